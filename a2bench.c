@@ -0,0 +1,535 @@
+/**************************************************************
+ *
+ *                     a2bench.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Microbenchmarks for the A2Methods primitives: 'at' and
+ *     every mapping function of both suites, over several
+ *     element sizes and array shapes. With -block-shapes the
+ *     blocked suite is also run with each of the given block
+ *     shapes, to sweep them.
+ *
+ *     Each repetition times the operation and then a reference
+ *     loop that reads the same number of cells from a plain C
+ *     buffer. The ratio of the two cancels most of the drift in
+ *     machine speed between and during runs (frequency scaling,
+ *     noisy neighbors), so ratios are what get compared. The
+ *     median ratio of several repetitions is kept; if the spread
+ *     of the ratios (median absolute deviation over the median)
+ *     is above 5% the benchmark is run again, and it is reported
+ *     as unstable if it never settles.
+ *
+ *     With -baseline, ratios are compared with a saved file. A
+ *     stable result slower than its baseline by more than the
+ *     threshold is measured again, on a new array, after the
+ *     whole pass, and counts as a regression only if every
+ *     re-measurement is slower too: the spread check only sees
+ *     noise within one measurement, not drift between runs. The
+ *     program exits with status 1 if any regression is confirmed.
+ *
+ *     Example commands:
+ *     ./a2bench -write a2bench.baseline
+ *     ./a2bench -baseline a2bench.baseline -threshold 10
+ *     ./a2bench -block-shapes 64x64,256x16,16x256
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "cputiming.h"
+
+#define MAX_REPS 31
+#define ATTEMPTS 3
+#define STABLE_SPREAD 0.05
+#define MAX_BASELINE 256
+#define MAX_BLOCK_SHAPES 8
+#define CONFIRMATIONS 2         /* re-measurements of a slow result */
+
+typedef A2Methods_UArray2 A2;
+
+/* a benchmarked operation: walks every cell of the array once */
+typedef void Operation(A2Methods_T methods, A2 array2);
+
+typedef struct Benchmark {
+        const char *name;
+        Operation *run;
+} Benchmark;
+
+typedef struct Shape {
+        int width, height;
+} Shape;
+
+typedef struct Baseline {
+        char name[64];
+        double ns_per_cell;
+        double ratio;           /* to the reference loop */
+} Baseline;
+
+/* Candidate is a result over the threshold, kept to be measured again
+ * after the pass
+ */
+typedef struct Candidate {
+        char name[64];
+        A2Methods_T methods;
+        Operation *run;
+        int size;
+        Shape shape, block;
+        double base_ratio;
+        double change;
+} Candidate;
+
+/* Result is one measured benchmark */
+typedef struct Result {
+        double ns_per_cell;     /* median */
+        double ratio;           /* median ratio to the reference loop */
+        double spread;          /* of the ratios */
+} Result;
+
+/* keeps the reads of every cell from being optimized away */
+static volatile unsigned sink;
+
+static void usage(const char *progname);
+static int load_baseline(const char *filename, Baseline *baseline);
+static int parse_block_shapes(char *list, Shape *block_shapes);
+static Result measure(Operation *run, A2Methods_T methods, A2 array2,
+                      int reps);
+static int confirm(Candidate *candidate, int reps, double threshold);
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ *                   The operations
+ * - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* run_reference
+ *    Purpose: read the first byte of as many cells as the array has, in
+ *             a plain C buffer of the same size, with no A2Methods calls
+ */
+static void run_reference(const unsigned char *buffer, int cells, int size)
+{
+        unsigned sum = 0;
+        for (int k = 0; k < cells; k++) {
+                sum += buffer[(size_t)k * size];
+        }
+        sink = sum;
+}
+
+static void run_at(A2Methods_T methods, A2 array2)
+{
+        unsigned sum = 0;
+        int width = methods->width(array2);
+        int height = methods->height(array2);
+        for (int j = 0; j < height; j++) {
+                for (int i = 0; i < width; i++) {
+                        sum += *(unsigned char *)methods->at(array2, i, j);
+                }
+        }
+        sink = sum;
+}
+
+static void add_cell(int i, int j, A2 array2, A2Methods_Object *ptr,
+                     void *cl)
+{
+        (void)i;
+        (void)j;
+        (void)array2;
+        *(unsigned *)cl += *(unsigned char *)ptr;
+}
+
+static void add_small(A2Methods_Object *ptr, void *cl)
+{
+        *(unsigned *)cl += *(unsigned char *)ptr;
+}
+
+#define MAP_OPERATION(kind)                                               \
+static void run_##kind(A2Methods_T methods, A2 array2)                    \
+{                                                                         \
+        unsigned sum = 0;                                                 \
+        methods->kind(array2, add_cell, &sum);                            \
+        sink = sum;                                                       \
+}                                                                         \
+static void run_small_##kind(A2Methods_T methods, A2 array2)              \
+{                                                                         \
+        unsigned sum = 0;                                                 \
+        methods->small_##kind(array2, add_small, &sum);                   \
+        sink = sum;                                                       \
+}
+
+MAP_OPERATION(map_row_major)
+MAP_OPERATION(map_col_major)
+MAP_OPERATION(map_block_major)
+
+static void run_map_tiled(A2Methods_T methods, A2 array2)
+{
+        unsigned sum = 0;
+        methods->map_tiled(array2, 0, add_cell, &sum);
+        sink = sum;
+}
+
+static Benchmark plain_benchmarks[] = {
+        { "at", run_at },
+        { "map_row_major", run_map_row_major },
+        { "map_col_major", run_map_col_major },
+        { "small_map_row_major", run_small_map_row_major },
+        { "small_map_col_major", run_small_map_col_major },
+        { "map_tiled", run_map_tiled },
+};
+
+static Benchmark blocked_benchmarks[] = {
+        { "at", run_at },
+        { "map_block_major", run_map_block_major },
+        { "small_map_block_major", run_small_map_block_major },
+};
+
+static int sizes[] = { 1, 4, 12 };
+static Shape shapes[] = { { 1000, 1000 }, { 4000, 250 }, { 250, 4000 } };
+
+int main(int argc, char *argv[])
+{
+        const char *baseline_name = NULL;
+        const char *write_name = NULL;
+        double threshold = 10;
+        int reps = 7;
+        Shape block_shapes[MAX_BLOCK_SHAPES];
+        int block_shape_count = 0;
+
+        for (int i = 1; i < argc; i++) {
+                if (i + 1 == argc) {
+                        usage(argv[0]);
+                } else if (strcmp(argv[i], "-baseline") == 0) {
+                        baseline_name = argv[++i];
+                } else if (strcmp(argv[i], "-write") == 0) {
+                        write_name = argv[++i];
+                } else if (strcmp(argv[i], "-threshold") == 0) {
+                        threshold = atof(argv[++i]);
+                } else if (strcmp(argv[i], "-reps") == 0) {
+                        reps = atoi(argv[++i]);
+                } else if (strcmp(argv[i], "-block-shapes") == 0) {
+                        block_shape_count = parse_block_shapes(argv[++i],
+                                                               block_shapes);
+                        if (block_shape_count == 0) {
+                                usage(argv[0]);
+                        }
+                } else {
+                        usage(argv[0]);
+                }
+        }
+        if (reps < 3 || reps > MAX_REPS || threshold <= 0) {
+                usage(argv[0]);
+        }
+
+        Baseline baseline[MAX_BASELINE];
+        int baseline_count = 0;
+        if (baseline_name != NULL) {
+                baseline_count = load_baseline(baseline_name, baseline);
+                if (baseline_count < 0) {
+                        fprintf(stderr, "%s: cannot read baseline %s\n",
+                                argv[0], baseline_name);
+                        exit(EXIT_FAILURE);
+                }
+        }
+        FILE *write_fp = NULL;
+        if (write_name != NULL) {
+                write_fp = fopen(write_name, "w");
+                if (write_fp == NULL) {
+                        fprintf(stderr, "%s: cannot write %s\n", argv[0],
+                                write_name);
+                        exit(EXIT_FAILURE);
+                }
+                fprintf(write_fp, "# a2bench baseline, %d reps: name, median "
+                                  "CPU ns per cell, median ratio to the "
+                                  "reference loop\n", reps);
+        }
+
+        Candidate candidates[MAX_BASELINE];
+        int candidate_count = 0;
+        int regressions = 0, unstable = 0;
+        printf("%-50s %9s %7s %7s %7s %8s\n", "benchmark", "ns/cell",
+               "ratio", "spread", "base", "change");
+
+        /* the plain suite, the blocked suite, then one per block shape */
+        for (int suite = 0; suite < 2 + block_shape_count; suite++) {
+                A2Methods_T methods = uarray2_methods_plain;
+                Shape block = { 0, 0 };
+                char label[32] = "plain";
+                if (suite == 1) {
+                        methods = uarray2_methods_blocked;
+                        strcpy(label, "blocked");
+                } else if (suite > 1) {
+                        block = block_shapes[suite - 2];
+                        methods = uarray2_methods_blocked;
+                        snprintf(label, sizeof(label), "blocked[%dx%d]",
+                                 block.width, block.height);
+                }
+                Benchmark *benchmarks = suite == 0 ? plain_benchmarks
+                                                   : blocked_benchmarks;
+                int count = suite == 0
+                        ? sizeof(plain_benchmarks) / sizeof(Benchmark)
+                        : sizeof(blocked_benchmarks) / sizeof(Benchmark);
+
+                for (size_t s = 0; s < sizeof(sizes) / sizeof(int); s++) {
+                for (size_t h = 0; h < sizeof(shapes) / sizeof(Shape); h++) {
+                        Shape shape = shapes[h];
+                        A2 array2 = block.width == 0
+                                ? methods->new(shape.width, shape.height,
+                                               sizes[s])
+                                : methods->new_with_block_shape(
+                                        shape.width, shape.height, sizes[s],
+                                        block.width, block.height);
+                        for (int b = 0; b < count; b++) {
+                                char name[64];
+                                snprintf(name, sizeof(name), "%s.%s.%dB.%dx%d",
+                                         label, benchmarks[b].name, sizes[s],
+                                         shape.width, shape.height);
+
+                                Result result = measure(benchmarks[b].run,
+                                                        methods, array2,
+                                                        reps);
+                                int stable = result.spread <= STABLE_SPREAD;
+                                unstable += !stable;
+                                printf("%-50s %9.3f %7.3f %6.1f%%", name,
+                                       result.ns_per_cell, result.ratio,
+                                       100 * result.spread);
+                                if (write_fp != NULL) {
+                                        fprintf(write_fp, "%s %.4f %.4f\n",
+                                                name, result.ns_per_cell,
+                                                result.ratio);
+                                }
+
+                                int k = 0;
+                                while (k < baseline_count &&
+                                       strcmp(baseline[k].name, name) != 0) {
+                                        k++;
+                                }
+                                if (k == baseline_count) {
+                                        printf(" %7s %8s\n", "-", "-");
+                                        continue;
+                                }
+                                double change = 100 * (result.ratio /
+                                        baseline[k].ratio - 1);
+                                int slower = stable && change > threshold &&
+                                             candidate_count < MAX_BASELINE;
+                                if (slower) {
+                                        Candidate *c =
+                                                &candidates[candidate_count++];
+                                        strcpy(c->name, name);
+                                        c->methods = methods;
+                                        c->run = benchmarks[b].run;
+                                        c->size = sizes[s];
+                                        c->shape = shape;
+                                        c->block = block;
+                                        c->base_ratio = baseline[k].ratio;
+                                        c->change = change;
+                                }
+                                printf(" %7.3f %+7.1f%%%s\n",
+                                       baseline[k].ratio, change,
+                                       slower ? "  slower"
+                                              : stable ? "" : "  unstable");
+                        }
+                        methods->free(&array2);
+                }
+                }
+        }
+
+        if (write_fp != NULL) {
+                fclose(write_fp);
+        }
+        if (candidate_count > 0) {
+                printf("\nslower results measured again:\n");
+        }
+        for (int c = 0; c < candidate_count; c++) {
+                int regressed = confirm(&candidates[c], reps, threshold);
+                regressions += regressed;
+                printf("%-50s %+7.1f%%%s\n", candidates[c].name,
+                       candidates[c].change,
+                       regressed ? "  REGRESSION" : "  not confirmed");
+        }
+        printf("\n%d regressions over %.0f%%, %d unstable results\n",
+               regressions, threshold, unstable);
+        return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* usage
+ * Purpose: Describe the command line on standard error and exit
+ * Parameters: the program name
+ * Returns: does not return
+ *
+ * Expected input: a non-null program name
+ * Success output: none
+ * Failure output: the usage message on standard error
+ */
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s [-baseline <file>] [-write <file>] "
+                        "[-threshold <percent>] [-reps <3..%d>] "
+                        "[-block-shapes <W>x<H>[,<W>x<H>...]]\n",
+                progname, MAX_REPS);
+        exit(1);
+}
+
+/* parse_block_shapes
+ *    Purpose: parse a comma-separated list of block shapes WIDTHxHEIGHT
+ *    Returns: the number of shapes, or 0 if the list is not valid or has
+ *             more than MAX_BLOCK_SHAPES
+ */
+static int parse_block_shapes(char *list, Shape *block_shapes)
+{
+        int count = 0;
+        for (char *item = strtok(list, ","); item != NULL;
+             item = strtok(NULL, ",")) {
+                int end = 0;
+                if (count == MAX_BLOCK_SHAPES ||
+                    sscanf(item, "%dx%d%n", &block_shapes[count].width,
+                           &block_shapes[count].height, &end) != 2 ||
+                    item[end] != '\0' || block_shapes[count].width < 1 ||
+                    block_shapes[count].height < 1) {
+                        return 0;
+                }
+                count++;
+        }
+        return count;
+}
+
+/* compare_doubles
+ *    Purpose: qsort comparison for doubles in increasing order
+ */
+static int compare_doubles(const void *a, const void *b)
+{
+        double x = *(const double *)a, y = *(const double *)b;
+        return (x > y) - (x < y);
+}
+
+/* median
+ *    Purpose: the median of n values, which are sorted in place
+ */
+static double median(double *values, int n)
+{
+        qsort(values, n, sizeof(double), compare_doubles);
+        return n % 2 ? values[n / 2]
+                     : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/* measure
+ *    Purpose: time an operation and the reference loop 'reps' times each,
+ *             after a warm-up run, trying again if the ratios are spread
+ *             out, and keep the attempt with the least spread
+ *    Returns: the medians and the spread of the ratios
+ */
+static Result measure(Operation *run, A2Methods_T methods, A2 array2,
+                      int reps)
+{
+        int cells = methods->width(array2) * methods->height(array2);
+        int size = methods->size(array2);
+        unsigned char *buffer = calloc(cells, size);
+        assert(buffer != NULL);
+
+        CPUTime_T timer = CPUTime_New();
+        Result best = { 0, 0, -1 };
+
+        for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+                double times[MAX_REPS], ratios[MAX_REPS];
+                double deviations[MAX_REPS];
+                run(methods, array2);
+                run_reference(buffer, cells, size);
+                for (int r = 0; r < reps; r++) {
+                        CPUTime_Start(timer);
+                        run(methods, array2);
+                        times[r] = CPUTime_Stop(timer) / cells;
+                        CPUTime_Start(timer);
+                        run_reference(buffer, cells, size);
+                        double reference = CPUTime_Stop(timer) / cells;
+                        ratios[r] = times[r] / (reference > 0 ? reference
+                                                              : 1);
+                }
+                double ratio = median(ratios, reps);
+                for (int r = 0; r < reps; r++) {
+                        deviations[r] = ratios[r] > ratio ? ratios[r] - ratio
+                                                          : ratio - ratios[r];
+                }
+                double spread = ratio > 0 ? median(deviations, reps) / ratio
+                                          : 0;
+
+                if (best.spread < 0 || spread < best.spread) {
+                        best.ns_per_cell = median(times, reps);
+                        best.ratio = ratio;
+                        best.spread = spread;
+                }
+                if (best.spread <= STABLE_SPREAD) {
+                        break;
+                }
+        }
+
+        CPUTime_Free(&timer);
+        free(buffer);
+        return best;
+}
+
+/* confirm
+ *    Purpose: measure a slow result again CONFIRMATIONS times, each on a
+ *             new array, keeping the smallest change in the candidate
+ *    Returns: 1 if every re-measurement is stable and slower than the
+ *             baseline by more than the threshold, and 0 otherwise
+ */
+static int confirm(Candidate *candidate, int reps, double threshold)
+{
+        A2Methods_T methods = candidate->methods;
+        for (int c = 0; c < CONFIRMATIONS; c++) {
+                A2 array2 = candidate->block.width == 0
+                        ? methods->new(candidate->shape.width,
+                                       candidate->shape.height,
+                                       candidate->size)
+                        : methods->new_with_block_shape(
+                                candidate->shape.width,
+                                candidate->shape.height, candidate->size,
+                                candidate->block.width,
+                                candidate->block.height);
+                Result result = measure(candidate->run, methods, array2,
+                                        reps);
+                methods->free(&array2);
+
+                double change = 100 * (result.ratio / candidate->base_ratio
+                                       - 1);
+                if (change < candidate->change) {
+                        candidate->change = change;
+                }
+                if (result.spread > STABLE_SPREAD || change <= threshold) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/* load_baseline
+ *    Purpose: read "name ns_per_cell ratio" lines, skipping # comments
+ *    Returns: the number of entries read, or -1 if the file cannot be read
+ */
+static int load_baseline(const char *filename, Baseline *baseline)
+{
+        FILE *fp = fopen(filename, "r");
+        if (fp == NULL) {
+                return -1;
+        }
+        char line[128];
+        int count = 0;
+        while (count < MAX_BASELINE && fgets(line, sizeof(line), fp)) {
+                if (line[0] == '#') {
+                        continue;
+                }
+                if (sscanf(line, "%63s %lf %lf", baseline[count].name,
+                           &baseline[count].ns_per_cell,
+                           &baseline[count].ratio) == 3 &&
+                    baseline[count].ratio > 0) {
+                        count++;
+                }
+        }
+        fclose(fp);
+        return count;
+}
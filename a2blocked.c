@@ -1,24 +1,51 @@
 #include <string.h>
 
-#include <a2blocked.h>
+#include "assert.h"
+#include "a2blocked.h"
 #include "uarray2b.h"
+#include "memstats.h"
 
 // define a private version of each function in A2Methods_T that we implement
 
 typedef A2Methods_UArray2 A2;	// private abbreviation
 
+// the bytes of an array's blocks, unused cells included, for MemStats
+
+static size_t footprint(UArray2b_T array2)
+{
+	return UArray2b_storage_size(UArray2b_width(array2),
+				     UArray2b_height(array2),
+				     UArray2b_size(array2),
+				     UArray2b_block_width(array2),
+				     UArray2b_block_height(array2));
+}
+
+static A2 counted(UArray2b_T array2)
+{
+	MemStats_allocated(footprint(array2));
+	return array2;
+}
+
 static A2 new(int width, int height, int size)
 {
-	return UArray2b_new_64K_block(width, height, size);
+	return counted(UArray2b_new_64K_block(width, height, size));
 }
 
 static A2 new_with_blocksize(int width, int height, int size, int blocksize)
 {
-	return UArray2b_new(width, height, size, blocksize);
+	return counted(UArray2b_new(width, height, size, blocksize));
+}
+
+static A2 new_with_block_shape(int width, int height, int size,
+				int block_width, int block_height)
+{
+	return counted(UArray2b_new_shape(width, height, size, block_width,
+					  block_height));
 }
 
 static void a2free(A2 * array2p)
 {
+	MemStats_released(footprint(*array2p));
 	UArray2b_free((UArray2b_T *) array2p);
 }
 
@@ -39,11 +66,31 @@ static int blocksize(A2 array2)
 	return UArray2b_blocksize(array2);
 }
 
+static void block_shape(A2 array2, int *block_width, int *block_height)
+{
+	*block_width = UArray2b_block_width(array2);
+	*block_height = UArray2b_block_height(array2);
+}
+
 static A2Methods_Object *at(A2 array2, int i, int j)
 {
 	return UArray2b_at(array2, i, j);
 }
 
+// cells of a blocked array are not in strided rows, so no raw access
+
+static void *data(A2 array2)
+{
+	(void)array2;
+	return NULL;
+}
+
+static int stride(A2 array2)
+{
+	(void)array2;
+	return 0;
+}
+
 typedef void applyfun(int i, int j, UArray2b_T array2b, void *elem, void *cl);
 
 static void map_block_major(A2 array2, A2Methods_applyfun apply, void *cl)
@@ -89,6 +136,11 @@ static struct A2Methods_T uarray2_methods_blocked_struct = {
 	NULL,			// small_map_col_major
 	small_map_block_major,
 	small_map_block_major,	// small_map_default
+	data,
+	stride,
+	NULL,			// map_tiled: blocks already give that order
+	new_with_block_shape,
+	block_shape,
 };
 
 // finally the payoff: here is the exported pointer to the struct
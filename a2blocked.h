@@ -0,0 +1,25 @@
+/**************************************************************
+ *
+ *                     a2blocked.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The methods suite for UArray2b, the blocked arrays.
+ *
+ **************************************************************/
+
+#ifndef A2BLOCKED_INCLUDED
+#define A2BLOCKED_INCLUDED
+
+#include "a2methods.h"
+
+/* every UArray2b array, whatever its block shape: 'new' makes the
+ * default blocks and 'new_with_block_shape' any other shape, which the
+ * array keeps for its life
+ */
+extern A2Methods_T uarray2_methods_blocked;
+
+#endif
@@ -1,26 +1,51 @@
 #include <string.h>
-#include <a2plain.h>
+#include <math.h>
+#include "a2plain.h"
 #include "uarray2.h"
+#include "memstats.h"
 
 /************************************************/
 /* Define a private version of each function in */
 /* A2Methods_T that we implement.               */
 /************************************************/
 
+/* the bytes of an array's cells, padding included, for MemStats */
+static size_t footprint(UArray2_T array2)
+{
+    return (size_t)UArray2_stride(array2) * UArray2_height(array2);
+}
+
+static A2Methods_UArray2 counted_new(int width, int height, int size)
+{
+    UArray2_T array2 = UArray2_new(width, height, size);
+    MemStats_allocated(footprint(array2));
+    return array2;
+}
+
 static A2Methods_UArray2 new(int width, int height, int size)
 {
-    return UArray2_new(width, height, size);
+    return counted_new(width, height, size);
 }
 
 static A2Methods_UArray2 new_with_blocksize(int width, int height,
                                           int size, int blocksize)
 {
     (void) blocksize;
-    return UArray2_new(width, height, size);
+    return counted_new(width, height, size);
+}
+
+static A2Methods_UArray2 new_with_block_shape(int width, int height,
+                                              int size, int block_width,
+                                              int block_height)
+{
+    (void) block_width;
+    (void) block_height;
+    return counted_new(width, height, size);
 }
 
 static void a2free(A2Methods_UArray2 * array2p)
 {
+    MemStats_released(footprint(*array2p));
     UArray2_free((UArray2_T *) array2p);
 }
 
@@ -45,11 +70,29 @@ static int blocksize(A2Methods_UArray2 array2)
     return 1;
 }
 
+static void block_shape(A2Methods_UArray2 array2, int *block_width,
+                        int *block_height)
+{
+    (void) array2;
+    *block_width = 1;
+    *block_height = 1;
+}
+
 static A2Methods_Object *at(A2Methods_UArray2 array2, int i, int j)
 {
     return UArray2_at(array2, i, j);
 }
 
+static void *data(A2Methods_UArray2 array2)
+{
+    return UArray2_data(array2);
+}
+
+static int stride(A2Methods_UArray2 array2)
+{
+    return UArray2_stride(array2);
+}
+
 static void map_row_major(A2Methods_UArray2 uarray2,
                           A2Methods_applyfun apply,
                           void *cl)
@@ -64,6 +107,18 @@ static void map_col_major(A2Methods_UArray2 uarray2,
     UArray2_map_col_major(uarray2, (UArray2_applyfun*)apply, cl);
 }
 
+static void map_tiled(A2Methods_UArray2 uarray2, int tile,
+                      A2Methods_applyfun apply, void *cl)
+{
+    if (tile < 1) {
+        /* as large as possible with the tile within 64KB, like the
+         * blocks of the blocked suite */
+        tile = sqrt(64 * 1024 / UArray2_size(uarray2));
+        tile = tile < 1 ? 1 : tile;
+    }
+    UArray2_map_tiled(uarray2, tile, (UArray2_applyfun*)apply, cl);
+}
+
 struct small_closure {
     A2Methods_smallapplyfun *apply; 
     void                    *cl;
@@ -112,6 +167,11 @@ static struct A2Methods_T uarray2_methods_plain_struct = {
     small_map_col_major,
     NULL,
     small_map_row_major,
+    data,
+    stride,
+    map_tiled,
+    new_with_block_shape,
+    block_shape,
 };
 
 /* Finally the payoff: here is the exported pointer to the struct */
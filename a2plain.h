@@ -0,0 +1,21 @@
+/**************************************************************
+ *
+ *                     a2plain.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The methods suite for UArray2, the plain (unblocked) arrays.
+ *
+ **************************************************************/
+
+#ifndef A2PLAIN_INCLUDED
+#define A2PLAIN_INCLUDED
+
+#include "a2methods.h"
+
+extern A2Methods_T uarray2_methods_plain;
+
+#endif
@@ -1,9 +1,16 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "assert.h"
 #include "a2methods.h"
 #include "a2plain.h"
 #include "a2blocked.h"
+#include "uarray2.h"
+#include "uarray2b.h"
+#include "relayout.h"
+#include "ppmio.h"
+#include "tiled.h"
 
 
 #define W 13
@@ -161,11 +168,293 @@ static void test_methods(A2Methods_T methods_under_test)
         methods->free(&array);
 }
 
+/* every cell of a plain array is at data + j * stride + i * size, with
+ * rows padded to the stride but never overlapping
+ */
+static void test_stride(void)
+{
+        A2Methods_T plain = uarray2_methods_plain;
+        int sizes[] = { 1, 3, 4, 12 };
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                A2 array = plain->new(W, H, sizes[s]);
+                char *data = plain->data(array);
+                int stride = plain->stride(array);
+                assert(data != NULL && stride >= W * sizes[s]);
+                for (int j = 0; j < H; j++) {
+                        for (int i = 0; i < W; i++) {
+                                assert((char *)plain->at(array, i, j) ==
+                                       data + (size_t)j * stride
+                                            + (size_t)i * sizes[s]);
+                        }
+                }
+                plain->free(&array);
+        }
+}
+
+static int released;
+
+static void count_release(void *storage, void *cl)
+{
+        assert(storage == cl);
+        released++;
+}
+
+/* a wrapped array addresses the caller's buffer with the caller's stride
+ * and hands the buffer back when freed
+ */
+static void test_wrap(void)
+{
+        enum { STRIDE = W * sizeof(unsigned) + 12 };
+        static unsigned char buffer[STRIDE * H];
+        A2Methods_T plain = uarray2_methods_plain;
+        A2 array = UArray2_wrap(W, H, sizeof(unsigned), STRIDE, buffer,
+                                count_release, buffer);
+        assert(plain->data(array) == buffer);
+        assert(plain->stride(array) == STRIDE);
+        for (int j = 0; j < H; j++) {
+                for (int i = 0; i < W; i++) {
+                        copy_unsigned(plain, array, i, j, 1000 * i + j);
+                }
+        }
+        for (int j = 0; j < H; j++) {
+                for (int i = 0; i < W; i++) {
+                        unsigned n;
+                        memcpy(&n, buffer + j * STRIDE + i * sizeof(n),
+                               sizeof(n));
+                        assert(n == (unsigned)(1000 * i + j));
+                }
+        }
+        released = 0;
+        plain->free(&array);
+        assert(released == 1 && array == NULL);
+}
+
+/* VisitData records which cells a mapping visited and checks that tiles
+ * come in row-major order
+ */
+typedef struct VisitData {
+        int width, tile;
+        int *counts;
+        long last_tile;
+} VisitData;
+
+static void count_visit(int i, int j, A2 a, void *elem, void *cl)
+{
+        VisitData *visits = cl;
+        assert(elem == uarray2_methods_plain->at(a, i, j));
+        long tiles_across = (visits->width + visits->tile - 1) / visits->tile;
+        long tile = (long)(j / visits->tile) * tiles_across
+                    + i / visits->tile;
+        assert(tile >= visits->last_tile);
+        visits->last_tile = tile;
+        visits->counts[j * visits->width + i]++;
+}
+
+/* map_tiled visits every cell exactly once, tile by tile, for shapes and
+ * tiles that do not divide each other
+ */
+static void test_map_tiled(void)
+{
+        A2Methods_T plain = uarray2_methods_plain;
+        int shapes[][2] = { { 37, 23 }, { 1, 50 }, { 50, 1 }, { 100, 3 } };
+        int tiles[] = { 1, 3, 7, 64, 100 };
+        for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+                int width = shapes[s][0], height = shapes[s][1];
+                A2 array = plain->new(width, height, sizeof(unsigned));
+                int *counts = malloc(width * height * sizeof(int));
+                assert(counts != NULL);
+                for (size_t t = 0; t < sizeof(tiles) / sizeof(int); t++) {
+                        memset(counts, 0, width * height * sizeof(int));
+                        VisitData visits = { width, tiles[t], counts, 0 };
+                        plain->map_tiled(array, tiles[t], count_visit,
+                                         &visits);
+                        for (int k = 0; k < width * height; k++) {
+                                assert(counts[k] == 1);
+                        }
+                }
+                free(counts);
+                plain->free(&array);
+        }
+}
+
+/* fill_pattern and check_pattern give every byte of every cell a value
+ * that depends on its column, row and offset
+ */
+static unsigned char pattern(int i, int j, int k)
+{
+        return (unsigned char)(i * 31 + j * 17 + k * 5);
+}
+
+static void fill_pattern(int i, int j, A2 a, void *elem, void *cl)
+{
+        (void)a;
+        int size = *(int *)cl;
+        for (int k = 0; k < size; k++) {
+                ((unsigned char *)elem)[k] = pattern(i, j, k);
+        }
+}
+
+static void check_pattern(int i, int j, A2 a, void *elem, void *cl)
+{
+        (void)a;
+        int size = *(int *)cl;
+        for (int k = 0; k < size; k++) {
+                assert(((unsigned char *)elem)[k] == pattern(i, j, k));
+        }
+}
+
+/* BlockVisits checks a block-major mapping of a blocked array: each cell
+ * once, at the address 'at' gives, one block at a time in storage order
+ */
+typedef struct BlockVisits {
+        int width, block_width, block_height;
+        int *counts;
+        long last_block;
+        char *storage, *end;
+} BlockVisits;
+
+static void visit_block_cell(int i, int j, A2 a, void *elem, void *cl)
+{
+        BlockVisits *visits = cl;
+        assert(elem == uarray2_methods_blocked->at(a, i, j));
+        assert((char *)elem >= visits->storage && (char *)elem < visits->end);
+        long blocks_across = (visits->width + visits->block_width - 1)
+                             / visits->block_width;
+        long block = (long)(j / visits->block_height) * blocks_across
+                     + i / visits->block_width;
+        assert(block >= visits->last_block);
+        visits->last_block = block;
+        visits->counts[j * visits->width + i]++;
+}
+
+/* rectangular blocks with ragged edges: 'at' and map_block_major agree
+ * on every cell, the shape is kept, and the cells fit the storage size
+ */
+static void test_block_shapes(void)
+{
+        A2Methods_T blocked = uarray2_methods_blocked;
+        int shapes[][2] = { { 5, 3 }, { 3, 7 }, { 16, 1 }, { 1, 9 } };
+        enum { WIDTH = 37, HEIGHT = 23 };
+        int size = 12;
+        static int counts[WIDTH * HEIGHT];
+        for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+                int bw = shapes[s][0], bh = shapes[s][1];
+                A2 array = blocked->new_with_block_shape(WIDTH, HEIGHT, size,
+                                                         bw, bh);
+                int block_width, block_height;
+                blocked->block_shape(array, &block_width, &block_height);
+                assert(block_width == bw && block_height == bh);
+                assert(blocked->blocksize(array) == bw);
+                assert(blocked->data(array) == NULL);
+
+                for (int j = 0; j < HEIGHT; j++) {
+                        for (int i = 0; i < WIDTH; i++) {
+                                fill_pattern(i, j, array,
+                                             blocked->at(array, i, j),
+                                             &size);
+                        }
+                }
+                memset(counts, 0, sizeof(counts));
+                char *storage = UArray2b_storage(array);
+                BlockVisits visits = {
+                        WIDTH, bw, bh, counts, 0, storage,
+                        storage + UArray2b_storage_size(WIDTH, HEIGHT, size,
+                                                        bw, bh)
+                };
+                blocked->map_block_major(array, visit_block_cell, &visits);
+                blocked->map_block_major(array, check_pattern, &size);
+                for (int k = 0; k < WIDTH * HEIGHT; k++) {
+                        assert(counts[k] == 1);
+                }
+                blocked->free(&array);
+        }
+}
+
+/* plain to blocked to plain gives back every byte, for an image large
+ * enough that the relayout runs on several threads
+ */
+static void test_relayout(void)
+{
+        A2Methods_T plain = uarray2_methods_plain;
+        A2Methods_T blocked = uarray2_methods_blocked;
+        int shapes[][2] = { { 0, 0 }, { 48, 20 } };
+        int sizes[] = { 4, 12 };
+        for (size_t z = 0; z < sizeof(sizes) / sizeof(int); z++) {
+                int size = sizes[z];
+                A2 source = plain->new(701, 401, size);
+                plain->map_row_major(source, fill_pattern, &size);
+                for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]);
+                     s++) {
+                        A2 blocks = A2_relayout(plain, source, blocked,
+                                                shapes[s][0], shapes[s][1]);
+                        blocked->map_block_major(blocks, check_pattern,
+                                                 &size);
+                        A2 back = A2_relayout(blocked, blocks, plain, 0, 0);
+                        assert(plain->width(back) == 701 &&
+                               plain->height(back) == 401);
+                        plain->map_row_major(back, check_pattern, &size);
+                        blocked->free(&blocks);
+                        plain->free(&back);
+                }
+                plain->free(&source);
+        }
+}
+
+/* a tiled file written from rectangular blocks reads back with the same
+ * blocks, and into the plain suite, with every pixel intact
+ */
+static void test_tiled(void)
+{
+        A2Methods_T blocked = uarray2_methods_blocked;
+        int sizes[] = { sizeof(struct Pnm_rgb), sizeof(struct Pnm_rgb16) };
+        unsigned maxvals[] = { 255, 1000 };
+        for (int z = 0; z < 2; z++) {
+                int size = sizes[z];
+                struct Pnm_ppm image = { 37, 23, maxvals[z], NULL, blocked };
+                image.pixels = blocked->new_with_block_shape(37, 23, size,
+                                                             5, 3);
+                blocked->map_block_major(image.pixels, fill_pattern, &size);
+
+                FILE *fp = tmpfile();
+                assert(fp != NULL);
+                Tiled_write(fp, &image);
+
+                A2Methods_T suites[] = { blocked, uarray2_methods_plain };
+                for (int s = 0; s < 2; s++) {
+                        char magic[2];
+                        rewind(fp);
+                        assert(fread(magic, 1, 2, fp) == 2);
+                        Pnm_ppm copy = Tiled_read(fp, magic, 2, suites[s],
+                                                  0, 0);
+                        assert(copy != NULL);
+                        assert(copy->width == 37 && copy->height == 23);
+                        assert(copy->denominator == maxvals[z]);
+                        assert(copy->methods == suites[s]);
+                        int block_width, block_height;
+                        suites[s]->block_shape(copy->pixels, &block_width,
+                                               &block_height);
+                        assert(s == 1 ||
+                               (block_width == 5 && block_height == 3));
+                        suites[s]->map_default(copy->pixels, check_pattern,
+                                               &size);
+                        Pnm_ppmfree(&copy);
+                }
+                fclose(fp);
+                blocked->free(&image.pixels);
+        }
+}
+
 int main(int argc, char *argv[])
 {
         assert(argc == 1);
         (void)argv;
         test_methods(uarray2_methods_plain);
+        test_stride();
+        test_wrap();
+        test_map_tiled();
+        test_block_shapes();
+        test_relayout();
+        test_tiled();
         /*  test_methods(uarray2_methods_blocked); */
         printf("Passed.\n");  /* only if we reach this point without
                                * assertion failure
@@ -0,0 +1,196 @@
+#include "a2traced.h"
+
+// the suite every call is forwarded to, and where the trace goes
+
+static A2Methods_T base;
+static CacheSim_T sim;
+
+typedef A2Methods_UArray2 A2;	// private abbreviation
+
+static A2 new(int width, int height, int size)
+{
+	return base->new(width, height, size);
+}
+
+static A2 new_with_blocksize(int width, int height, int size, int blocksize)
+{
+	return base->new_with_blocksize(width, height, size, blocksize);
+}
+
+static A2 new_with_block_shape(int width, int height, int size,
+				int block_width, int block_height)
+{
+	return base->new_with_block_shape(width, height, size, block_width,
+					  block_height);
+}
+
+static void a2free(A2 * array2p)
+{
+	base->free(array2p);
+}
+
+static int width(A2 array2)
+{
+	return base->width(array2);
+}
+static int height(A2 array2)
+{
+	return base->height(array2);
+}
+static int size(A2 array2)
+{
+	return base->size(array2);
+}
+static int blocksize(A2 array2)
+{
+	return base->blocksize(array2);
+}
+
+static void block_shape(A2 array2, int *block_width, int *block_height)
+{
+	base->block_shape(array2, block_width, block_height);
+}
+
+static A2Methods_Object *at(A2 array2, int i, int j)
+{
+	A2Methods_Object *cell = base->at(array2, i, j);
+	CacheSim_access(sim, cell, base->size(array2));
+	return cell;
+}
+
+// each traced mapping passes the client's apply through one that
+// records the cell first
+
+struct closure {
+	A2Methods_applyfun *apply;
+	void *cl;
+	int size;
+};
+
+static void apply_traced(int i, int j, A2 array2, void *elem, void *vcl)
+{
+	struct closure *cl = vcl;
+	CacheSim_access(sim, elem, cl->size);
+	cl->apply(i, j, array2, elem, cl->cl);
+}
+
+struct small_closure {
+	A2Methods_smallapplyfun *apply;
+	void *cl;
+	int size;
+};
+
+static void apply_small_traced(void *elem, void *vcl)
+{
+	struct small_closure *cl = vcl;
+	CacheSim_access(sim, elem, cl->size);
+	cl->apply(elem, cl->cl);
+}
+
+static void map_row_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+	struct closure mycl = { apply, cl, base->size(array2) };
+	base->map_row_major(array2, apply_traced, &mycl);
+}
+
+static void map_col_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+	struct closure mycl = { apply, cl, base->size(array2) };
+	base->map_col_major(array2, apply_traced, &mycl);
+}
+
+static void map_block_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+	struct closure mycl = { apply, cl, base->size(array2) };
+	base->map_block_major(array2, apply_traced, &mycl);
+}
+
+static void map_tiled(A2 array2, int tile, A2Methods_applyfun apply,
+		      void *cl)
+{
+	struct closure mycl = { apply, cl, base->size(array2) };
+	base->map_tiled(array2, tile, apply_traced, &mycl);
+}
+
+static void map_default(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+	struct closure mycl = { apply, cl, base->size(array2) };
+	base->map_default(array2, apply_traced, &mycl);
+}
+
+static void small_map_row_major(A2 a2, A2Methods_smallapplyfun apply,
+				void *cl)
+{
+	struct small_closure mycl = { apply, cl, base->size(a2) };
+	base->small_map_row_major(a2, apply_small_traced, &mycl);
+}
+
+static void small_map_col_major(A2 a2, A2Methods_smallapplyfun apply,
+				void *cl)
+{
+	struct small_closure mycl = { apply, cl, base->size(a2) };
+	base->small_map_col_major(a2, apply_small_traced, &mycl);
+}
+
+static void small_map_block_major(A2 a2, A2Methods_smallapplyfun apply,
+				  void *cl)
+{
+	struct small_closure mycl = { apply, cl, base->size(a2) };
+	base->small_map_block_major(a2, apply_small_traced, &mycl);
+}
+
+static void small_map_default(A2 a2, A2Methods_smallapplyfun apply, void *cl)
+{
+	struct small_closure mycl = { apply, cl, base->size(a2) };
+	base->small_map_default(a2, apply_small_traced, &mycl);
+}
+
+// raw pointers would bypass the trace, so the traced suite never gives one
+
+static void *data(A2 array2)
+{
+	(void)array2;
+	return NULL;
+}
+
+static int stride(A2 array2)
+{
+	(void)array2;
+	return 0;
+}
+
+static struct A2Methods_T traced_struct;
+
+// the payoff: a suite shaped like 'base', with every access recorded
+
+A2Methods_T a2traced_methods(A2Methods_T base_methods, CacheSim_T simulator)
+{
+	base = base_methods;
+	sim = simulator;
+
+	struct A2Methods_T traced = {
+		new,
+		new_with_blocksize,
+		a2free,
+		width,
+		height,
+		size,
+		blocksize,
+		at,
+		base->map_row_major ? map_row_major : NULL,
+		base->map_col_major ? map_col_major : NULL,
+		base->map_block_major ? map_block_major : NULL,
+		map_default,
+		base->small_map_row_major ? small_map_row_major : NULL,
+		base->small_map_col_major ? small_map_col_major : NULL,
+		base->small_map_block_major ? small_map_block_major : NULL,
+		small_map_default,
+		data,
+		stride,
+		base->map_tiled ? map_tiled : NULL,
+		new_with_block_shape,
+		block_shape,
+	};
+	traced_struct = traced;
+	return &traced_struct;
+}
@@ -0,0 +1,32 @@
+/**************************************************************
+ *
+ *                     a2traced.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     An instrumented methods suite. It forwards every call to
+ *     another suite (plain or blocked) and feeds the address of
+ *     each cell returned by 'at' or visited by a mapping function
+ *     to a cache simulator, so a transform run with it produces
+ *     the trace its memory accesses would make.
+ *
+ *     Only one traced suite exists at a time: each call to
+ *     a2traced_methods replaces the previous suite and simulator.
+ *
+ **************************************************************/
+
+#ifndef A2TRACED_INCLUDED
+#define A2TRACED_INCLUDED
+
+#include "a2methods.h"
+#include "cachesim.h"
+
+/* The traced version of 'base'. Arrays it creates are arrays of 'base'.
+ * A mapping function the base suite lacks is NULL in the traced suite too
+ */
+extern A2Methods_T a2traced_methods(A2Methods_T base, CacheSim_T sim);
+
+#endif
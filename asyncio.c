@@ -0,0 +1,546 @@
+/**************************************************************
+ *
+ *                     asyncio.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the asynchronous file I/O. Every reader
+ *     or writer has a ring of DEPTH chunk slots, used in file
+ *     order. A reader issues every slot up front and reissues a
+ *     slot further on as soon as the caller has taken its bytes;
+ *     a writer issues a slot when the caller has filled it and
+ *     waits for it only when the ring comes back around to it.
+ *
+ *     Requests are carried out by pread/pwrite threads that are
+ *     started with the first reader or writer and shared by all of
+ *     them for the life of the process, so opening one costs no
+ *     thread creation. The tail of an O_DIRECT request that comes
+ *     back short is finished through the caller's own descriptor,
+ *     so callers only ever see whole chunks. An io_uring backend
+ *     is deferred until it can be built and tested here.
+ *
+ **************************************************************/
+
+#define _GNU_SOURCE             /* O_DIRECT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "assert.h"
+#include "asyncio.h"
+#include "trace.h"
+
+#define T AsyncIO_T
+
+#define CHUNK (1 << 20)         /* bytes per request */
+#define DEPTH 8                 /* requests in flight */
+#define ALIGN 4096              /* O_DIRECT buffer, offset and length unit */
+#define THREADS 4               /* shared pread/pwrite threads */
+
+typedef enum SlotState {
+        SLOT_FREE,              /* not issued: idle, or being filled */
+        SLOT_QUEUED,            /* issued, not yet picked up by a thread */
+        SLOT_BUSY,              /* being read or written by a thread */
+        SLOT_DONE               /* finished, 'result' is set */
+} SlotState;
+
+/* Slot is one chunk request */
+typedef struct Slot {
+        char *buffer;           /* CHUNK bytes, ALIGN-aligned */
+        off_t offset;
+        size_t length;          /* bytes asked for */
+        ssize_t result;         /* bytes moved, or -1 on error */
+        SlotState state;
+        int finished;           /* 'result' has been checked by finish */
+} Slot;
+
+struct T {
+        int fd;                 /* the fd requests go to */
+        int plain_fd;           /* the caller's fd, for finishing short
+                                   requests without O_DIRECT alignment */
+        int direct;             /* fd was reopened with O_DIRECT */
+        int writing;
+        int failed;
+        Slot slots[DEPTH];
+        int head;               /* the slot the caller is at */
+        size_t pos;             /* bytes of the head slot taken or filled */
+        off_t next_offset;      /* where the next request starts */
+        off_t end;              /* reader: end of the range */
+        T next;                 /* the next open reader or writer */
+};
+
+static T new_io(int fd, int writing);
+static void end_io(T io);
+static SlotState slot_state(T io, Slot *slot);
+static void free_slot(T io, Slot *slot);
+static void submit(T io, Slot *slot);
+static void wait_done(T io, Slot *slot);
+static void finish(T io, Slot *slot);
+static void issue_read(T io, Slot *slot);
+
+/* AsyncIO_usable
+ * Purpose: Tell whether a file descriptor can be used for asynchronous
+ *          requests at offsets
+ * Parameters: the descriptor and 1 to write it or 0 to read it
+ * Returns: 1 if it can and 0 otherwise
+ *
+ * Expected input: any descriptor
+ * Success output: none
+ * Failure output: none
+ */
+int AsyncIO_usable(int fd, int writing)
+{
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 ||
+            !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+                return 0;
+        }
+        int flags = fcntl(fd, F_GETFL);
+        return flags != -1 && !(writing && (flags & O_APPEND));
+}
+
+/* AsyncIO_reader
+ * Purpose: Start reading a range of a file, DEPTH chunks ahead
+ * Parameters: the descriptor, the offset and length of the range, and
+ *             1 to bypass the page cache
+ * Returns: the reader, closed with AsyncIO_close
+ *
+ * Expected input: a descriptor AsyncIO_usable accepts for reading
+ * Success output: none
+ * Failure output: CRE if the descriptor is negative
+ */
+T AsyncIO_reader(int fd, off_t offset, off_t length, int direct)
+{
+        assert(fd >= 0 && offset >= 0 && length >= 0);
+        T io = new_io(fd, 0);
+        if (direct) {
+                char path[64];
+                snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+                int direct_fd = open(path, O_RDONLY | O_DIRECT);
+                if (direct_fd >= 0) {
+                        io->fd = direct_fd;
+                        io->direct = 1;
+                }
+        }
+
+        /* O_DIRECT requests start on an ALIGN boundary; the bytes in
+         * front of 'offset' are skipped in the first chunk
+         */
+        io->next_offset = io->direct ? offset & ~(off_t)(ALIGN - 1)
+                                     : offset;
+        io->pos = offset - io->next_offset;
+        io->end = offset + length;
+        for (int k = 0; k < DEPTH; k++) {
+                issue_read(io, &io->slots[k]);
+        }
+        return io;
+}
+
+/* AsyncIO_read
+ * Purpose: Take the next bytes of a reader's range
+ * Parameters: the reader, where to copy the bytes and how many
+ * Returns: how many were copied
+ *
+ * Expected input: a reader and room for n bytes
+ * Success output: none
+ * Failure output: fewer than n bytes if the file ends early or a read
+ *                 fails
+ */
+size_t AsyncIO_read(T io, void *buf, size_t n)
+{
+        assert(io != NULL && !io->writing && (buf != NULL || n == 0));
+        size_t copied = 0;
+
+        while (copied < n && !io->failed) {
+                Slot *slot = &io->slots[io->head];
+                if (slot_state(io, slot) == SLOT_FREE) {
+                        break;          /* nothing left in the range */
+                }
+                wait_done(io, slot);
+                if (slot->result < 0) {
+                        io->failed = 1;
+                        break;
+                }
+
+                size_t usable = slot->result;
+                if ((off_t)usable > io->end - slot->offset) {
+                        usable = io->end - slot->offset;
+                }
+                if (io->pos < usable) {
+                        size_t take = usable - io->pos;
+                        if (take > n - copied) {
+                                take = n - copied;
+                        }
+                        memcpy((char *)buf + copied, slot->buffer + io->pos,
+                               take);
+                        copied += take;
+                        io->pos += take;
+                }
+                if (io->pos < usable) {
+                        break;          /* the caller has all it asked for */
+                }
+                if (usable < slot->length &&
+                    slot->offset + (off_t)usable < io->end) {
+                        break;          /* the file ended early */
+                }
+
+                /* the slot is used up: send it further ahead */
+                free_slot(io, slot);
+                issue_read(io, slot);
+                io->head = (io->head + 1) % DEPTH;
+                io->pos = 0;
+        }
+        return copied;
+}
+
+/* AsyncIO_writer
+ * Purpose: Start writing a file from an offset
+ * Parameters: the descriptor and the offset of the first byte
+ * Returns: the writer, closed with AsyncIO_close
+ *
+ * Expected input: a descriptor AsyncIO_usable accepts for writing
+ * Success output: none
+ * Failure output: CRE if the descriptor is negative
+ */
+T AsyncIO_writer(int fd, off_t offset)
+{
+        assert(fd >= 0 && offset >= 0);
+        T io = new_io(fd, 1);
+        io->next_offset = offset;
+        return io;
+}
+
+/* AsyncIO_write
+ * Purpose: Queue bytes to be written, waiting only when every slot is
+ *          still in flight
+ * Parameters: the writer, the bytes and how many there are
+ * Returns: void
+ *
+ * Expected input: a writer and n readable bytes
+ * Success output: the bytes are written by the time the writer is closed
+ * Failure output: AsyncIO_close returns 0 if a write fails
+ */
+void AsyncIO_write(T io, const void *buf, size_t n)
+{
+        assert(io != NULL && io->writing && (buf != NULL || n == 0));
+        size_t copied = 0;
+
+        while (copied < n) {
+                Slot *slot = &io->slots[io->head];
+                if (slot_state(io, slot) != SLOT_FREE) {
+                        wait_done(io, slot);
+                        free_slot(io, slot);
+                }
+
+                size_t take = CHUNK - io->pos;
+                if (take > n - copied) {
+                        take = n - copied;
+                }
+                memcpy(slot->buffer + io->pos, (const char *)buf + copied,
+                       take);
+                copied += take;
+                io->pos += take;
+
+                if (io->pos == CHUNK) {
+                        slot->offset = io->next_offset;
+                        slot->length = CHUNK;
+                        io->next_offset += CHUNK;
+                        submit(io, slot);
+                        io->head = (io->head + 1) % DEPTH;
+                        io->pos = 0;
+                }
+        }
+}
+
+/* AsyncIO_close
+ * Purpose: Finish a reader or writer: a writer's partly filled chunk is
+ *          written, every request is waited for, and everything is freed
+ * Parameters: a pointer to the reader or writer, set to NULL
+ * Returns: 1 if every request succeeded and 0 otherwise
+ *
+ * Expected input: a pointer to a reader or writer
+ * Success output: a writer's bytes are all in the file
+ * Failure output: 0 if a request failed
+ */
+int AsyncIO_close(T *iop)
+{
+        assert(iop != NULL && *iop != NULL);
+        T io = *iop;
+
+        if (io->writing && io->pos > 0) {
+                Slot *slot = &io->slots[io->head];
+                slot->offset = io->next_offset;
+                slot->length = io->pos;
+                io->next_offset += io->pos;
+                submit(io, slot);
+        }
+        for (int k = 0; k < DEPTH; k++) {
+                Slot *slot = &io->slots[k];
+                if (slot_state(io, slot) != SLOT_FREE) {
+                        wait_done(io, slot);
+                }
+        }
+
+        end_io(io);
+        if (io->direct) {
+                close(io->fd);
+        }
+        for (int k = 0; k < DEPTH; k++) {
+                free(io->slots[k].buffer);
+        }
+
+        int ok = !io->failed;
+        free(io);
+        *iop = NULL;
+        return ok;
+}
+
+/* issue_read
+ *    Purpose: send a free reader slot for the next chunk of the range, or
+ *             leave it free if the range is all asked for
+ */
+static void issue_read(T io, Slot *slot)
+{
+        if (io->next_offset >= io->end) {
+                return;
+        }
+        size_t length = CHUNK;
+        if ((off_t)length > io->end - io->next_offset) {
+                length = io->end - io->next_offset;
+                if (io->direct) {
+                        length = (length + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+                }
+        }
+        slot->offset = io->next_offset;
+        slot->length = length;
+        io->next_offset += length;
+        submit(io, slot);
+}
+
+/* transfer
+ *    Purpose: move a whole request with pread or pwrite, starting 'done'
+ *             bytes in
+ *    Returns: the bytes moved in all, short only at the end of the file,
+ *             or -1 on an error
+ */
+static ssize_t transfer(int fd, Slot *slot, int writing, size_t done)
+{
+        while (done < slot->length) {
+                ssize_t n = writing
+                        ? pwrite(fd, slot->buffer + done, slot->length - done,
+                                 slot->offset + done)
+                        : pread(fd, slot->buffer + done, slot->length - done,
+                                slot->offset + done);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n < 0) {
+                        return -1;
+                }
+                if (n == 0) {
+                        break;
+                }
+                done += n;
+        }
+        return done;
+}
+
+/* finish
+ *    Purpose: complete a finished request that came back short, and note
+ *             a failure; only the first call for a request does anything
+ */
+static void finish(T io, Slot *slot)
+{
+        if (slot->finished) {
+                return;
+        }
+        slot->finished = 1;
+        if (slot->result >= 0 && (size_t)slot->result < slot->length) {
+                slot->result = transfer(io->plain_fd, slot, io->writing,
+                                        slot->result);
+        }
+        if (slot->result < 0 ||
+            (io->writing && (size_t)slot->result < slot->length)) {
+                io->failed = 1;
+        }
+}
+
+/* pool_lock guards the state of every slot of every open reader and
+ * writer, and the list of them the shared threads take requests from
+ */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static T open_ios;
+
+static void start_pool(void);
+static void *worker(void *cl);
+
+/* new_io
+ *    Purpose: allocate a reader or writer with its slots and put it on
+ *             the list the threads serve, starting them the first time
+ */
+static T new_io(int fd, int writing)
+{
+        T io = calloc(1, sizeof(*io));
+        assert(io != NULL);
+        io->fd = io->plain_fd = fd;
+        io->writing = writing;
+        for (int k = 0; k < DEPTH; k++) {
+                int rc = posix_memalign((void **)&io->slots[k].buffer, ALIGN,
+                                        CHUNK);
+                assert(rc == 0);
+        }
+        pthread_once(&pool_once, start_pool);
+        pthread_mutex_lock(&pool_lock);
+        io->next = open_ios;
+        open_ios = io;
+        pthread_mutex_unlock(&pool_lock);
+        return io;
+}
+
+/* end_io
+ *    Purpose: take a reader or writer with nothing in flight off the
+ *             threads' list
+ */
+static void end_io(T io)
+{
+        pthread_mutex_lock(&pool_lock);
+        T *link = &open_ios;
+        while (*link != io) {
+                link = &(*link)->next;
+        }
+        *link = io->next;
+        pthread_mutex_unlock(&pool_lock);
+}
+
+/* slot_state
+ *    Purpose: a slot's state, read with the lock held
+ */
+static SlotState slot_state(T io, Slot *slot)
+{
+        (void)io;
+        pthread_mutex_lock(&pool_lock);
+        SlotState state = slot->state;
+        pthread_mutex_unlock(&pool_lock);
+        return state;
+}
+
+/* free_slot
+ *    Purpose: mark a finished slot free for reuse, with the lock held
+ */
+static void free_slot(T io, Slot *slot)
+{
+        (void)io;
+        pthread_mutex_lock(&pool_lock);
+        slot->state = SLOT_FREE;
+        pthread_mutex_unlock(&pool_lock);
+}
+
+/* submit
+ *    Purpose: queue a slot's request for the threads
+ */
+static void submit(T io, Slot *slot)
+{
+        (void)io;
+        pthread_mutex_lock(&pool_lock);
+        slot->state = SLOT_QUEUED;
+        slot->finished = 0;
+        pthread_cond_signal(&pool_queued);
+        pthread_mutex_unlock(&pool_lock);
+}
+
+/* wait_done
+ *    Purpose: wait until a thread has finished the slot's request, then
+ *             complete it if it came back short. Time spent waiting is
+ *             traced as "io wait"
+ */
+static void wait_done(T io, Slot *slot)
+{
+        pthread_mutex_lock(&pool_lock);
+        uint64_t start = slot->state != SLOT_DONE ? Trace_begin() : 0;
+        while (slot->state != SLOT_DONE) {
+                pthread_cond_wait(&pool_done, &pool_lock);
+        }
+        pthread_mutex_unlock(&pool_lock);
+        Trace_end("io wait", start, (long)slot->offset);
+        finish(io, slot);
+}
+
+/* start_pool
+ *    Purpose: start the shared threads, which run until the process ends
+ */
+static void start_pool(void)
+{
+        for (int t = 0; t < THREADS; t++) {
+                pthread_t thread;
+                int rc = pthread_create(&thread, NULL, worker, NULL);
+                assert(rc == 0);
+                pthread_detach(thread);
+        }
+}
+
+/* next_queued
+ *    Purpose: the queued slot earliest in the file of the first open
+ *             reader or writer that has one, with the lock held
+ *    Returns: the slot, with its reader or writer in *owner, or NULL if
+ *             none is queued
+ */
+static Slot *next_queued(T *owner)
+{
+        for (T io = open_ios; io != NULL; io = io->next) {
+                Slot *first = NULL;
+                for (int k = 0; k < DEPTH; k++) {
+                        Slot *slot = &io->slots[k];
+                        if (slot->state == SLOT_QUEUED &&
+                            (first == NULL || slot->offset < first->offset)) {
+                                first = slot;
+                        }
+                }
+                if (first != NULL) {
+                        *owner = io;
+                        return first;
+                }
+        }
+        return NULL;
+}
+
+/* worker
+ *    Purpose: shared thread that carries out queued requests of every
+ *             open reader and writer
+ */
+static void *worker(void *cl)
+{
+        (void)cl;
+        pthread_mutex_lock(&pool_lock);
+        for (;;) {
+                T io;
+                Slot *slot = next_queued(&io);
+                if (slot == NULL) {
+                        pthread_cond_wait(&pool_queued, &pool_lock);
+                        continue;
+                }
+                slot->state = SLOT_BUSY;
+                pthread_mutex_unlock(&pool_lock);
+
+                ssize_t result = transfer(io->fd, slot, io->writing, 0);
+
+                pthread_mutex_lock(&pool_lock);
+                slot->result = result;
+                slot->state = SLOT_DONE;
+                pthread_cond_broadcast(&pool_done);
+        }
+        return NULL;
+}
+
+#undef T
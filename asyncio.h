@@ -0,0 +1,60 @@
+/**************************************************************
+ *
+ *                     asyncio.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Asynchronous sequential file I/O with many large requests in
+ *     flight. A reader keeps reading 1MB chunks ahead of the
+ *     caller, who takes the bytes in order; a writer queues each
+ *     chunk the caller fills and goes on filling the next. A few
+ *     threads shared by every reader and writer issue pread and
+ *     pwrite. Reads can bypass the page cache with O_DIRECT.
+ *
+ *     Only files with positions (regular files and block devices)
+ *     can be used, since every request names its own offset.
+ *
+ **************************************************************/
+
+#ifndef __ASYNCIO__
+#define __ASYNCIO__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define T AsyncIO_T
+typedef struct T *T;
+
+/* 1 if 'fd' can be read or written at offsets: it is a regular file or
+ * a block device, and, for writing, was not opened with O_APPEND
+ */
+extern int AsyncIO_usable(int fd, int writing);
+
+/* A reader of the 'length' bytes at 'offset' in 'fd'. With 'direct' the
+ * file is reopened with O_DIRECT when the file system allows it. The
+ * caller keeps 'fd' open until the reader is closed
+ */
+extern T AsyncIO_reader(int fd, off_t offset, off_t length, int direct);
+
+/* Copy the next n bytes into buf, waiting for them if they are still in
+ * flight. Returns how many were copied, fewer than n only at the end of
+ * the range or of the file, or on a read error
+ */
+extern size_t AsyncIO_read(T io, void *buf, size_t n);
+
+/* A writer of bytes to 'fd' from 'offset' on */
+extern T AsyncIO_writer(int fd, off_t offset);
+
+/* Queue n bytes from buf to be written after the bytes before them */
+extern void AsyncIO_write(T io, const void *buf, size_t n);
+
+/* Wait for every request of a reader or writer to finish and free it.
+ * Returns 1 if every request succeeded and 0 if any failed
+ */
+extern int AsyncIO_close(T *io);
+
+#undef T
+#endif /* __ASYNCIO__ */
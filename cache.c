@@ -0,0 +1,517 @@
+/**************************************************************
+ *
+ *                     cache.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the result cache. The input hash is
+ *     XXH64 (seed 0) run incrementally from a fopencookie read
+ *     function, so it costs no pass of its own. New entries are
+ *     written to a temporary file and renamed into place, so a
+ *     reader never sees a partial entry. The hit and miss counts
+ *     of every run that used the directory are kept in its
+ *     .stats file, updated under an flock.
+ *
+ **************************************************************/
+
+#define _GNU_SOURCE     /* fopencookie */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "cache.h"
+
+#define T Cache_T
+
+#define PRIME1 11400714785074694791ULL
+#define PRIME2 14029467366897019727ULL
+#define PRIME3  1609587929392839161ULL
+#define PRIME4  9650029242287828579ULL
+#define PRIME5  2870177450012600261ULL
+
+/* Hash is the state of an incremental XXH64 */
+typedef struct Hash {
+        uint64_t v[4];
+        uint64_t total;
+        unsigned char buffer[32];
+        size_t buffered;
+} Hash;
+
+struct T {
+        char *dir;
+        uint64_t max_bytes;
+        Hash hash;
+        FILE *source;                   /* stream Cache_reader hashes */
+        char *entry_name;               /* path being written, if any */
+        char *temp_name;
+        unsigned long hits, misses;     /* of the directory, all runs */
+};
+
+static void hash_init(Hash *hash);
+static void hash_update(Hash *hash, const unsigned char *bytes, size_t n);
+static uint64_t hash_digest(const Hash *hash);
+static ssize_t hash_read(void *cookie, char *buf, size_t size);
+static char *entry_path(T cache, const char *spec);
+static void count_lookup(T cache, int hit);
+static void evict(T cache);
+
+T Cache_new(const char *dir, uint64_t max_bytes)
+{
+        assert(dir != NULL);
+
+        if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+                return NULL;
+        }
+        struct stat st;
+        if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                return NULL;
+        }
+
+        T cache;
+        NEW0(cache);
+        cache->dir = strdup(dir);
+        assert(cache->dir != NULL);
+        cache->max_bytes = max_bytes;
+        hash_init(&cache->hash);
+        return cache;
+}
+
+void Cache_free(T *cache)
+{
+        assert(cache != NULL && *cache != NULL);
+        free((*cache)->dir);
+        free((*cache)->entry_name);
+        free((*cache)->temp_name);
+        FREE(*cache);
+}
+
+/* Cache_reader
+ * Purpose: Wrap the input stream so the bytes read from it are hashed
+ * Parameters: the cache and the input stream
+ * Returns: the hashing stream, to be closed before 'fp'
+ *
+ * Expected input: a cache whose hash has seen no other input
+ * Success output: none
+ * Failure output: CRE if the stream cannot be created
+ */
+FILE *Cache_reader(T cache, FILE *fp)
+{
+        assert(cache != NULL && fp != NULL);
+        cache->source = fp;
+
+        cookie_io_functions_t io = { hash_read, NULL, NULL, NULL };
+        FILE *hashing = fopencookie(cache, "r", io);
+        assert(hashing != NULL);
+        return hashing;
+}
+
+/* Cache_lookup
+ * Purpose: Find the cached result for the input read so far
+ * Parameters: the cache and the spec of the result
+ * Returns: the entry open for reading, or NULL on a miss
+ *
+ * Expected input: the whole input has been read through Cache_reader
+ * Success output: the hit or miss is added to the directory's counts
+ * Failure output: none; an unreadable entry is a miss
+ */
+FILE *Cache_lookup(T cache, const char *spec)
+{
+        assert(cache != NULL && spec != NULL);
+
+        char *path = entry_path(cache, spec);
+        FILE *entry = fopen(path, "r");
+        if (entry != NULL) {
+                /* the modification time orders entries for eviction */
+                utimensat(AT_FDCWD, path, NULL, 0);
+        }
+        count_lookup(cache, entry != NULL);
+        free(path);
+        return entry;
+}
+
+/* Cache_insert
+ * Purpose: Start a new entry for the input read so far
+ * Parameters: the cache and the spec of the result
+ * Returns: a temporary file to write the result to, or NULL
+ *
+ * Expected input: no entry is being written to this cache
+ * Success output: none
+ * Failure output: none
+ */
+FILE *Cache_insert(T cache, const char *spec)
+{
+        assert(cache != NULL && spec != NULL);
+        assert(cache->temp_name == NULL);
+
+        cache->entry_name = entry_path(cache, spec);
+        size_t length = strlen(cache->dir) + sizeof("/.tmp.XXXXXX");
+        cache->temp_name = malloc(length);
+        assert(cache->temp_name != NULL);
+        snprintf(cache->temp_name, length, "%s/.tmp.XXXXXX", cache->dir);
+
+        int fd = mkstemp(cache->temp_name);
+        FILE *entry = fd >= 0 && fchmod(fd, 0644) == 0 ? fdopen(fd, "w+")
+                                                       : NULL;
+        if (entry == NULL) {
+                if (fd >= 0) {
+                        close(fd);
+                        unlink(cache->temp_name);
+                }
+                FREE(cache->temp_name);
+                FREE(cache->entry_name);
+        }
+        return entry;
+}
+
+/* Cache_commit
+ * Purpose: Publish the entry started by Cache_insert and keep the cache
+ *          under its size cap
+ * Parameters: the cache and the entry, with the result written to it
+ * Returns: the entry positioned at its start for reading
+ *
+ * Expected input: the stream returned by the last Cache_insert
+ * Success output: none
+ * Failure output: none; an entry that cannot be renamed is dropped, but
+ *                 the returned stream still holds the result
+ */
+FILE *Cache_commit(T cache, FILE *entry)
+{
+        assert(cache != NULL && entry != NULL);
+        assert(cache->temp_name != NULL);
+
+        if (fflush(entry) != 0 ||
+            rename(cache->temp_name, cache->entry_name) != 0) {
+                unlink(cache->temp_name);
+        }
+        FREE(cache->temp_name);
+        FREE(cache->entry_name);
+
+        evict(cache);
+        rewind(entry);
+        return entry;
+}
+
+void Cache_copy(FILE *entry, FILE *out)
+{
+        assert(entry != NULL && out != NULL);
+
+        char buffer[1 << 16];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), entry)) > 0) {
+                fwrite(buffer, 1, n, out);
+        }
+        fclose(entry);
+}
+
+unsigned long Cache_hits(T cache)
+{
+        assert(cache != NULL);
+        return cache->hits;
+}
+
+unsigned long Cache_misses(T cache)
+{
+        assert(cache != NULL);
+        return cache->misses;
+}
+
+/* hash_read
+ *    Purpose: fopencookie read function that reads the source stream and
+ *             hashes what it returns
+ */
+static ssize_t hash_read(void *cookie, char *buf, size_t size)
+{
+        T cache = cookie;
+        size_t n = fread(buf, 1, size, cache->source);
+        hash_update(&cache->hash, (unsigned char *)buf, n);
+        return n;
+}
+
+/* entry_path
+ *    Purpose: name the entry for the input hashed so far and 'spec'
+ *    Returns: a malloc'd path inside the cache directory
+ */
+static char *entry_path(T cache, const char *spec)
+{
+        size_t length = strlen(cache->dir) + strlen(spec) + 20;
+        char *path = malloc(length);
+        assert(path != NULL);
+        snprintf(path, length, "%s/%016llx-%s", cache->dir,
+                 (unsigned long long)hash_digest(&cache->hash), spec);
+        return path;
+}
+
+/* count_lookup
+ *    Purpose: add a hit or a miss to the counts in the directory's .stats
+ *             file and keep the new totals; if the file cannot be used,
+ *             count this run's lookups only
+ */
+static void count_lookup(T cache, int hit)
+{
+        size_t length = strlen(cache->dir) + sizeof("/.stats");
+        char *path = malloc(length);
+        assert(path != NULL);
+        snprintf(path, length, "%s/.stats", cache->dir);
+        int fd = open(path, O_RDWR | O_CREAT, 0644);
+        free(path);
+
+        unsigned long hits = cache->hits, misses = cache->misses;
+        char text[64];
+        int locked = fd >= 0 && flock(fd, LOCK_EX) == 0;
+        if (locked) {
+                ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+                text[n > 0 ? n : 0] = '\0';
+                if (sscanf(text, "%lu %lu", &hits, &misses) != 2) {
+                        hits = misses = 0;
+                }
+        }
+        if (hit) {
+                hits++;
+        } else {
+                misses++;
+        }
+        if (locked) {
+                int n = snprintf(text, sizeof(text), "%lu %lu\n", hits,
+                                 misses);
+                if (pwrite(fd, text, n, 0) != n || ftruncate(fd, n) != 0) {
+                        hits = cache->hits + (hit != 0);
+                        misses = cache->misses + (hit == 0);
+                }
+        }
+        if (fd >= 0) {
+                close(fd);
+        }
+        cache->hits = hits;
+        cache->misses = misses;
+}
+
+/* Entry is one file in the cache directory, for eviction */
+typedef struct Entry {
+        char *path;
+        off_t size;
+        struct timespec used;
+} Entry;
+
+/* compare_used
+ *    Purpose: qsort comparison putting the least recently used first
+ */
+static int compare_used(const void *a, const void *b)
+{
+        const struct timespec *x = &((const Entry *)a)->used;
+        const struct timespec *y = &((const Entry *)b)->used;
+        if (x->tv_sec != y->tv_sec) {
+                return x->tv_sec < y->tv_sec ? -1 : 1;
+        }
+        return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/* evict
+ *    Purpose: remove least recently used entries until the directory
+ *             holds at most max_bytes. Entries that vanish while this
+ *             runs, because another ppmtrans evicted them, are skipped
+ */
+static void evict(T cache)
+{
+        DIR *dir = opendir(cache->dir);
+        if (dir == NULL) {
+                return;
+        }
+
+        size_t count = 0, capacity = 64;
+        Entry *entries = malloc(capacity * sizeof(Entry));
+        assert(entries != NULL);
+        uint64_t total = 0;
+
+        struct dirent *dirent;
+        while ((dirent = readdir(dir)) != NULL) {
+                if (dirent->d_name[0] == '.') {
+                        continue;
+                }
+                size_t length = strlen(cache->dir) +
+                                strlen(dirent->d_name) + 2;
+                char *path = malloc(length);
+                assert(path != NULL);
+                snprintf(path, length, "%s/%s", cache->dir, dirent->d_name);
+
+                struct stat st;
+                if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+                        free(path);
+                        continue;
+                }
+                if (count == capacity) {
+                        capacity *= 2;
+                        entries = realloc(entries, capacity * sizeof(Entry));
+                        assert(entries != NULL);
+                }
+                entries[count].path = path;
+                entries[count].size = st.st_size;
+                entries[count].used = st.st_mtim;
+                count++;
+                total += st.st_size;
+        }
+        closedir(dir);
+
+        qsort(entries, count, sizeof(Entry), compare_used);
+        for (size_t k = 0; k < count; k++) {
+                if (total > cache->max_bytes &&
+                    (unlink(entries[k].path) == 0 || errno == ENOENT)) {
+                        total -= entries[k].size;
+                }
+                free(entries[k].path);
+        }
+        free(entries);
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ *                   XXH64, incrementally
+ * - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+        return x << r | x >> (64 - r);
+}
+
+/* read64, read32
+ *    Purpose: load little-endian words; XXH64 is defined on them
+ */
+static inline uint64_t read64(const unsigned char *p)
+{
+        uint64_t x;
+        memcpy(&x, p, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        x = __builtin_bswap64(x);
+#endif
+        return x;
+}
+
+static inline uint64_t read32(const unsigned char *p)
+{
+        uint32_t x;
+        memcpy(&x, p, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        x = __builtin_bswap32(x);
+#endif
+        return x;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+        acc += input * PRIME2;
+        return rotl(acc, 31) * PRIME1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t v)
+{
+        acc ^= hash_round(0, v);
+        return acc * PRIME1 + PRIME4;
+}
+
+static void hash_init(Hash *hash)
+{
+        memset(hash, 0, sizeof(*hash));
+        hash->v[0] = PRIME1 + PRIME2;
+        hash->v[1] = PRIME2;
+        hash->v[2] = 0;
+        hash->v[3] = -PRIME1;
+}
+
+/* hash_stripes
+ *    Purpose: fold whole 32-byte stripes into the accumulators
+ *    Returns: the number of bytes consumed
+ */
+static size_t hash_stripes(Hash *hash, const unsigned char *p, size_t n)
+{
+        const unsigned char *start = p;
+        uint64_t v0 = hash->v[0], v1 = hash->v[1];
+        uint64_t v2 = hash->v[2], v3 = hash->v[3];
+        for (; n >= 32; n -= 32, p += 32) {
+                v0 = hash_round(v0, read64(p));
+                v1 = hash_round(v1, read64(p + 8));
+                v2 = hash_round(v2, read64(p + 16));
+                v3 = hash_round(v3, read64(p + 24));
+        }
+        hash->v[0] = v0;
+        hash->v[1] = v1;
+        hash->v[2] = v2;
+        hash->v[3] = v3;
+        return p - start;
+}
+
+static void hash_update(Hash *hash, const unsigned char *bytes, size_t n)
+{
+        hash->total += n;
+
+        if (hash->buffered > 0) {
+                size_t fill = 32 - hash->buffered;
+                if (fill > n) {
+                        fill = n;
+                }
+                memcpy(hash->buffer + hash->buffered, bytes, fill);
+                hash->buffered += fill;
+                bytes += fill;
+                n -= fill;
+                if (hash->buffered < 32) {
+                        return;
+                }
+                hash_stripes(hash, hash->buffer, 32);
+                hash->buffered = 0;
+        }
+
+        size_t used = hash_stripes(hash, bytes, n);
+        memcpy(hash->buffer, bytes + used, n - used);
+        hash->buffered = n - used;
+}
+
+static uint64_t hash_digest(const Hash *hash)
+{
+        uint64_t h;
+        if (hash->total >= 32) {
+                h = rotl(hash->v[0], 1) + rotl(hash->v[1], 7)
+                  + rotl(hash->v[2], 12) + rotl(hash->v[3], 18);
+                for (int k = 0; k < 4; k++) {
+                        h = merge_round(h, hash->v[k]);
+                }
+        } else {
+                h = hash->v[2] + PRIME5;
+        }
+        h += hash->total;
+
+        const unsigned char *p = hash->buffer;
+        size_t n = hash->buffered;
+        for (; n >= 8; n -= 8, p += 8) {
+                h ^= hash_round(0, read64(p));
+                h = rotl(h, 27) * PRIME1 + PRIME4;
+        }
+        if (n >= 4) {
+                h ^= read32(p) * PRIME1;
+                h = rotl(h, 23) * PRIME2 + PRIME3;
+                n -= 4;
+                p += 4;
+        }
+        for (; n > 0; n--, p++) {
+                h ^= *p * PRIME5;
+                h = rotl(h, 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+}
+
+#undef T
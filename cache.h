@@ -0,0 +1,73 @@
+/**************************************************************
+ *
+ *                     cache.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     A content-addressed cache of ppmtrans results on disk. An
+ *     entry is named by a 64-bit XXH64 hash of the input bytes,
+ *     taken while the image is read, and a spec string naming
+ *     the transform and output format. The directory is kept
+ *     under a size cap by removing the least recently used
+ *     entries; a hit refreshes an entry's modification time.
+ *
+ *     Usage:
+ *       Cache_T cache = Cache_new(dir, max_bytes);
+ *       FILE *in = Cache_reader(cache, fp);
+ *         ... read the image from 'in'
+ *       FILE *entry = Cache_lookup(cache, spec);
+ *       if (entry == NULL) {
+ *               entry = Cache_insert(cache, spec);
+ *                 ... write the result to 'entry'
+ *               entry = Cache_commit(cache, entry);
+ *       }
+ *       Cache_copy(entry, out);
+ *
+ **************************************************************/
+
+#ifndef __CACHE__
+#define __CACHE__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define T Cache_T
+typedef struct T *T;
+
+/* A cache in directory 'dir', created if needed, holding at most
+ * 'max_bytes' of results. Returns NULL if the directory cannot be used
+ */
+extern T Cache_new(const char *dir, uint64_t max_bytes);
+extern void Cache_free(T *cache);
+
+/* A stream that reads 'fp' and hashes every byte read through it. Closing
+ * it does not close 'fp'
+ */
+extern FILE *Cache_reader(T cache, FILE *fp);
+
+/* The entry for the input read so far and 'spec', positioned at its start,
+ * or NULL on a miss. Counts a hit or a miss in the directory's .stats
+ */
+extern FILE *Cache_lookup(T cache, const char *spec);
+
+/* A new entry for the input read so far and 'spec' to write the result to.
+ * Cache_commit publishes it, evicts entries over the size cap, and returns
+ * it positioned at its start. Returns NULL if no entry can be created
+ */
+extern FILE *Cache_insert(T cache, const char *spec);
+extern FILE *Cache_commit(T cache, FILE *entry);
+
+/* Copy an entry to 'out' and close it */
+extern void Cache_copy(FILE *entry, FILE *out);
+
+/* The hits and misses of every run that has used the directory, this
+ * one's included
+ */
+extern unsigned long Cache_hits(T cache);
+extern unsigned long Cache_misses(T cache);
+
+#undef T
+#endif /* __CACHE__ */
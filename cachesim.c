@@ -0,0 +1,283 @@
+/**************************************************************
+ *
+ *                     cachesim.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the cache and TLB simulator. Every level
+ *     keeps, for each set, the tag of each way and when it was
+ *     last used; a miss replaces the way used least recently.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "cachesim.h"
+
+#define T CacheSim_T
+#define MAX_LEVELS 8
+
+/* Level is one cache, or the TLB with pages in place of lines */
+typedef struct Level {
+        char name[8];
+        unsigned sets, ways;
+        unsigned line_shift;            /* log2 of the line or page size */
+        uint64_t *tags;                 /* sets * ways, UINT64_MAX empty */
+        uint64_t *used;                 /* last use of each way */
+        unsigned long long accesses, hits;
+} Level;
+
+struct T {
+        int levels;                     /* caches, then the TLB */
+        int has_tlb;
+        Level level[MAX_LEVELS];
+        uint64_t clock;
+};
+
+static int parse_level(const char *spec, size_t length, Level *level,
+                       int *is_tlb);
+static int lookup(Level *level, uint64_t block, uint64_t clock);
+
+T CacheSim_new(const char *config)
+{
+        assert(config != NULL);
+
+        T sim;
+        NEW0(sim);
+        Level tlb;
+        const char *p = config;
+        while (*p != '\0') {
+                size_t length = strcspn(p, ",");
+                int is_tlb;
+                Level level;
+                if (sim->levels == MAX_LEVELS - 1 ||
+                    !parse_level(p, length, &level, &is_tlb) ||
+                    (is_tlb && sim->has_tlb)) {
+                        sim->has_tlb = 0;
+                        CacheSim_free(&sim);
+                        return NULL;
+                }
+                if (is_tlb) {
+                        tlb = level;
+                        sim->has_tlb = 1;
+                } else {
+                        sim->level[sim->levels++] = level;
+                }
+                p += length + (p[length] == ',');
+        }
+        if (sim->has_tlb) {
+                sim->level[sim->levels++] = tlb;
+        }
+        if (sim->levels == 0) {
+                CacheSim_free(&sim);
+                return NULL;
+        }
+
+        for (int k = 0; k < sim->levels; k++) {
+                Level *level = &sim->level[k];
+                size_t cells = (size_t)level->sets * level->ways;
+                level->tags = malloc(cells * sizeof(uint64_t));
+                level->used = malloc(cells * sizeof(uint64_t));
+                assert(level->tags != NULL && level->used != NULL);
+        }
+        CacheSim_reset(sim);
+        return sim;
+}
+
+void CacheSim_free(T *sim)
+{
+        assert(sim != NULL && *sim != NULL);
+        for (int k = 0; k < (*sim)->levels; k++) {
+                free((*sim)->level[k].tags);
+                free((*sim)->level[k].used);
+        }
+        FREE(*sim);
+}
+
+void CacheSim_reset(T sim)
+{
+        assert(sim != NULL);
+        for (int k = 0; k < sim->levels; k++) {
+                Level *level = &sim->level[k];
+                size_t cells = (size_t)level->sets * level->ways;
+                memset(level->tags, 0xff, cells * sizeof(uint64_t));
+                memset(level->used, 0, cells * sizeof(uint64_t));
+                level->accesses = 0;
+                level->hits = 0;
+        }
+        sim->clock = 0;
+}
+
+/* CacheSim_access
+ * Purpose: Simulate one access, which touches every line it overlaps
+ * Parameters: the simulator, the address and the number of bytes
+ * Returns: void
+ *
+ * Expected input: a simulator and at least one byte
+ * Success output: none
+ * Failure output: none
+ */
+void CacheSim_access(T sim, const void *address, size_t bytes)
+{
+        assert(sim != NULL && bytes > 0);
+
+        uint64_t first = (uintptr_t)address;
+        uint64_t last = first + bytes - 1;
+        int caches = sim->levels - sim->has_tlb;
+
+        if (sim->has_tlb) {
+                Level *tlb = &sim->level[caches];
+                for (uint64_t page = first >> tlb->line_shift;
+                     page <= last >> tlb->line_shift; page++) {
+                        lookup(tlb, page, ++sim->clock);
+                }
+        }
+
+        unsigned shift = sim->level[0].line_shift;
+        for (uint64_t line = first >> shift; line <= last >> shift; line++) {
+                uint64_t clock = ++sim->clock;
+                uint64_t byte = line << shift;
+                for (int k = 0; k < caches; k++) {
+                        Level *level = &sim->level[k];
+                        if (lookup(level, byte >> level->line_shift, clock)) {
+                                break;
+                        }
+                }
+        }
+}
+
+int CacheSim_levels(T sim)
+{
+        assert(sim != NULL);
+        return sim->levels;
+}
+
+const char *CacheSim_name(T sim, int level)
+{
+        assert(sim != NULL && level >= 0 && level < sim->levels);
+        return sim->level[level].name;
+}
+
+unsigned long long CacheSim_accesses(T sim, int level)
+{
+        assert(sim != NULL && level >= 0 && level < sim->levels);
+        return sim->level[level].accesses;
+}
+
+double CacheSim_hit_rate(T sim, int level)
+{
+        assert(sim != NULL && level >= 0 && level < sim->levels);
+        Level *l = &sim->level[level];
+        return l->accesses == 0 ? 0.0 : (double)l->hits / l->accesses;
+}
+
+/* lookup
+ *    Purpose: look up one line (or page) number in a level, filling it on
+ *             a miss in place of the least recently used way
+ *    Returns: 1 on a hit and 0 on a miss
+ */
+static int lookup(Level *level, uint64_t block, uint64_t clock)
+{
+        level->accesses++;
+        size_t set = (block % level->sets) * level->ways;
+        uint64_t *tags = level->tags + set;
+        uint64_t *used = level->used + set;
+
+        unsigned victim = 0;
+        for (unsigned w = 0; w < level->ways; w++) {
+                if (tags[w] == block) {
+                        used[w] = clock;
+                        level->hits++;
+                        return 1;
+                }
+                if (used[w] < used[victim]) {
+                        victim = w;
+                }
+        }
+        tags[victim] = block;
+        used[victim] = clock;
+        return 0;
+}
+
+/* parse_size
+ *    Purpose: parse a count with an optional K, M or G suffix
+ *    Returns: a pointer past the count, or NULL if there is none
+ */
+static const char *parse_size(const char *p, unsigned long long *n)
+{
+        char *end;
+        *n = strtoull(p, &end, 10);
+        if (end == p || *p == '-') {
+                return NULL;
+        }
+        if (*end == 'K' || *end == 'k') {
+                *n <<= 10;
+                end++;
+        } else if (*end == 'M' || *end == 'm') {
+                *n <<= 20;
+                end++;
+        } else if (*end == 'G' || *end == 'g') {
+                *n <<= 30;
+                end++;
+        }
+        return end;
+}
+
+/* parse_level
+ *    Purpose: parse one NAME=size/ways/line (or TLB=entries/ways/page)
+ *             level of a configuration
+ *    Returns: 1 if the level is valid, with its geometry in *level, and
+ *             0 otherwise
+ */
+static int parse_level(const char *spec, size_t length, Level *level,
+                       int *is_tlb)
+{
+        char text[64];
+        if (length == 0 || length >= sizeof(text)) {
+                return 0;
+        }
+        memcpy(text, spec, length);
+        text[length] = '\0';
+
+        char *equals = strchr(text, '=');
+        if (equals == NULL || equals == text ||
+            equals - text >= (long)sizeof(level->name)) {
+                return 0;
+        }
+        memset(level, 0, sizeof(*level));
+        memcpy(level->name, text, equals - text);
+        *is_tlb = strcmp(level->name, "TLB") == 0;
+
+        unsigned long long capacity, ways, line;
+        const char *p = parse_size(equals + 1, &capacity);
+        if (p == NULL || *p++ != '/' ||
+            (p = parse_size(p, &ways)) == NULL || *p++ != '/' ||
+            (p = parse_size(p, &line)) == NULL || *p != '\0') {
+                return 0;
+        }
+
+        /* line (or page) sizes must be powers of two */
+        if (line == 0 || (line & (line - 1)) != 0 || ways == 0) {
+                return 0;
+        }
+        unsigned long long blocks = *is_tlb ? capacity : capacity / line;
+        if (blocks == 0 || blocks % ways != 0 || blocks > 1ULL << 28) {
+                return 0;
+        }
+        level->ways = ways;
+        level->sets = blocks / ways;
+        while ((1ULL << level->line_shift) < line) {
+                level->line_shift++;
+        }
+        return 1;
+}
+
+#undef T
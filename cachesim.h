@@ -0,0 +1,54 @@
+/**************************************************************
+ *
+ *                     cachesim.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     A trace-driven simulator of a cache hierarchy and a TLB.
+ *     Each level is set associative with LRU replacement. An
+ *     access that misses a level goes on to the next one and is
+ *     filled into every level it missed. The TLB is looked up
+ *     for every access, independent of the caches.
+ *
+ *     Configuration strings list the levels, nearest first:
+ *       L1=32K/8/64,L2=1M/16/64,L3=16M/16/64,TLB=64/4/4K
+ *     where a cache is NAME=size/ways/line and the TLB (optional,
+ *     at most one) is TLB=entries/ways/page. Sizes take a K, M
+ *     or G suffix.
+ *
+ **************************************************************/
+
+#ifndef __CACHESIM__
+#define __CACHESIM__
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define T CacheSim_T
+typedef struct T *T;
+
+#define CACHESIM_DEFAULT "L1=32K/8/64,L2=1M/16/64,L3=16M/16/64,TLB=64/4/4K"
+
+/* A simulator for 'config', or NULL if the string is not valid */
+extern T CacheSim_new(const char *config);
+extern void CacheSim_free(T *sim);
+
+/* Empty every level and zero the counts */
+extern void CacheSim_reset(T sim);
+
+/* Simulate touching 'bytes' bytes at 'address' */
+extern void CacheSim_access(T sim, const void *address, size_t bytes);
+
+/* Levels are numbered from 0, nearest first, with the TLB (if any) last.
+ * The hit rate of a level is out of the accesses that reached it
+ */
+extern int CacheSim_levels(T sim);
+extern const char *CacheSim_name(T sim, int level);
+extern unsigned long long CacheSim_accesses(T sim, int level);
+extern double CacheSim_hit_rate(T sim, int level);
+
+#undef T
+#endif /* __CACHESIM__ */
@@ -0,0 +1,408 @@
+/**************************************************************
+ *
+ *                     costmodel.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the cost model. The plans are fixed when
+ *     the model is first used: plain row-major, column-major and
+ *     tiled, blocked with the suite's 64KB blocks and with 32 and
+ *     128 pixel blocks, and, on a machine with more than one CPU,
+ *     the parallel transform on every CPU with either suite. A
+ *     profile line holds a plan's name and its four times, so a
+ *     profile written on a machine with another CPU count simply
+ *     has no times for this machine's parallel plans.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "relayout.h"
+#include "costmodel.h"
+
+#define MAX_PLANS 8
+#define MAX_THREADS 8
+
+/* the calibration images: one that fits in cache and one that does not */
+#define SMALL_WIDTH 512
+#define SMALL_HEIGHT 512
+#define LARGE_WIDTH 3000
+#define LARGE_HEIGHT 2000
+
+/* Costs are the nanoseconds per pixel of one plan, indexed by whether
+ * the transform turns rows into columns and by the calibration image
+ */
+typedef struct Costs {
+        char name[16];
+        double ns[2][2];        /* [turns rows][small, large] */
+} Costs;
+
+/* measured on the development machine (one CPU), used without a profile */
+static const Costs default_costs[] = {
+        { "row",      { { 36.0, 37.8 }, { 40.5, 47.2 } } },
+        { "col",      { { 44.5, 67.7 }, { 33.2, 43.2 } } },
+        { "tiled",    { { 37.5, 38.9 }, { 35.6, 45.7 } } },
+        { "block",    { { 76.2, 60.2 }, { 57.3, 63.0 } } },
+        { "block32",  { { 41.8, 68.4 }, { 39.1, 60.6 } } },
+        { "block128", { { 38.6, 55.7 }, { 37.6, 65.9 } } },
+};
+
+static Plan plans[MAX_PLANS];
+static int plan_count;
+static Costs costs[MAX_PLANS];  /* costs[k] belongs to plans[k] */
+static int has_costs[MAX_PLANS];
+static pthread_once_t loaded = PTHREAD_ONCE_INIT;
+
+static void load(void);
+static void make_plans(void);
+static const char *profile_path(char *buf, size_t size);
+static double time_plan(Plan plan, int turns, int width, int height,
+                        int reps);
+
+/* Costmodel_choose
+ * Purpose: Pick the plan with the least estimated time for a transform
+ * Parameters: the orientation, the image's width and height, and a
+ *             thread count the caller insists on, or 0
+ * Returns: the plan
+ *
+ * Expected input: a positive width and height
+ * Success output: none
+ * Failure output: none
+ */
+Plan Costmodel_choose(Orientation orientation, int width, int height,
+                      int threads)
+{
+        assert(width > 0 && height > 0 && threads >= 0);
+        pthread_once(&loaded, load);
+
+        /* the identity costs nothing in any layout: keep the plain one */
+        Plan best = plans[0];
+        best.threads = threads;
+        if (orientation == ORIENT_0) {
+                return best;
+        }
+
+        int turns = Orientation_swaps(orientation);
+        double pixels = (double)width * height;
+        double small = (double)SMALL_WIDTH * SMALL_HEIGHT;
+        double large = (double)LARGE_WIDTH * LARGE_HEIGHT;
+        double t = (log(pixels) - log(small)) / (log(large) - log(small));
+        t = t < 0 ? 0 : t > 1 ? 1 : t;
+
+        for (int k = 0; k < plan_count; k++) {
+                Plan plan = plans[k];
+                if (!has_costs[k]) {
+                        continue;
+                }
+                /* a given thread count runs the parallel transform, which
+                 * has no mapping: rank the suites by their one-thread row-
+                 * or block-major costs
+                 */
+                if (threads > 0) {
+                        if (plan.threads > 0 ||
+                            plan.mapping == PLAN_COL_MAJOR ||
+                            plan.mapping == PLAN_TILED) {
+                                continue;
+                        }
+                        plan.threads = threads;
+                }
+                const double *ns = costs[k].ns[turns];
+                plan.estimate = (ns[0] + (ns[1] - ns[0]) * t) * pixels / 1e9;
+                if (best.estimate == 0 || plan.estimate < best.estimate) {
+                        best = plan;
+                }
+        }
+        return best;
+}
+
+/* map_tiled
+ *    Purpose: mapping function for the tiled plan: the plain suite's tiled
+ *             mapping with its default tile
+ */
+static void map_tiled(A2Methods_UArray2 array2, A2Methods_applyfun apply,
+                      void *cl)
+{
+        uarray2_methods_plain->map_tiled(array2, 0, apply, cl);
+}
+
+/* Costmodel_methods
+ * Purpose: Give the suite and mapping function a plan runs with
+ * Parameters: the plan and where to put the suite and the mapping
+ * Returns: void
+ *
+ * Expected input: a plan from Costmodel_choose and non-null pointers
+ * Success output: none
+ * Failure output: none
+ */
+void Costmodel_methods(Plan plan, A2Methods_T *methods,
+                       A2Methods_mapfun **map)
+{
+        assert(methods != NULL && map != NULL);
+        *methods = uarray2_methods_plain;
+        switch (plan.mapping) {
+        case PLAN_ROW_MAJOR:
+                *map = uarray2_methods_plain->map_row_major;
+                break;
+        case PLAN_COL_MAJOR:
+                *map = uarray2_methods_plain->map_col_major;
+                break;
+        case PLAN_TILED:
+                *map = map_tiled;
+                break;
+        case PLAN_BLOCK_MAJOR:
+                *methods = uarray2_methods_blocked;
+                *map = uarray2_methods_blocked->map_block_major;
+                break;
+        }
+}
+
+/* Costmodel_calibrate
+ * Purpose: Measure every plan on this machine and save the profile
+ * Parameters: the profile's path, or NULL for the default, and a stream
+ *             for the progress report
+ * Returns: 1 on success and 0 if the profile cannot be written
+ *
+ * Expected input: a non-null log
+ * Success output: the profile, and each plan's times on 'log'
+ * Failure output: 0 if the profile cannot be opened
+ */
+int Costmodel_calibrate(const char *path, FILE *log)
+{
+        assert(log != NULL);
+        pthread_once(&loaded, load);
+
+        char buf[4096];
+        if (path == NULL) {
+                path = profile_path(buf, sizeof(buf));
+        }
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+                return 0;
+        }
+        fprintf(fp, "# ppmtrans cost profile: plan, then nanoseconds per "
+                    "pixel keeping rows at %dx%d and %dx%d,\n# then turning "
+                    "rows into columns at both sizes\n", SMALL_WIDTH,
+                SMALL_HEIGHT, LARGE_WIDTH, LARGE_HEIGHT);
+        fprintf(log, "%-10s %10s %10s %10s %10s\n", "plan", "keep small",
+                "keep large", "turn small", "turn large");
+
+        for (int k = 0; k < plan_count; k++) {
+                Costs measured;
+                snprintf(measured.name, sizeof(measured.name), "%s",
+                         plans[k].name);
+                for (int turns = 0; turns < 2; turns++) {
+                        measured.ns[turns][0] = time_plan(plans[k], turns,
+                                                          SMALL_WIDTH,
+                                                          SMALL_HEIGHT, 5);
+                        measured.ns[turns][1] = time_plan(plans[k], turns,
+                                                          LARGE_WIDTH,
+                                                          LARGE_HEIGHT, 2);
+                }
+                fprintf(fp, "%s %.2f %.2f %.2f %.2f\n", measured.name,
+                        measured.ns[0][0], measured.ns[0][1],
+                        measured.ns[1][0], measured.ns[1][1]);
+                fprintf(log, "%-10s %10.2f %10.2f %10.2f %10.2f\n",
+                        measured.name, measured.ns[0][0], measured.ns[0][1],
+                        measured.ns[1][0], measured.ns[1][1]);
+                costs[k] = measured;
+                has_costs[k] = 1;
+        }
+
+        int ok = fclose(fp) == 0;
+        fprintf(log, "wrote %s\n", path);
+        return ok;
+}
+
+/* Costmodel_has_profile
+ * Purpose: Tell whether this machine has been calibrated
+ * Parameters: none
+ * Returns: 1 if the profile at the default place can be read, 0 otherwise
+ *
+ * Expected input: none
+ * Success output: none
+ * Failure output: none
+ */
+int Costmodel_has_profile(void)
+{
+        char buf[4096];
+        return access(profile_path(buf, sizeof(buf)), R_OK) == 0;
+}
+
+/* load
+ *    Purpose: set up the plans and their costs, from the profile if there
+ *             is one and from the built-in costs otherwise; run once
+ */
+static void load(void)
+{
+        make_plans();
+
+        char buf[4096];
+        FILE *fp = fopen(profile_path(buf, sizeof(buf)), "r");
+        int from_profile = 0;
+        if (fp != NULL) {
+                char line[256];
+                Costs read;
+                while (fgets(line, sizeof(line), fp) != NULL) {
+                        if (sscanf(line, "%15s %lf %lf %lf %lf", read.name,
+                                   &read.ns[0][0], &read.ns[0][1],
+                                   &read.ns[1][0], &read.ns[1][1]) != 5 ||
+                            read.name[0] == '#') {
+                                continue;
+                        }
+                        for (int k = 0; k < plan_count; k++) {
+                                if (strcmp(plans[k].name, read.name) == 0) {
+                                        costs[k] = read;
+                                        has_costs[k] = 1;
+                                        from_profile = 1;
+                                }
+                        }
+                }
+                fclose(fp);
+        }
+        if (from_profile) {
+                return;
+        }
+
+        int defaults = sizeof(default_costs) / sizeof(default_costs[0]);
+        for (int k = 0; k < plan_count; k++) {
+                for (int d = 0; d < defaults; d++) {
+                        if (strcmp(plans[k].name, default_costs[d].name) == 0) {
+                                costs[k] = default_costs[d];
+                                has_costs[k] = 1;
+                        }
+                }
+        }
+}
+
+/* make_plans
+ *    Purpose: list the plans this machine can run; plain row-major comes
+ *             first
+ */
+static void make_plans(void)
+{
+        static char parallel_names[2][24];
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int threads = cpus > MAX_THREADS ? MAX_THREADS : cpus;
+
+        plan_count = 0;
+        plans[plan_count++] = (Plan){ "row", PLAN_ROW_MAJOR, 0, 0, 0 };
+        plans[plan_count++] = (Plan){ "col", PLAN_COL_MAJOR, 0, 0, 0 };
+        plans[plan_count++] = (Plan){ "tiled", PLAN_TILED, 0, 0, 0 };
+        plans[plan_count++] = (Plan){ "block", PLAN_BLOCK_MAJOR, 0, 0, 0 };
+        plans[plan_count++] = (Plan){ "block32", PLAN_BLOCK_MAJOR, 32, 0, 0 };
+        plans[plan_count++] = (Plan){ "block128", PLAN_BLOCK_MAJOR, 128, 0,
+                                      0 };
+        if (threads > 1) {
+                snprintf(parallel_names[0], 24, "row-t%d", threads);
+                snprintf(parallel_names[1], 24, "block-t%d", threads);
+                plans[plan_count++] = (Plan){ parallel_names[0],
+                                              PLAN_ROW_MAJOR, 0, threads, 0 };
+                plans[plan_count++] = (Plan){ parallel_names[1],
+                                              PLAN_BLOCK_MAJOR, 0, threads,
+                                              0 };
+        }
+}
+
+/* profile_path
+ *    Purpose: the profile's default place: $PPMTRANS_PROFILE, or
+ *             .ppmtrans_profile in the home directory
+ *    Returns: the path, in buf unless it is the environment's
+ */
+static const char *profile_path(char *buf, size_t size)
+{
+        const char *path = getenv("PPMTRANS_PROFILE");
+        if (path != NULL && *path != '\0') {
+                return path;
+        }
+        const char *home = getenv("HOME");
+        snprintf(buf, size, "%s/.ppmtrans_profile",
+                 home != NULL ? home : ".");
+        return buf;
+}
+
+/* now_ns
+ *    Purpose: the wall-clock time in nanoseconds, since the parallel
+ *             plans spread their CPU time over several threads
+ */
+static double now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* synthetic_image
+ *    Purpose: a plain image of Pnm_rgb pixels with varied contents, as
+ *             Ppmio_read would return it
+ */
+static Pnm_ppm synthetic_image(int width, int height)
+{
+        Pnm_ppm image;
+        NEW(image);
+        image->width = width;
+        image->height = height;
+        image->denominator = 255;
+        image->methods = uarray2_methods_plain;
+        image->pixels = uarray2_methods_plain->new(width, height,
+                                                   sizeof(struct Pnm_rgb));
+        char *data = uarray2_methods_plain->data(image->pixels);
+        int stride = uarray2_methods_plain->stride(image->pixels);
+        for (int j = 0; j < height; j++) {
+                Pnm_rgb row = (Pnm_rgb)(data + (size_t)j * stride);
+                for (int i = 0; i < width; i++) {
+                        row[i].red = i & 255;
+                        row[i].green = j & 255;
+                        row[i].blue = (i ^ j) & 255;
+                }
+        }
+        return image;
+}
+
+/* time_plan
+ *    Purpose: time a plan's transform of a synthetic image, relayout into
+ *             its suite and back to plain included, as a read and write
+ *             would pay them
+ *    Returns: the least nanoseconds per pixel of 'reps' runs
+ */
+static double time_plan(Plan plan, int turns, int width, int height,
+                        int reps)
+{
+        A2Methods_T methods;
+        A2Methods_mapfun *map;
+        Costmodel_methods(plan, &methods, &map);
+        Orientation orientation = turns ? ORIENT_90 : ORIENT_180;
+
+        double best = 0;
+        for (int r = 0; r < reps; r++) {
+                Pnm_ppm image = synthetic_image(width, height);
+                double start = now_ns();
+                A2_relayout_ppm(image, methods, plan.blocksize,
+                                plan.blocksize);
+                if (plan.threads > 0) {
+                        image = transform_parallel(image, orientation,
+                                                   methods, plan.threads);
+                } else {
+                        image = transform(image, turns ? 90 : 180, NULL, 0,
+                                          methods, map);
+                }
+                A2_relayout_ppm(image, uarray2_methods_plain, 0, 0);
+                double ns = (now_ns() - start) / ((double)width * height);
+                Pnm_ppmfree(&image);
+                if (r == 0 || ns < best) {
+                        best = ns;
+                }
+        }
+        return best;
+}
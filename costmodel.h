@@ -0,0 +1,73 @@
+/**************************************************************
+ *
+ *                     costmodel.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The cost model behind -auto. For every plan (a suite, a
+ *     mapping, a block size and a thread count) it knows the
+ *     time per pixel of a transform on a small image, which fits
+ *     in cache, and on a large one, for transforms that keep rows
+ *     as rows (180 degrees, flips) and for those that turn rows
+ *     into columns (90, 270, transpose). The time of a blocked
+ *     plan includes relaying the image out into blocks and back.
+ *     An image between the two sizes is estimated by interpolating
+ *     in the logarithm of its pixel count, and the cheapest plan
+ *     wins.
+ *
+ *     The times come from a profile written by ppmtrans
+ *     --calibrate, found in $PPMTRANS_PROFILE or
+ *     ~/.ppmtrans_profile. Without one, times measured on the
+ *     development machine are used.
+ *
+ **************************************************************/
+
+#ifndef __COSTMODEL__
+#define __COSTMODEL__
+
+#include <stdio.h>
+
+#include "a2methods.h"
+#include "transform.h"
+
+/* the mapping of a plan */
+typedef enum PlanMapping {
+        PLAN_ROW_MAJOR, PLAN_COL_MAJOR, PLAN_TILED, PLAN_BLOCK_MAJOR
+} PlanMapping;
+
+typedef struct Plan {
+        const char *name;       /* as in the profile, e.g. "block32" */
+        PlanMapping mapping;
+        int blocksize;          /* PLAN_BLOCK_MAJOR: 0 for the suite's */
+        int threads;            /* 0 for the single-threaded transform */
+        double estimate;        /* predicted seconds, 0 if not modelled */
+} Plan;
+
+/* The cheapest plan for the transform of a width x height image. With
+ * 'threads' above 0 only plans with that many threads are considered
+ */
+extern Plan Costmodel_choose(Orientation orientation, int width, int height,
+                             int threads);
+
+/* The suite and mapping function that carry out a plan. A blocked plan's
+ * arrays have blocks of 'blocksize' cells on a side, or the default
+ * blocks if it is 0
+ */
+extern void Costmodel_methods(Plan plan, A2Methods_T *methods,
+                              A2Methods_mapfun **map);
+
+/* 1 if there is a profile at the default place, $PPMTRANS_PROFILE or
+ * ~/.ppmtrans_profile, and 0 otherwise
+ */
+extern int Costmodel_has_profile(void);
+
+/* Time every plan on this machine, write the profile to 'path' (NULL for
+ * the default place) and report to 'log'. Returns 1 on success and 0 if
+ * the profile cannot be written
+ */
+extern int Costmodel_calibrate(const char *path, FILE *log);
+
+#endif /* __COSTMODEL__ */
@@ -0,0 +1,374 @@
+/**************************************************************
+ *
+ *                     frames.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the frame stream. Two slots alternate
+ *     between the decoder thread, which fills an empty slot with
+ *     the next frame, and the calling thread, which transforms a
+ *     full slot, writes it and hands it back. Each slot owns its
+ *     raw raster, its input and output pixel arrays and its
+ *     encoded output, and keeps them from frame to frame while
+ *     the frame size does not change. Rasters are decoded and
+ *     encoded by ppmio's row converters, the same as a single
+ *     image.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "assert.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "relayout.h"
+#include "frames.h"
+#include "trace.h"
+
+typedef A2Methods_UArray2 A2;
+
+typedef enum SlotState {
+        SLOT_EMPTY, SLOT_FULL, SLOT_END, SLOT_BAD
+} SlotState;
+
+/* Slot is one frame on its way through the stream */
+typedef struct Slot {
+        SlotState state;
+        unsigned width, height, maxval;
+        double start;                   /* when decoding began, in ns */
+        unsigned char *raster;          /* raw P6 bytes of the frame */
+        size_t raster_capacity;
+        A2 input, output;               /* NULL until first needed */
+        unsigned char *encoded;         /* raw P6 bytes of the output */
+        size_t encoded_capacity;
+} Slot;
+
+/* Stream is shared by the decoder thread and the caller */
+typedef struct Stream {
+        FILE *input;
+        A2Methods_T methods;
+        int block_width, block_height;  /* as for A2_new_shaped */
+        Slot slot[2];
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+} Stream;
+
+/* FrameData is the closure for transforming one frame into the output
+ * array of its slot
+ */
+typedef struct FrameData {
+        A2Methods_T methods;
+        A2 output;
+        Orientation orientation;
+        int width, height, size;
+} FrameData;
+
+static void *decode_frames(void *cl);
+static int decode_frame(Stream *stream, Slot *slot);
+static void write_frame(FILE *output, A2Methods_T methods, Slot *slot);
+static void apply_frame(int i, int j, A2 array2, A2Methods_Object *ptr,
+                        void *cl);
+static void set_state(Stream *stream, Slot *slot, SlotState state);
+static void free_slot(A2Methods_T methods, Slot *slot);
+static int compare_doubles(const void *a, const void *b);
+
+/* now_ns
+ *    Purpose: read the monotonic wall clock
+ *    Returns: the time in nanoseconds
+ */
+static double now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Frames_stream
+ * Purpose: Transform a stream of concatenated P6 frames, decoding the next
+ *          frame while the current one is transformed and written
+ * Parameters: the input and output streams, the orientation, the methods
+ *             suite, the shape of its blocks (0 by 0 for the default) and
+ *             the mapping to transform with, and where to store the
+ *             statistics
+ * Returns: void
+ *
+ * Expected input: open streams, a suite, a shape A2_new_shaped accepts
+ *                 and one of the suite's mappings
+ * Success output: every frame transformed, in order, on 'output'
+ * Failure output: Pnm_Badformat if a frame is malformed or truncated; the
+ *                 frames before it have been written
+ */
+void Frames_stream(FILE *input, FILE *output, Orientation orientation,
+                   A2Methods_T methods, int block_width, int block_height,
+                   A2Methods_mapfun *map, FrameStats *stats)
+{
+        assert(input != NULL && output != NULL && methods != NULL &&
+               map != NULL && stats != NULL);
+
+        Stream stream;
+        memset(&stream, 0, sizeof(stream));
+        stream.input = input;
+        stream.methods = methods;
+        stream.block_width = block_width;
+        stream.block_height = block_height;
+        pthread_mutex_init(&stream.lock, NULL);
+        pthread_cond_init(&stream.changed, NULL);
+
+        size_t latency_capacity = 64;
+        double *latency = malloc(latency_capacity * sizeof(double));
+        assert(latency != NULL);
+        unsigned frames = 0;
+
+        double start = now_ns();
+        pthread_t decoder;
+        int rc = pthread_create(&decoder, NULL, decode_frames, &stream);
+        assert(rc == 0);
+
+        SlotState last;
+        for (int k = 0;; k ^= 1) {
+                Slot *slot = &stream.slot[k];
+                uint64_t wait = Trace_begin();
+                pthread_mutex_lock(&stream.lock);
+                while (slot->state == SLOT_EMPTY) {
+                        pthread_cond_wait(&stream.changed, &stream.lock);
+                }
+                last = slot->state;
+                pthread_mutex_unlock(&stream.lock);
+                Trace_end("frame wait", wait, frames);
+                if (last != SLOT_FULL) {
+                        break;
+                }
+
+                /* reuse the slot's output array while the size holds */
+                int size = methods->size(slot->input);
+                int swaps = Orientation_swaps(orientation);
+                int out_width = swaps ? slot->height : slot->width;
+                int out_height = swaps ? slot->width : slot->height;
+                if (slot->output == NULL) {
+                        slot->output = A2_new_shaped(methods, out_width,
+                                                     out_height, size,
+                                                     stream.block_width,
+                                                     stream.block_height);
+                }
+                FrameData data = { methods, slot->output, orientation,
+                                   slot->width, slot->height, size };
+                uint64_t phase = Trace_begin();
+                map(slot->input, apply_frame, &data);
+                Trace_end("transform", phase, frames);
+                phase = Trace_begin();
+                write_frame(output, methods, slot);
+                Trace_end("write", phase, frames);
+
+                if (frames == latency_capacity) {
+                        latency_capacity *= 2;
+                        latency = realloc(latency,
+                                          latency_capacity * sizeof(double));
+                        assert(latency != NULL);
+                }
+                latency[frames++] = now_ns() - slot->start;
+                set_state(&stream, slot, SLOT_EMPTY);
+        }
+        fflush(output);
+        pthread_join(decoder, NULL);
+
+        stats->frames = frames;
+        stats->seconds = (now_ns() - start) / 1e9;
+        qsort(latency, frames, sizeof(double), compare_doubles);
+        double *percentile[] = { &stats->latency_p50, &stats->latency_p90,
+                                 &stats->latency_p99 };
+        double rank[] = { 0.50, 0.90, 0.99 };
+        for (int p = 0; p < 3; p++) {
+                /* nearest rank */
+                size_t n = (size_t)(rank[p] * frames + 0.999999);
+                *percentile[p] = frames == 0 ? 0 : latency[n > 0 ? n - 1
+                                                                 : 0];
+        }
+        stats->latency_max = frames == 0 ? 0 : latency[frames - 1];
+
+        free(latency);
+        free_slot(methods, &stream.slot[0]);
+        free_slot(methods, &stream.slot[1]);
+        pthread_cond_destroy(&stream.changed);
+        pthread_mutex_destroy(&stream.lock);
+        if (last == SLOT_BAD) {
+                RAISE(Pnm_Badformat);
+        }
+}
+
+/* decode_frames
+ *    Purpose: decoder thread body: fill the slots in turn until the input
+ *             ends or a frame is bad, which is recorded in the slot
+ *    Returns: NULL
+ */
+static void *decode_frames(void *cl)
+{
+        Stream *stream = cl;
+        for (int k = 0;; k ^= 1) {
+                Slot *slot = &stream->slot[k];
+                pthread_mutex_lock(&stream->lock);
+                while (slot->state != SLOT_EMPTY) {
+                        pthread_cond_wait(&stream->changed, &stream->lock);
+                }
+                pthread_mutex_unlock(&stream->lock);
+
+                /* whitespace may separate frames; anything else starts one */
+                int c = getc(stream->input);
+                while (c != EOF && isspace(c)) {
+                        c = getc(stream->input);
+                }
+                if (c == EOF) {
+                        set_state(stream, slot, SLOT_END);
+                        return NULL;
+                }
+                ungetc(c, stream->input);
+
+                slot->start = now_ns();
+                uint64_t phase = Trace_begin();
+                if (!decode_frame(stream, slot)) {
+                        set_state(stream, slot, SLOT_BAD);
+                        return NULL;
+                }
+                Trace_end("decode", phase, -1);
+                set_state(stream, slot, SLOT_FULL);
+        }
+}
+
+/* decode_frame
+ *    Purpose: read one P6 frame into a slot and unpack it into the slot's
+ *             input array, which is replaced only if the frame's size or
+ *             depth differs from the last one in this slot
+ *    Returns: 1 on success and 0 if the frame is bad
+ */
+static int decode_frame(Stream *stream, Slot *slot)
+{
+        A2Methods_T methods = stream->methods;
+        unsigned width, height, maxval;
+        if (!Ppmio_read_header(stream->input, &width, &height, &maxval)) {
+                return 0;
+        }
+        int wide = maxval > 255;
+        size_t bpp = wide ? 6 : 3;
+        size_t bytes = (size_t)width * height * bpp;
+        if (bytes > slot->raster_capacity) {
+                free(slot->raster);
+                slot->raster = malloc(bytes);
+                assert(slot->raster != NULL);
+                slot->raster_capacity = bytes;
+        }
+        if (fread(slot->raster, 1, bytes, stream->input) != bytes) {
+                return 0;
+        }
+
+        int size = wide ? sizeof(struct Pnm_rgb16) : sizeof(struct Pnm_rgb);
+        if (slot->input != NULL &&
+            (slot->width != width || slot->height != height ||
+             methods->size(slot->input) != size)) {
+                methods->free(&slot->input);
+                if (slot->output != NULL) {
+                        methods->free(&slot->output);
+                }
+        }
+        if (slot->input == NULL) {
+                slot->input = A2_new_shaped(methods, width, height, size,
+                                            stream->block_width,
+                                            stream->block_height);
+                slot->output = NULL;
+        }
+        slot->width = width;
+        slot->height = height;
+        slot->maxval = maxval;
+
+        struct Pnm_ppm frame = { width, height, maxval, slot->input,
+                                 methods };
+        Ppmio_decode_rows(&frame, slot->raster, 0, height);
+        return 1;
+}
+
+/* write_frame
+ *    Purpose: pack a slot's output array into its encoded buffer and write
+ *             it as one P6 frame
+ */
+static void write_frame(FILE *output, A2Methods_T methods, Slot *slot)
+{
+        A2 array = slot->output;
+        unsigned width = methods->width(array);
+        unsigned height = methods->height(array);
+        int wide = slot->maxval > 255;
+        size_t bpp = wide ? 6 : 3;
+        size_t bytes = (size_t)width * height * bpp;
+        if (bytes > slot->encoded_capacity) {
+                free(slot->encoded);
+                slot->encoded = malloc(bytes);
+                assert(slot->encoded != NULL);
+                slot->encoded_capacity = bytes;
+        }
+
+        struct Pnm_ppm frame = { width, height, slot->maxval, array,
+                                 methods };
+        Ppmio_encode_rows(&frame, slot->encoded, 0, height);
+        fprintf(output, "P6\n%u %u\n%u\n", width, height, slot->maxval);
+        fwrite(slot->encoded, 1, bytes, output);
+}
+
+/* apply_frame
+ *    Purpose: apply function that copies an input cell to where the
+ *             orientation puts it in the output array of the closure
+ */
+static void apply_frame(int i, int j, A2 array2, A2Methods_Object *ptr,
+                        void *cl)
+{
+        (void)array2;
+        FrameData *data = cl;
+        int new_i, new_j;
+        orient_coords(data->orientation, i, j, data->width, data->height,
+                      &new_i, &new_j);
+        void *cell = data->methods->at(data->output, new_i, new_j);
+        if (data->size == sizeof(struct Pnm_rgb)) {
+                *(Pnm_rgb)cell = *(Pnm_rgb)ptr;
+        } else {
+                *(Pnm_rgb16)cell = *(Pnm_rgb16)ptr;
+        }
+}
+
+/* set_state
+ *    Purpose: hand a slot over by changing its state under the lock
+ */
+static void set_state(Stream *stream, Slot *slot, SlotState state)
+{
+        pthread_mutex_lock(&stream->lock);
+        slot->state = state;
+        pthread_cond_broadcast(&stream->changed);
+        pthread_mutex_unlock(&stream->lock);
+}
+
+/* free_slot
+ *    Purpose: release everything a slot holds
+ */
+static void free_slot(A2Methods_T methods, Slot *slot)
+{
+        if (slot->input != NULL) {
+                methods->free(&slot->input);
+        }
+        if (slot->output != NULL) {
+                methods->free(&slot->output);
+        }
+        free(slot->raster);
+        free(slot->encoded);
+}
+
+/* compare_doubles
+ *    Purpose: qsort comparison for ascending doubles
+ */
+static int compare_doubles(const void *a, const void *b)
+{
+        double x = *(const double *)a, y = *(const double *)b;
+        return (x > y) - (x < y);
+}
@@ -0,0 +1,45 @@
+/**************************************************************
+ *
+ *                     frames.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     A stream mode for sequences of P6 frames concatenated on
+ *     one stream, as Netpbm allows. Every frame is transformed
+ *     and written in turn. A decoder thread reads and unpacks
+ *     frame N + 1 while frame N is transformed and written, and
+ *     the two frame slots keep their pixel arrays and raster
+ *     buffers for as long as the frame size stays the same.
+ *
+ **************************************************************/
+
+#ifndef __FRAMES__
+#define __FRAMES__
+
+#include <stdio.h>
+
+#include "a2methods.h"
+#include "transform.h"
+
+/* throughput and per-frame latency of a stream; latency runs from the
+ * start of a frame's decoding to the end of its write, in nanoseconds
+ */
+typedef struct FrameStats {
+        unsigned frames;
+        double seconds;         /* wall-clock time of the whole stream */
+        double latency_p50, latency_p90, latency_p99, latency_max;
+} FrameStats;
+
+/* Transform every frame on 'input' to 'output' with the given suite,
+ * block shape (0 by 0 for the default blocks) and mapping, filling in
+ * *stats. An empty input is a stream of no frames. Raises Pnm_Badformat
+ * if a frame is not a complete P6 image
+ */
+void Frames_stream(FILE *input, FILE *output, Orientation orientation,
+                   A2Methods_T methods, int block_width, int block_height,
+                   A2Methods_mapfun *map, FrameStats *stats);
+
+#endif /* __FRAMES__ */
@@ -0,0 +1,209 @@
+/**************************************************************
+ *
+ *                     locsim.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     This program predicts the locality of every ppmtrans
+ *     transform and mapping for one image. Each transform runs
+ *     on a traced methods suite, and the trace of cell accesses
+ *     drives a cache and TLB simulator. The hit rate of every
+ *     level is printed, so mappings can be compared for a new
+ *     image shape or machine without timing a full run.
+ *
+ *     Note
+ *     Only cell accesses are traced; the arrays' own bookkeeping
+ *     (the width, stride and storage pointer read on every at) is
+ *     not.
+ *     Example commands:
+ *     ./locsim testing/flowers.ppm
+ *     ./locsim -cache L1=48K/12/64,L2=2M/16/64,TLB=1536/12/4K big.ppm
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "a2traced.h"
+#include "cachesim.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "transform.h"
+
+/* a transform as ppmtrans options give it */
+typedef struct Transform {
+        const char *name;
+        int degrees;
+        char *flip;
+        int transpose;
+} Transform;
+
+static Transform transforms[] = {
+        { "rotate 90", 90, NULL, 0 },
+        { "rotate 180", 180, NULL, 0 },
+        { "rotate 270", 270, NULL, 0 },
+        { "flip horizontal", 0, "horizontal", 0 },
+        { "flip vertical", 0, "vertical", 0 },
+        { "transpose", 0, NULL, 1 },
+};
+
+/* the traced plain suite, for map_tiled */
+static A2Methods_T traced_plain;
+
+static const char *mappings[] = { "row-major", "col-major", "tiled",
+                                  "block-major" };
+
+static void usage(const char *progname);
+static void map_tiled(A2Methods_UArray2 array2, A2Methods_applyfun apply,
+                      void *cl);
+static Pnm_ppm copy_image(Pnm_ppm image, A2Methods_T methods);
+static void copy_cell(int i, int j, A2Methods_UArray2 array2,
+                      A2Methods_Object *ptr, void *cl);
+
+int main(int argc, char *argv[])
+{
+        const char *config = CACHESIM_DEFAULT;
+        char *filename = NULL;
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc) {
+                        config = argv[++i];
+                } else if (*argv[i] == '-' || filename != NULL) {
+                        usage(argv[0]);
+                } else {
+                        filename = argv[i];
+                }
+        }
+
+        CacheSim_T sim = CacheSim_new(config);
+        if (sim == NULL) {
+                fprintf(stderr, "%s: bad cache configuration '%s'\n",
+                        argv[0], config);
+                usage(argv[0]);
+        }
+
+        FILE *fp = stdin;
+        if (filename != NULL) {
+                fp = fopen(filename, "r");
+                if (fp == NULL) {
+                        fprintf(stderr, "%s: cannot open %s\n", argv[0],
+                                filename);
+                        exit(EXIT_FAILURE);
+                }
+        }
+        Pnm_ppm image = Ppmio_read(fp, uarray2_methods_plain);
+        if (fp != stdin) {
+                fclose(fp);
+        }
+
+        printf("%u x %u image, %d-byte pixels, %s\n\n", image->width,
+               image->height, image->methods->size(image->pixels), config);
+        printf("%-16s %-12s %12s", "transform", "mapping", "accesses");
+        for (int k = 0; k < CacheSim_levels(sim); k++) {
+                printf(" %7s", CacheSim_name(sim, k));
+        }
+        printf("\n");
+
+        for (size_t t = 0; t < sizeof(transforms) / sizeof(*transforms);
+             t++) {
+                for (int m = 0; m < 4; m++) {
+                        A2Methods_T base = m == 3 ? uarray2_methods_blocked
+                                                  : uarray2_methods_plain;
+                        A2Methods_T traced = a2traced_methods(base, sim);
+                        traced_plain = traced;
+                        A2Methods_mapfun *map = m == 0
+                                ? traced->map_row_major
+                                : m == 1 ? traced->map_col_major
+                                : m == 2 ? map_tiled
+                                         : traced->map_block_major;
+
+                        /* copy untraced, so only the transform is seen */
+                        Pnm_ppm input = copy_image(image, base);
+                        input->methods = traced;
+                        CacheSim_reset(sim);
+                        Pnm_ppm output = transform(input,
+                                                   transforms[t].degrees,
+                                                   transforms[t].flip,
+                                                   transforms[t].transpose,
+                                                   traced, map);
+
+                        printf("%-16s %-12s %12llu", transforms[t].name,
+                               mappings[m], CacheSim_accesses(sim, 0));
+                        for (int k = 0; k < CacheSim_levels(sim); k++) {
+                                printf(" %6.2f%%",
+                                       100 * CacheSim_hit_rate(sim, k));
+                        }
+                        printf("\n");
+                        Pnm_ppmfree(&output);
+                }
+        }
+
+        Pnm_ppmfree(&image);
+        CacheSim_free(&sim);
+        return 0;
+}
+
+/* usage
+ * Purpose: Describe the command line on standard error and exit
+ * Parameters: the program name
+ * Returns: does not return
+ *
+ * Expected input: a non-null program name
+ * Success output: none
+ * Failure output: the usage message on standard error
+ */
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s [-cache <levels>] [filename]\n"
+                        "       levels: NAME=size/ways/line,... and "
+                        "optionally TLB=entries/ways/page\n"
+                        "       default: %s\n", progname, CACHESIM_DEFAULT);
+        exit(1);
+}
+
+/* map_tiled
+ *    Purpose: the traced plain suite's tiled mapping, with its default
+ *             tile size, as a mapping function transform can take
+ */
+static void map_tiled(A2Methods_UArray2 array2, A2Methods_applyfun apply,
+                      void *cl)
+{
+        traced_plain->map_tiled(array2, 0, apply, cl);
+}
+
+/* copy_image
+ *    Purpose: copy an image into a new array of the given suite
+ *    Returns: the copy, with 'methods' as its suite
+ */
+static Pnm_ppm copy_image(Pnm_ppm image, A2Methods_T methods)
+{
+        Pnm_ppm copy;
+        NEW(copy);
+        *copy = *image;
+        copy->methods = methods;
+        copy->pixels = methods->new(image->width, image->height,
+                                    image->methods->size(image->pixels));
+        methods->map_default(copy->pixels, copy_cell, image);
+        return copy;
+}
+
+/* copy_cell
+ *    Purpose: apply function that copies the matching cell of the image
+ *             in the closure into this cell
+ */
+static void copy_cell(int i, int j, A2Methods_UArray2 array2,
+                      A2Methods_Object *ptr, void *cl)
+{
+        Pnm_ppm image = cl;
+        memcpy(ptr, image->methods->at(image->pixels, i, j),
+               image->methods->size(array2));
+}
@@ -0,0 +1,154 @@
+/**************************************************************
+ *
+ *                     memstats.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the memory accounting. The counters are
+ *     updated with atomic operations, since arrays are made and
+ *     freed on several threads at once (the stream decoder, the
+ *     server workers); the peak is raised with compare-and-swap.
+ *     Each thread also counts its own allocations, so a server
+ *     worker can report what it made without the other workers'.
+ *
+ **************************************************************/
+
+#define _GNU_SOURCE             /* RUSAGE_THREAD */
+
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "assert.h"
+#include "memstats.h"
+
+static size_t live_bytes;
+static size_t peak_bytes;
+static unsigned long allocations;
+static __thread unsigned long thread_allocations;
+
+/* MemStats_allocated
+ * Purpose: Count an allocation of 'bytes', raising the peak if the live
+ *          bytes are now higher than it
+ * Parameters: the size of the allocation
+ * Returns: void
+ *
+ * Expected input: any size
+ * Success output: none
+ * Failure output: none
+ */
+void MemStats_allocated(size_t bytes)
+{
+        size_t live = __atomic_add_fetch(&live_bytes, bytes,
+                                         __ATOMIC_RELAXED);
+        __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+        thread_allocations++;
+
+        size_t peak = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+        while (live > peak &&
+               !__atomic_compare_exchange_n(&peak_bytes, &peak, live, 1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+        }
+}
+
+/* MemStats_released
+ * Purpose: Count the release of 'bytes' counted by MemStats_allocated
+ * Parameters: the size of the allocation
+ * Returns: void
+ *
+ * Expected input: the size an allocation was counted with
+ * Success output: none
+ * Failure output: none
+ */
+void MemStats_released(size_t bytes)
+{
+        __atomic_sub_fetch(&live_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/* MemStats_malloc
+ * Purpose: Allocate memory and count it
+ * Parameters: the number of bytes
+ * Returns: the memory, freed with MemStats_free
+ *
+ * Expected input: a positive size
+ * Success output: none
+ * Failure output: CRE if the memory cannot be allocated
+ */
+void *MemStats_malloc(size_t bytes)
+{
+        void *ptr = malloc(bytes);
+        assert(ptr != NULL);
+        MemStats_allocated(bytes);
+        return ptr;
+}
+
+/* MemStats_free
+ * Purpose: Free memory from MemStats_malloc and count its release
+ * Parameters: the memory and the size it was allocated with
+ * Returns: void
+ *
+ * Expected input: memory from MemStats_malloc, or NULL
+ * Success output: none
+ * Failure output: none
+ */
+void MemStats_free(void *ptr, size_t bytes)
+{
+        if (ptr != NULL) {
+                MemStats_released(bytes);
+                free(ptr);
+        }
+}
+
+/* fill
+ *    Purpose: copy the counters and the page faults getrusage reports for
+ *             'who' into *stats, with the calling thread's allocations
+ *             for RUSAGE_THREAD
+ */
+static void fill(MemStats *stats, int who)
+{
+        assert(stats != NULL);
+        struct rusage usage;
+        if (getrusage(who, &usage) != 0) {
+                usage.ru_minflt = usage.ru_majflt = 0;
+        }
+        stats->live_bytes = __atomic_load_n(&live_bytes, __ATOMIC_RELAXED);
+        stats->peak_bytes = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+        stats->allocations = who == RUSAGE_THREAD
+                ? thread_allocations
+                : __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+        stats->minor_faults = usage.ru_minflt;
+        stats->major_faults = usage.ru_majflt;
+}
+
+/* MemStats_get
+ * Purpose: Read the counters and the page faults of the process
+ * Parameters: where to put them
+ * Returns: void
+ *
+ * Expected input: a non-null MemStats
+ * Success output: none
+ * Failure output: none
+ */
+void MemStats_get(MemStats *stats)
+{
+        fill(stats, RUSAGE_SELF);
+}
+
+/* MemStats_get_thread
+ * Purpose: Read the counters, with the allocations and page faults of
+ *          the calling thread only
+ * Parameters: where to put them
+ * Returns: void
+ *
+ * Expected input: a non-null MemStats
+ * Success output: none
+ * Failure output: none
+ */
+void MemStats_get_thread(MemStats *stats)
+{
+        fill(stats, RUSAGE_THREAD);
+}
@@ -0,0 +1,50 @@
+/**************************************************************
+ *
+ *                     memstats.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Memory accounting for ppmtrans. The methods suites count
+ *     the bytes of every array they make and free, and transform
+ *     counts its closures, so the live bytes, the most ever live
+ *     at once and the number of allocations can be reported with
+ *     the page faults getrusage sees. The counters are shared by
+ *     every thread of the process; allocations are also counted
+ *     per thread.
+ *
+ **************************************************************/
+
+#ifndef __MEMSTATS__
+#define __MEMSTATS__
+
+#include <stddef.h>
+
+typedef struct MemStats {
+        size_t live_bytes;              /* counted and not yet released */
+        size_t peak_bytes;              /* most ever live at once */
+        unsigned long allocations;
+        long minor_faults, major_faults;
+} MemStats;
+
+/* Count 'bytes' as allocated or as released */
+void MemStats_allocated(size_t bytes);
+void MemStats_released(size_t bytes);
+
+/* malloc and free, counted. MemStats_malloc never returns NULL: running
+ * out of memory is a CRE. MemStats_free needs the size that was allocated
+ */
+void *MemStats_malloc(size_t bytes);
+void MemStats_free(void *ptr, size_t bytes);
+
+/* The counters, with the page faults of the whole process */
+void MemStats_get(MemStats *stats);
+
+/* The counters, with the allocations and page faults of the calling
+ * thread only; threads it hands work to are not included
+ */
+void MemStats_get_thread(MemStats *stats);
+
+#endif /* __MEMSTATS__ */
@@ -0,0 +1,187 @@
+/**************************************************************
+ *
+ *                     numaplace.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the NUMA placement interface. Nodes and
+ *     their CPUs come from /sys/devices/system/node, which exists
+ *     whether or not libnuma is installed. Memory is bound with
+ *     mbind (through libnuma) only when built with HAVE_LIBNUMA.
+ *
+ **************************************************************/
+
+#define _GNU_SOURCE     /* cpu_set_t, pthread_setaffinity_np */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#endif
+
+#include "assert.h"
+#include "mem.h"
+#include "numaplace.h"
+
+#define MAX_NODES 64
+
+struct Numa_T {
+        int nodes;
+        cpu_set_t cpus[MAX_NODES];
+};
+
+static int read_cpulist(int node, cpu_set_t *cpus);
+
+/* Numa_new
+ * Purpose: Find the memory nodes of this machine and the CPUs on each
+ * Parameters: none
+ * Returns: a new Numa_T
+ *
+ * Expected input: none
+ * Success output: none
+ * Failure output: none; a machine whose topology cannot be read, or whose
+ *                 nodes have no CPUs the process may use, is one node
+ */
+Numa_T Numa_new(void)
+{
+        Numa_T numa;
+        NEW(numa);
+        numa->nodes = 0;
+
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+                long online = sysconf(_SC_NPROCESSORS_ONLN);
+                for (int cpu = 0; cpu < online; cpu++) {
+                        CPU_SET(cpu, &allowed);
+                }
+        }
+
+        for (int node = 0; node < MAX_NODES; node++) {
+                cpu_set_t cpus;
+                if (!read_cpulist(node, &cpus)) {
+                        continue;
+                }
+                CPU_AND(&cpus, &cpus, &allowed);
+                if (CPU_COUNT(&cpus) > 0) {
+                        numa->cpus[numa->nodes++] = cpus;
+                }
+        }
+
+        if (numa->nodes == 0) {
+                numa->cpus[0] = allowed;
+                numa->nodes = 1;
+        }
+        return numa;
+}
+
+void Numa_free(Numa_T *numap)
+{
+        assert(numap != NULL && *numap != NULL);
+        FREE(*numap);
+}
+
+int Numa_nodes(Numa_T numa)
+{
+        assert(numa != NULL);
+        return numa->nodes;
+}
+
+int Numa_cpus(Numa_T numa, int node)
+{
+        assert(numa != NULL && node >= 0 && node < numa->nodes);
+        return CPU_COUNT(&numa->cpus[node]);
+}
+
+/* Numa_pin
+ * Purpose: Let the calling thread run only on the CPUs of one node
+ * Parameters: the topology and the node
+ * Returns: void
+ *
+ * Expected input: a node below Numa_nodes
+ * Success output: none
+ * Failure output: CRE if the node is out of range; if the kernel refuses
+ *                 the affinity the thread simply stays unpinned
+ */
+void Numa_pin(Numa_T numa, int node)
+{
+        assert(numa != NULL && node >= 0 && node < numa->nodes);
+        if (numa->nodes > 1) {
+                pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                       &numa->cpus[node]);
+        }
+}
+
+/* Numa_bind
+ * Purpose: Ask for the pages under a range of memory to live on one node
+ * Parameters: the topology, the start and length of the range, and the
+ *             node
+ * Returns: void
+ *
+ * Expected input: a range that has not been touched yet; pages shared
+ *                 with a neighbouring range go to whichever binds last
+ * Success output: none
+ * Failure output: none; binding is only advice
+ */
+void Numa_bind(Numa_T numa, void *addr, size_t length, int node)
+{
+        assert(numa != NULL && node >= 0 && node < numa->nodes);
+#ifdef HAVE_LIBNUMA
+        if (numa->nodes > 1 && length > 0 && numa_available() >= 0) {
+                uintptr_t page = sysconf(_SC_PAGESIZE);
+                uintptr_t start = (uintptr_t)addr & ~(page - 1);
+                uintptr_t end = ((uintptr_t)addr + length + page - 1)
+                                & ~(page - 1);
+                numa_tonode_memory((void *)start, end - start, node);
+        }
+#else
+        (void)addr;
+        (void)length;
+#endif
+}
+
+/* read_cpulist
+ *    Purpose: parse /sys/devices/system/node/node<n>/cpulist, a list of
+ *             CPU numbers and ranges such as "0-7,16-23"
+ *    Returns: 1 if the node exists and 0 otherwise
+ */
+static int read_cpulist(int node, cpu_set_t *cpus)
+{
+        char path[64];
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+                return 0;
+        }
+
+        CPU_ZERO(cpus);
+        int first, last;
+        while (fscanf(fp, "%d", &first) == 1) {
+                last = first;
+                int c = getc(fp);
+                if (c == '-') {
+                        if (fscanf(fp, "%d", &last) != 1) {
+                                break;
+                        }
+                        c = getc(fp);
+                }
+                for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE;
+                     cpu++) {
+                        CPU_SET(cpu, cpus);
+                }
+                if (c != ',') {
+                        break;
+                }
+        }
+        fclose(fp);
+        return 1;
+}
@@ -0,0 +1,41 @@
+/**************************************************************
+ *
+ *                     numaplace.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The NUMA placement interface. It reports the memory nodes
+ *     of the machine and the CPUs on each, pins threads to a node,
+ *     and binds memory to a node. A machine without NUMA support
+ *     is reported as a single node holding every CPU the process
+ *     may run on, so callers never need a separate code path.
+ *
+ **************************************************************/
+
+#ifndef __NUMA_PLACEMENT__
+#define __NUMA_PLACEMENT__
+
+#include <stddef.h>
+
+typedef struct Numa_T *Numa_T;
+
+/* Discover the nodes; never fails, falls back to one node */
+Numa_T Numa_new(void);
+void Numa_free(Numa_T *numap);
+
+int Numa_nodes(Numa_T numa);
+int Numa_cpus(Numa_T numa, int node);
+
+/* Restrict the calling thread to the CPUs of 'node' */
+void Numa_pin(Numa_T numa, int node);
+
+/* Place the pages covering [addr, addr + length) on 'node'. Without
+ * libnuma this does nothing and placement falls to first touch, so the
+ * caller should touch the memory from a thread pinned to 'node'
+ */
+void Numa_bind(Numa_T numa, void *addr, size_t length, int node);
+
+#endif /* __NUMA_PLACEMENT__ */
@@ -0,0 +1,704 @@
+/**************************************************************
+ *
+ *                     options.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the ppmtrans options interface.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "transform.h"
+#include "planar.h"
+#include "cputiming.h"
+#include "ppmio.h"
+#include "tiled.h"
+#include "relayout.h"
+#include "costmodel.h"
+#include "options.h"
+
+/* fail
+ *    Purpose: record why parsing failed
+ *    Returns: 0, so callers can write 'return fail(...)'
+ */
+static int fail(Options *options, const char *format, ...)
+{
+        va_list args;
+        va_start(args, format);
+        vsnprintf(options->error, sizeof(options->error), format, args);
+        va_end(args);
+        return 0;
+}
+
+/* set_methods
+ *    Purpose: Set the method suite and mapping function for the
+ *             transformation
+ *    Returns: 1, or 0 if the suite does not support the mapping
+ */
+static int set_methods(Options *options, A2Methods_T methods,
+                       A2Methods_mapfun *map, const char *what)
+{
+        assert(methods != NULL);
+        options->methods = methods;
+        options->map = map;
+        options->block_width = options->block_height = 0;
+        options->auto_plan = 0;
+        if (map == NULL) {
+                return fail(options, "does not support %s mapping", what);
+        }
+        return 1;
+}
+
+/* MAP_TILED defines map_tiled_<tile>, the mapping function for
+ * -tiled-major=<tile>: the plain suite's tiled mapping with that tile,
+ * 0 being the default. A mapping function has no closure of its own, so
+ * the tile size is carried by which function the options hold
+ */
+#define MAP_TILED(tile)                                                 \
+static void map_tiled_##tile(A2Methods_UArray2 array2,                  \
+                             A2Methods_applyfun apply, void *cl)        \
+{                                                                       \
+        uarray2_methods_plain->map_tiled(array2, tile, apply, cl);      \
+}
+
+MAP_TILED(0)
+MAP_TILED(1) MAP_TILED(2) MAP_TILED(4) MAP_TILED(8) MAP_TILED(16)
+MAP_TILED(32) MAP_TILED(64) MAP_TILED(128) MAP_TILED(256) MAP_TILED(512)
+MAP_TILED(1024) MAP_TILED(2048) MAP_TILED(4096)
+
+#undef MAP_TILED
+
+/* tiled_maps are the -tiled-major mappings, tiled_maps[k] for a tile of
+ * 2^k
+ */
+static A2Methods_mapfun *const tiled_maps[] = {
+        map_tiled_1, map_tiled_2, map_tiled_4, map_tiled_8, map_tiled_16,
+        map_tiled_32, map_tiled_64, map_tiled_128, map_tiled_256,
+        map_tiled_512, map_tiled_1024, map_tiled_2048, map_tiled_4096
+};
+
+/* parse_count
+ *    Purpose: parse a positive decimal integer option value
+ *    Returns: 1 and the value in *n, or 0 if it is not one
+ */
+static int parse_count(const char *arg, int *n)
+{
+        char *endptr;
+        long value = strtol(arg, &endptr, 10);
+        if (*arg == '\0' || *endptr != '\0' || value < 1 || value > 1 << 30) {
+                return 0;
+        }
+        *n = value;
+        return 1;
+}
+
+/* parse_size
+ *    Purpose: parse a byte count with an optional K, M or G suffix
+ *    Returns: 1 and the value in *n, or 0 if it is not one
+ */
+static int parse_size(const char *arg, size_t *n)
+{
+        char *endptr;
+        unsigned long long value = strtoull(arg, &endptr, 10);
+        int shift = 0;
+        if (*endptr == 'K' || *endptr == 'k') {
+                shift = 10;
+        } else if (*endptr == 'M' || *endptr == 'm') {
+                shift = 20;
+        } else if (*endptr == 'G' || *endptr == 'g') {
+                shift = 30;
+        }
+        if (*arg == '\0' || *arg == '-' || value == 0 ||
+            endptr[shift != 0] != '\0' || value > (~0ULL >> 1) >> shift) {
+                return 0;
+        }
+        *n = value << shift;
+        return 1;
+}
+
+/* parse_shape
+ *    Purpose: parse a block shape written WIDTHxHEIGHT
+ *    Returns: 1 and the sides in *width and *height, or 0 if it is not one
+ */
+static int parse_shape(const char *arg, int *width, int *height)
+{
+        int end = 0;
+        if (sscanf(arg, "%dx%d%n", width, height, &end) != 2 ||
+            arg[end] != '\0') {
+                return 0;
+        }
+        return *width >= 1 && *height >= 1 &&
+               *width <= 1 << 15 && *height <= 1 << 15;
+}
+
+/* emit_names are the orientation names -emit accepts */
+static const struct {
+        const char *name;
+        Orientation orientation;
+} emit_names[] = {
+        { "rotate0", ORIENT_0 }, { "rotate90", ORIENT_90 },
+        { "rotate180", ORIENT_180 }, { "rotate270", ORIENT_270 },
+        { "flip-h", ORIENT_FLIP_H }, { "flip-v", ORIENT_FLIP_V },
+        { "transpose", ORIENT_TRANSPOSE }, { "transverse", ORIENT_TRANSVERSE }
+};
+
+/* parse_emit
+ *    Purpose: Parse an -emit output such as "rotate90:out90.ppm"; the
+ *             file name is not copied
+ *    Returns: 1, or 0 if the orientation or file name is missing or bad
+ */
+static int parse_emit(char *arg, Emit *emit)
+{
+        char *colon = strchr(arg, ':');
+        if (colon == NULL || colon[1] == '\0') {
+                return 0;
+        }
+        size_t length = colon - arg;
+        int names = sizeof(emit_names) / sizeof(emit_names[0]);
+        for (int k = 0; k < names; k++) {
+                if (strlen(emit_names[k].name) == length &&
+                    strncmp(arg, emit_names[k].name, length) == 0) {
+                        emit->orientation = emit_names[k].orientation;
+                        emit->file_name = colon + 1;
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+/* parse_rect
+ *    Purpose: parse a rectangle written x,y,WIDTHxHEIGHT whose far edges
+ *             x + WIDTH and y + HEIGHT fit in an int
+ *    Returns: 1 and the rectangle in *rect, or 0 if it is not one
+ */
+static int parse_rect(const char *arg, Rect *rect)
+{
+        int end = 0;
+        if (sscanf(arg, "%d,%d,%dx%d%n", &rect->x, &rect->y, &rect->width,
+                   &rect->height, &end) != 4 || arg[end] != '\0') {
+                return 0;
+        }
+        return rect->x >= 0 && rect->y >= 0 && rect->width > 0 &&
+               rect->height > 0 && rect->x <= INT_MAX - rect->width &&
+               rect->y <= INT_MAX - rect->height;
+}
+
+void Options_init(Options *options)
+{
+        assert(options != NULL);
+        memset(options, 0, sizeof(*options));
+
+        /* default to UArray2 methods and their best map */
+        options->methods = uarray2_methods_plain;
+        assert(options->methods);
+        options->map = options->methods->map_default;
+        assert(options->map);
+        options->scale = 1;
+        options->cache_max = 1024;
+        options->prefetch = 16;
+        options->io = PPMIO_ASYNC;
+        /* a plan is only as good as the costs behind it */
+        options->auto_plan = Costmodel_has_profile();
+}
+
+/* Options_parse
+ * Purpose: Parse ppmtrans options into an Options record
+ * Parameters: the record, filled in by Options_init, and an argument
+ *             vector whose first element is the program name
+ * Returns: 1 on success and 0 if the options are not valid
+ *
+ * Expected input: a non-null record and argument vector
+ * Success output: none
+ * Failure output: a message in options->error
+ */
+int Options_parse(Options *options, int argc, char *argv[])
+{
+        assert(options != NULL && argv != NULL);
+
+        for (int i = 1; i < argc; i++) {
+            /* options that take a value */
+            int has_value = i + 1 < argc;
+
+            /* change mapping function to reflect user input */
+            if (strcmp(argv[i], "-row-major") == 0) {
+                if (!set_methods(options, uarray2_methods_plain,
+                                 uarray2_methods_plain->map_row_major,
+                                 "row-major")) {
+                    return 0;
+                }
+            } else if (strcmp(argv[i], "-col-major") == 0) {
+                if (!set_methods(options, uarray2_methods_plain,
+                                 uarray2_methods_plain->map_col_major,
+                                 "column-major")) {
+                    return 0;
+                }
+            } else if (strcmp(argv[i], "-tiled-major") == 0 ||
+                       strncmp(argv[i], "-tiled-major=", 13) == 0) {
+                options->tile = 0;
+                A2Methods_mapfun *map = map_tiled_0;
+                if (argv[i][12] == '=') {
+                    int k = 0;
+                    if (parse_count(argv[i] + 13, &options->tile)) {
+                        while (k < 12 && 1 << k < options->tile) {
+                            k++;
+                        }
+                    }
+                    if (options->tile != 1 << k) {
+                        return fail(options, "Tile size must be a power of "
+                                             "two from 1 to 4096");
+                    }
+                    map = tiled_maps[k];
+                }
+                set_methods(options, uarray2_methods_plain, map, "tiled");
+            } else if (strcmp(argv[i], "-block-major") == 0) {
+                if (!set_methods(options, uarray2_methods_blocked,
+                                 uarray2_methods_blocked->map_block_major,
+                                 "block-major")) {
+                    return 0;
+                }
+            } else if (strncmp(argv[i], "-block-major=", 13) == 0) {
+                int block_width, block_height;
+                if (!parse_shape(argv[i] + 13, &block_width, &block_height)) {
+                    return fail(options, "Block shape must be WIDTHxHEIGHT");
+                }
+                if (!set_methods(options, uarray2_methods_blocked,
+                                 uarray2_methods_blocked->map_block_major,
+                                 "block-major")) {
+                    return 0;
+                }
+                options->block_width = block_width;
+                options->block_height = block_height;
+            /* check for a plan chosen by the cost model */
+            } else if (strcmp(argv[i], "-auto") == 0) {
+                options->auto_plan = 1;
+            /* check for rotation value */
+            } else if (strcmp(argv[i], "-rotate") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs an angle", argv[i]);
+                }
+                char *endptr;
+                int rotation = strtol(argv[++i], &endptr, 10);
+                if (!(rotation == 0 || rotation == 90 ||
+                      rotation == 180 || rotation == 270) ||
+                    *endptr != '\0') {
+                    return fail(options,
+                                "Rotation must be 0, 90 180 or 270");
+                }
+                options->rotation = rotation;
+            /* check for flips */
+            } else if (strcmp(argv[i], "-flip") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a direction", argv[i]);
+                }
+                char *flip = argv[++i];
+                if (!(strcmp(flip, "horizontal") == 0 ||
+                      strcmp(flip, "vertical") == 0)) {
+                    return fail(options,
+                                "Flip must be horizontal or vertical");
+                }
+                options->flip = flip;
+            /* check for a downscale factor, given as 1/N */
+            } else if (strcmp(argv[i], "-scale") == 0) {
+                if (!has_value || strncmp(argv[i + 1], "1/", 2) != 0 ||
+                    !parse_count(argv[i + 1] + 2, &options->scale) ||
+                    options->scale > MAX_SCALE) {
+                    return fail(options, "Scale must be 1/N for N from 1 "
+                                         "to %d", MAX_SCALE);
+                }
+                i++;
+            /* check for planar (one array per channel) storage */
+            } else if (strcmp(argv[i], "-planar") == 0) {
+                options->planar = 1;
+            /* check for a multithreaded, NUMA-aware transform */
+            } else if (strcmp(argv[i], "-threads") == 0) {
+                if (!has_value || !parse_count(argv[++i],
+                                               &options->threads)) {
+                    return fail(options, "Threads must be at least 1");
+                }
+            /* check for the format of the output image */
+            } else if (strcmp(argv[i], "-out-format") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a format", argv[i]);
+                }
+                char *format = argv[++i];
+                if (strcmp(format, "ppm") == 0) {
+                    options->out_format = OUT_PPM;
+                } else if (strcmp(format, "tiled") == 0) {
+                    options->out_format = OUT_TILED;
+                } else {
+                    return fail(options, "Output format must be ppm or "
+                                         "tiled");
+                }
+            /* check for a result cache and its size cap */
+            } else if (strcmp(argv[i], "-cache") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a directory", argv[i]);
+                }
+                options->cache_dir = argv[++i];
+            } else if (strcmp(argv[i], "-cache-max") == 0) {
+                if (!has_value || !parse_count(argv[++i],
+                                               &options->cache_max)) {
+                    return fail(options, "Cache size must be at least 1 MB");
+                }
+            /* check for an out-of-core transform and its memory budget */
+            } else if (strcmp(argv[i], "-memory-limit") == 0) {
+                if (!has_value || !parse_size(argv[++i],
+                                              &options->memory_limit)) {
+                    return fail(options, "Memory limit must be a size "
+                                         "such as 512M");
+                }
+            /* check for the image I/O */
+            } else if (strcmp(argv[i], "-io") == 0) {
+                const char *mode = has_value ? argv[++i] : "";
+                if (strcmp(mode, "stdio") == 0) {
+                    options->io = PPMIO_STDIO;
+                } else if (strcmp(mode, "async") == 0) {
+                    options->io = PPMIO_ASYNC;
+                } else if (strcmp(mode, "direct") == 0) {
+                    options->io = PPMIO_DIRECT;
+                } else {
+                    return fail(options, "-io must be stdio, async or "
+                                         "direct");
+                }
+            /* check for a stream of frames */
+            } else if (strcmp(argv[i], "-stream") == 0) {
+                options->stream = 1;
+            /* check for an incremental update of a previous output */
+            } else if (strcmp(argv[i], "-update") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a file name", argv[i]);
+                }
+                options->update_name = argv[++i];
+            } else if (strcmp(argv[i], "-dirty") == 0) {
+                if (options->dirty_count == MAX_DIRTY) {
+                    return fail(options, "At most %d -dirty rectangles",
+                                MAX_DIRTY);
+                }
+                if (!has_value ||
+                    !parse_rect(argv[++i],
+                                &options->dirty[options->dirty_count++])) {
+                    return fail(options, "Dirty rectangle must be "
+                                         "x,y,WIDTHxHEIGHT");
+                }
+            /* check for several orientations written from one read */
+            } else if (strcmp(argv[i], "-emit") == 0) {
+                if (options->emit_count == MAX_EMITS) {
+                    return fail(options, "At most %d -emit outputs",
+                                MAX_EMITS);
+                }
+                if (!has_value ||
+                    !parse_emit(argv[++i],
+                                &options->emits[options->emit_count++])) {
+                    return fail(options, "-emit needs ORIENTATION:FILE "
+                                         "(rotate0, rotate90, rotate180, "
+                                         "rotate270, flip-h, flip-v, "
+                                         "transpose or transverse)");
+                }
+            /* check for the mip levels of the output */
+            } else if (strcmp(argv[i], "-pyramid") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a file prefix", argv[i]);
+                }
+                options->pyramid_name = argv[++i];
+            /* check for the output write strategy and prefetch distance */
+            } else if (strcmp(argv[i], "-write-strategy") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a strategy", argv[i]);
+                }
+                char *strategy = argv[++i];
+                if (strcmp(strategy, "normal") == 0) {
+                    options->write_strategy = WRITE_NORMAL;
+                } else if (strcmp(strategy, "gather") == 0) {
+                    options->write_strategy = WRITE_GATHER;
+                } else if (strcmp(strategy, "stream") == 0) {
+                    options->write_strategy = WRITE_STREAM;
+                } else {
+                    return fail(options, "Write strategy must be normal, "
+                                         "gather or stream");
+                }
+            } else if (strcmp(argv[i], "-prefetch") == 0) {
+                if (!has_value || (strcmp(argv[i + 1], "0") != 0 &&
+                                   !parse_count(argv[i + 1],
+                                                &options->prefetch))) {
+                    return fail(options, "Prefetch distance must be 0 or "
+                                         "more pixels");
+                }
+                if (strcmp(argv[++i], "0") == 0) {
+                    options->prefetch = 0;
+                }
+            /* check for transpose */
+            } else if (strcmp(argv[i], "-transpose") == 0) {
+                options->transpose = 1;
+            /* check if going to use -time */
+            } else if (strcmp(argv[i], "-time") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a file name", argv[i]);
+                }
+                options->time_file_name = argv[++i];
+            /* check for a timeline of the run's phases */
+            } else if (strcmp(argv[i], "-trace") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a file name", argv[i]);
+                }
+                options->trace_file_name = argv[++i];
+            /* check for an output file other than standard output */
+            } else if (strcmp(argv[i], "-output") == 0) {
+                if (!has_value) {
+                    return fail(options, "%s needs a file name", argv[i]);
+                }
+                options->output_name = argv[++i];
+            /* exceptions handling */
+            } else if (*argv[i] == '-') {
+                return fail(options, "unknown option '%s'", argv[i]);
+            } else if (argc - i > 1) {
+                return fail(options, "Too many arguments");
+            } else {
+                options->filename = argv[i];
+            }
+        }
+
+        if (options->planar + (options->scale > 1) +
+            (options->threads > 0) +
+            (options->write_strategy != WRITE_NORMAL) > 1) {
+            return fail(options, "only one of -planar, -scale, -threads and "
+                                 "-write-strategy may be given");
+        }
+        if (options->write_strategy != WRITE_NORMAL &&
+            options->methods != uarray2_methods_plain) {
+            return fail(options, "-write-strategy %s needs -row-major or "
+                                 "-col-major",
+                        options->write_strategy == WRITE_GATHER ? "gather"
+                                                                : "stream");
+        }
+        if (options->memory_limit > 0) {
+            Orientation orientation = orientation_of(options->rotation,
+                                                     options->flip,
+                                                     options->transpose);
+            if (orientation != ORIENT_90 && orientation != ORIENT_270 &&
+                orientation != ORIENT_TRANSPOSE) {
+                return fail(options, "-memory-limit needs -rotate 90, "
+                                     "-rotate 270 or -transpose");
+            }
+            if (options->planar || options->scale > 1 ||
+                options->threads > 0 || options->cache_dir != NULL ||
+                options->out_format != OUT_PPM) {
+                return fail(options, "-memory-limit writes P6 and cannot "
+                                     "be combined with -planar, -scale, "
+                                     "-threads or -cache");
+            }
+            if (options->write_strategy != WRITE_NORMAL) {
+                return fail(options, "-memory-limit has its own write "
+                                     "strategy");
+            }
+        }
+        if (options->stream &&
+            (options->planar || options->scale > 1 ||
+             options->threads > 0 || options->cache_dir != NULL ||
+             options->memory_limit > 0 || options->update_name != NULL ||
+             options->write_strategy != WRITE_NORMAL ||
+             options->out_format != OUT_PPM)) {
+            return fail(options, "-stream writes P6 frames and cannot be "
+                                 "combined with -planar, -scale, -threads, "
+                                 "-cache, -memory-limit, -update or "
+                                 "-write-strategy");
+        }
+        if ((options->update_name != NULL) != (options->dirty_count > 0)) {
+            return fail(options, "-update and -dirty must be given together");
+        }
+        if (options->update_name != NULL &&
+            (options->planar || options->scale > 1 ||
+             options->threads > 0 || options->cache_dir != NULL ||
+             options->memory_limit > 0 ||
+             options->write_strategy != WRITE_NORMAL)) {
+            return fail(options, "-update cannot be combined with -planar, "
+                                 "-scale, -threads, -cache, -memory-limit "
+                                 "or -write-strategy");
+        }
+        if (options->emit_count > 0 &&
+            (options->rotation != 0 || options->flip != NULL ||
+             options->transpose || options->planar || options->scale > 1 ||
+             options->threads > 0 || options->cache_dir != NULL ||
+             options->memory_limit > 0 || options->update_name != NULL ||
+             options->stream || options->write_strategy != WRITE_NORMAL ||
+             options->out_format != OUT_PPM ||
+             options->output_name != NULL)) {
+            return fail(options, "-emit gives each output's orientation "
+                                 "and file, and takes only mapping, -time, "
+                                 "-trace and -io options");
+        }
+        if (options->pyramid_name != NULL &&
+            (options->cache_dir != NULL || options->memory_limit > 0 ||
+             options->update_name != NULL || options->stream ||
+             options->emit_count > 0)) {
+            return fail(options, "-pyramid cannot be combined with -cache, "
+                                 "-memory-limit, -update, -stream or "
+                                 "-emit");
+        }
+
+        /* -auto plans only the whole-image transform to P6 */
+        if (options->planar || options->scale > 1 ||
+            options->write_strategy != WRITE_NORMAL ||
+            options->memory_limit > 0 || options->stream ||
+            options->update_name != NULL || options->out_format != OUT_PPM ||
+            options->emit_count > 0) {
+            options->auto_plan = 0;
+        }
+        return 1;
+}
+
+/* Options_plan
+ * Purpose: Carry out -auto: choose the plan for transforming the image
+ *          with the cost model and set the suite, block shape, mapping
+ *          and thread count from it. Options_transform lays the image
+ *          out in the chosen suite. A thread count given with -threads
+ *          is kept
+ * Parameters: the parsed options and the image as read
+ * Returns: void
+ *
+ * Expected input: options accepted by Options_parse and an image read with
+ *                 options->methods
+ * Success output: none
+ * Failure output: none
+ */
+void Options_plan(Options *options, Pnm_ppm image)
+{
+        assert(options != NULL && image != NULL);
+        if (!options->auto_plan) {
+            return;
+        }
+
+        Plan plan = Costmodel_choose(orientation_of(options->rotation,
+                                                    options->flip,
+                                                    options->transpose),
+                                     image->width, image->height,
+                                     options->threads);
+        Costmodel_methods(plan, &options->methods, &options->map);
+        options->block_width = options->block_height = plan.blocksize;
+        options->threads = plan.threads;
+        options->plan = plan.name;
+}
+
+/* Options_transform
+ * Purpose: Run the transform stage selected by the options
+ * Parameters: the parsed options, the image read with options->methods,
+ *             and where to store the CPU time of the transform
+ * Returns: the transformed image
+ *
+ * Expected input: options accepted by Options_parse
+ * Success output: none
+ * Failure output: CREs from the transform functions
+ */
+Pnm_ppm Options_transform(Options *options, Pnm_ppm image,
+                          double *time_used)
+{
+        assert(options != NULL && image != NULL && time_used != NULL);
+        CPUTime_T timer = CPUTime_New();
+
+        if (options->planar) {
+            Planar_T planes = Planar_from_ppm(&image);
+
+            CPUTime_Start(timer);
+            Planar_transform(planes, options->rotation, options->flip,
+                             options->transpose, options->map);
+            *time_used = CPUTime_Stop(timer);
+
+            image = Planar_to_ppm(&planes);
+        } else {
+            CPUTime_Start(timer);
+            /* the relayout into the suite -auto chose is part of what
+             * the plan costs, so it is timed with the transform
+             */
+            A2_relayout_ppm(image, options->methods, options->block_width,
+                            options->block_height);
+            if (options->scale > 1) {
+                image = scale_transform(image, options->rotation,
+                                        options->flip, options->transpose,
+                                        options->scale, options->methods,
+                                        options->map);
+            } else if (options->write_strategy != WRITE_NORMAL) {
+                image = transform_streaming(image,
+                            orientation_of(options->rotation, options->flip,
+                                           options->transpose),
+                            options->methods, options->prefetch,
+                            options->write_strategy == WRITE_STREAM);
+            } else if (options->threads > 0) {
+                image = transform_parallel(image,
+                            orientation_of(options->rotation, options->flip,
+                                           options->transpose),
+                            options->methods, options->threads);
+            } else {
+                image = transform(image, options->rotation, options->flip,
+                                  options->transpose, options->methods,
+                                  options->map);
+            }
+            *time_used = CPUTime_Stop(timer);
+        }
+
+        CPUTime_Free(&timer);
+        return image;
+}
+
+/* Options_spec
+ * Purpose: Name the output the options select for the result cache. The
+ *          mapping, suite, -planar and -threads give identical bytes, so
+ *          only the orientation, scale and output format are named, with
+ *          the block shape of a tiled output
+ * Parameters: the parsed options and where to write the name
+ * Returns: void
+ *
+ * Expected input: options accepted by Options_parse and room for at least
+ *                 32 characters
+ * Success output: none
+ * Failure output: none
+ */
+void Options_spec(Options *options, char *spec, size_t size)
+{
+        assert(options != NULL && spec != NULL);
+
+        Orientation orientation = orientation_of(options->rotation,
+                                                 options->flip,
+                                                 options->transpose);
+        if (options->out_format == OUT_TILED && options->block_width != 0) {
+            snprintf(spec, size, "o%d-s%d-b%dx%d.tiled", (int)orientation,
+                     options->scale, options->block_width,
+                     options->block_height);
+        } else {
+            snprintf(spec, size, "o%d-s%d.%s", (int)orientation,
+                     options->scale,
+                     options->out_format == OUT_TILED ? "tiled" : "ppm");
+        }
+}
+
+/* Options_write
+ * Purpose: Write an image in the output format selected by the options
+ * Parameters: the parsed options, a file pointer to write to and the image
+ * Returns: void
+ *
+ * Expected input: options accepted by Options_parse and an image read by
+ *                 Ppmio_read or transformed from one
+ * Success output: the image as P6 or in the tiled format
+ * Failure output: CREs from the writers
+ */
+void Options_write(Options *options, FILE *fp, Pnm_ppm image)
+{
+        assert(options != NULL && fp != NULL && image != NULL);
+
+        if (options->out_format == OUT_TILED) {
+            Tiled_write(fp, image);
+        } else {
+            Ppmio_write(fp, image);
+        }
+}
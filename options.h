@@ -0,0 +1,115 @@
+/**************************************************************
+ *
+ *                     options.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The ppmtrans options interface. Parsing reports errors in
+ *     the Options record instead of exiting, so the same options
+ *     can come from the command line or from a request sent to
+ *     the ppmtrans server.
+ *
+ **************************************************************/
+
+#ifndef __OPTIONS__
+#define __OPTIONS__
+
+#include <stdio.h>
+
+#include "a2methods.h"
+#include "pnm.h"
+#include "transform.h"
+#include "ppmio.h"
+
+/* most dirty rectangles one update can be given */
+#define MAX_DIRTY 64
+
+/* most outputs one run can -emit: every orientation once */
+#define MAX_EMITS 8
+
+/* one -emit output: an orientation of the input and its file */
+typedef struct Emit {
+        Orientation orientation;
+        char *file_name;
+} Emit;
+
+/* how transform output is written: by the mapping (normal), or row by
+ * row from a gathered buffer with cached or non-temporal stores
+ */
+typedef enum WriteStrategy {
+        WRITE_NORMAL, WRITE_GATHER, WRITE_STREAM
+} WriteStrategy;
+
+/* formats an output image can be written in */
+typedef enum OutFormat { OUT_PPM, OUT_TILED } OutFormat;
+
+typedef struct Options {
+        A2Methods_T methods;
+        A2Methods_mapfun *map;
+        int tile;               /* -tiled-major tile size, 0 for default */
+        int block_width;        /* block shape from -block-major=WxH or */
+        int block_height;       /* -auto, 0 for the default blocks */
+        int rotation;
+        char *flip;
+        int transpose;
+        int scale;
+        int planar;
+        int threads;
+        int auto_plan;          /* -auto: the cost model picks the above */
+        const char *plan;       /* the plan -auto chose, or NULL */
+        OutFormat out_format;
+        char *cache_dir;        /* NULL for no result cache */
+        int cache_max;          /* result cache size cap in megabytes */
+        size_t memory_limit;    /* 0, or the out-of-core pixel budget */
+        WriteStrategy write_strategy;
+        int prefetch;           /* source prefetch distance in pixels */
+        Ppmio_IO io;            /* how P6 files are read and written */
+        int stream;             /* transform a sequence of P6 frames */
+        char *update_name;      /* NULL, or the output to bring up to date */
+        Rect dirty[MAX_DIRTY];  /* edited source rectangles for -update */
+        int dirty_count;
+        Emit emits[MAX_EMITS];  /* the -emit outputs, from one read */
+        int emit_count;
+        char *pyramid_name;     /* NULL, or the -pyramid output prefix */
+        char *time_file_name;
+        char *trace_file_name;  /* NULL, or where -trace writes events */
+        char *filename;         /* NULL for standard input */
+        char *output_name;      /* NULL for standard output */
+        char error[128];        /* why Options_parse failed */
+} Options;
+
+/* Fill in the defaults: no transform, plain methods, default map, and
+ * -auto only if a cost profile has been calibrated on this machine
+ */
+void Options_init(Options *options);
+
+/* Parse argv[1] .. argv[argc - 1]; the strings are not copied. Returns 1
+ * on success, or 0 with a message in options->error
+ */
+int Options_parse(Options *options, int argc, char *argv[]);
+
+/* With -auto, choose the suite, block shape, mapping and thread count for
+ * transforming 'image'; otherwise do nothing
+ */
+void Options_plan(Options *options, Pnm_ppm image);
+
+/* Apply the transform the options describe, freeing the input image as
+ * transform does. The image is first laid out in the options' suite if
+ * -auto chose another. *time_used is set to the CPU time taken in
+ * nanoseconds, that relayout included
+ */
+Pnm_ppm Options_transform(Options *options, Pnm_ppm image,
+                          double *time_used);
+
+/* Write into 'spec' a name for the output the options select, which is
+ * the same for every option set producing the same bytes from an input
+ */
+void Options_spec(Options *options, char *spec, size_t size);
+
+/* Write the image in the output format the options select */
+void Options_write(Options *options, FILE *fp, Pnm_ppm image);
+
+#endif /* __OPTIONS__ */
@@ -0,0 +1,232 @@
+/**************************************************************
+ *
+ *                     outcore.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the external-memory transform. Pixels
+ *     are moved as raw P6 bytes (3 or 6 per pixel), so they are
+ *     never unpacked and the output is byte-for-byte what the
+ *     in-memory transform writes.
+ *
+ *     Note
+ *     Because output columns depend only on the input row for
+ *     these orientations, a band of input rows lands in one
+ *     contiguous range of output columns in every output row.
+ *     A run stores that range for output row 0, then for output
+ *     row 1, and so on, so any group of consecutive output rows
+ *     is one contiguous stretch of every run.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "assert.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "outcore.h"
+
+/* Run describes one rotated band in the scratch file */
+typedef struct Run {
+        off_t offset;           /* where the run starts */
+        unsigned first_col;     /* leftmost output column it covers */
+        unsigned count;         /* input rows in the band = columns */
+} Run;
+
+static FILE *open_scratch(void);
+static void rotate_band(Orientation orientation, unsigned width,
+                        unsigned height, size_t bpp, unsigned first_row,
+                        const unsigned char *band, Run *run,
+                        unsigned char *tiles);
+
+/* copy_pixel
+ *    Purpose: copy one raw P6 pixel, with a constant size the compiler
+ *             can inline for both depths
+ */
+static inline void copy_pixel(unsigned char *dst, const unsigned char *src,
+                              size_t bpp)
+{
+        if (bpp == 3) {
+                memcpy(dst, src, 3);
+        } else {
+                memcpy(dst, src, 6);
+        }
+}
+
+/* Outcore_transform
+ * Purpose: Transform a P6 image between streams in bounded memory
+ * Parameters: the input and output streams, the orientation, the memory
+ *             budget for pixel buffers in bytes, and where to store the
+ *             output width and height
+ * Returns: void
+ *
+ * Expected input: an input stream at the start of a P6 image and an
+ *                 orientation of ORIENT_90, ORIENT_270 or ORIENT_TRANSPOSE
+ * Success output: the transformed image as P6 on 'output'
+ * Failure output: Pnm_Badformat if the input is not a complete P6 image;
+ *                 CRE if the scratch file cannot be created
+ */
+void Outcore_transform(FILE *input, FILE *output, Orientation orientation,
+                       size_t memory_limit, unsigned *width,
+                       unsigned *height)
+{
+        assert(input != NULL && output != NULL);
+        assert(width != NULL && height != NULL);
+        assert(orientation == ORIENT_90 || orientation == ORIENT_270 ||
+               orientation == ORIENT_TRANSPOSE);
+
+        unsigned w, h, maxval;
+        if (!Ppmio_read_header(input, &w, &h, &maxval)) {
+                RAISE(Pnm_Badformat);
+        }
+        size_t bpp = maxval > 255 ? 6 : 3;
+        size_t in_row = w * bpp;
+        size_t out_row = h * bpp;
+
+        /* pass 1 holds a band and its rotated copy */
+        size_t band_rows = memory_limit / (2 * in_row);
+        if (band_rows < 1) {
+                band_rows = 1;
+        } else if (band_rows > h) {
+                band_rows = h;
+        }
+        size_t num_runs = (h + band_rows - 1) / band_rows;
+
+        Run *runs = malloc(num_runs * sizeof(Run));
+        unsigned char *band = malloc(band_rows * in_row);
+        unsigned char *tiles = malloc(band_rows * in_row);
+        assert(runs != NULL && band != NULL && tiles != NULL);
+        FILE *scratch = open_scratch();
+
+        off_t offset = 0;
+        for (size_t k = 0; k < num_runs; k++) {
+                unsigned first_row = k * band_rows;
+                unsigned count = h - first_row < band_rows ? h - first_row
+                                                           : band_rows;
+                if (fread(band, in_row, count, input) != count) {
+                        free(runs);
+                        free(band);
+                        free(tiles);
+                        fclose(scratch);
+                        RAISE(Pnm_Badformat);
+                }
+                runs[k].offset = offset;
+                runs[k].count = count;
+                rotate_band(orientation, w, h, bpp, first_row, band,
+                            &runs[k], tiles);
+                size_t written = fwrite(tiles, in_row, count, scratch);
+                assert(written == count);
+                offset += (off_t)count * in_row;
+        }
+        free(band);
+        free(tiles);
+
+        /* pass 2 holds a group of output rows and one run's share of it */
+        size_t group_rows = memory_limit / (out_row + band_rows * bpp);
+        if (group_rows < 1) {
+                group_rows = 1;
+        } else if (group_rows > w) {
+                group_rows = w;
+        }
+        unsigned char *rows = malloc(group_rows * out_row);
+        unsigned char *segments = malloc(group_rows * band_rows * bpp);
+        assert(rows != NULL && segments != NULL);
+
+        fprintf(output, "P6\n%u %u\n%u\n", h, w, maxval);
+        for (unsigned r0 = 0; r0 < w; r0 += group_rows) {
+                unsigned n = w - r0 < group_rows ? w - r0 : group_rows;
+                for (size_t k = 0; k < num_runs; k++) {
+                        size_t segment = runs[k].count * bpp;
+                        int ok = fseeko(scratch, runs[k].offset
+                                        + (off_t)r0 * segment, SEEK_SET) == 0
+                              && fread(segments, segment, n, scratch) == n;
+                        assert(ok);
+                        for (unsigned q = 0; q < n; q++) {
+                                memcpy(rows + q * out_row
+                                            + runs[k].first_col * bpp,
+                                       segments + q * segment, segment);
+                        }
+                }
+                fwrite(rows, out_row, n, output);
+        }
+
+        free(rows);
+        free(segments);
+        free(runs);
+        fclose(scratch);
+        *width = h;
+        *height = w;
+}
+
+/* open_scratch
+ *    Purpose: create an anonymous scratch file in $TMPDIR (or /tmp); it
+ *             is unlinked at once, so it goes away when it is closed
+ *    Returns: the file, open for reading and writing
+ */
+static FILE *open_scratch(void)
+{
+        const char *dir = getenv("TMPDIR");
+        if (dir == NULL || *dir == '\0') {
+                dir = "/tmp";
+        }
+        size_t length = strlen(dir) + sizeof("/ppmtrans.XXXXXX");
+        char *name = malloc(length);
+        assert(name != NULL);
+        snprintf(name, length, "%s/ppmtrans.XXXXXX", dir);
+
+        int fd = mkstemp(name);
+        assert(fd >= 0);
+        unlink(name);
+        free(name);
+
+        FILE *scratch = fdopen(fd, "w+");
+        assert(scratch != NULL);
+        return scratch;
+}
+
+/* rotate_band
+ *    Purpose: lay out a band of input rows as a run: for each output row
+ *             in order, the band's pixels in output column order. The
+ *             source of each output row comes from source_coords, so the
+ *             orientation math is the same as the in-memory transform's
+ */
+static void rotate_band(Orientation orientation, unsigned width,
+                        unsigned height, size_t bpp, unsigned first_row,
+                        const unsigned char *band, Run *run,
+                        unsigned char *tiles)
+{
+        unsigned count = run->count;
+        int first_col, last_col, unused;
+        orient_coords(orientation, 0, first_row, width, height,
+                      &first_col, &unused);
+        orient_coords(orientation, 0, first_row + count - 1, width, height,
+                      &last_col, &unused);
+
+        /* walking output columns left to right walks the band's rows up
+         * or down
+         */
+        int step = first_col <= last_col ? 1 : -1;
+        run->first_col = first_col <= last_col ? first_col : last_col;
+
+        for (unsigned r = 0; r < width; r++) {
+                int i, j;
+                source_coords(orientation, run->first_col, r, width, height,
+                              &i, &j);
+                const unsigned char *src = band
+                        + (size_t)(j - first_row) * width * bpp + i * bpp;
+                long stride = step * (long)(width * bpp);
+                unsigned char *dst = tiles + (size_t)r * count * bpp;
+                for (unsigned k = 0; k < count; k++) {
+                        copy_pixel(dst, src, bpp);
+                        dst += bpp;
+                        src += stride;
+                }
+        }
+}
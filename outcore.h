@@ -0,0 +1,44 @@
+/**************************************************************
+ *
+ *                     outcore.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     An external-memory transform for P6 images too large to
+ *     hold in memory. It handles the orientations that exchange
+ *     width and height (90, 270 and transpose), where every
+ *     output row needs a pixel from every input row.
+ *
+ *     Pass 1 reads the input in bands of whole rows and writes
+ *     each band, already rotated, to a scratch file as a run of
+ *     short output-row segments. Pass 2 reads a group of output
+ *     rows' segments from each run, one contiguous read per run,
+ *     and writes the finished rows. The image is read, written
+ *     to scratch, read back and written once, all sequentially
+ *     or in long runs.
+ *
+ **************************************************************/
+
+#ifndef __OUTCORE__
+#define __OUTCORE__
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "transform.h"
+
+/* Transform the P6 image on 'input' to 'output', keeping the pixel
+ * buffers within 'memory_limit' bytes (at least one input and output row
+ * are always held). The scratch file is created in $TMPDIR, or /tmp.
+ * The output size is stored in *width and *height. Raises Pnm_Badformat
+ * if the input is not a complete P6 image; it is a CRE to pass an
+ * orientation that does not exchange width and height
+ */
+void Outcore_transform(FILE *input, FILE *output, Orientation orientation,
+                       size_t memory_limit, unsigned *width,
+                       unsigned *height);
+
+#endif /* __OUTCORE__ */
@@ -0,0 +1,380 @@
+/**************************************************************
+ *
+ *                     planar.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the planar interface. Each plane is an
+ *     ordinary 2D array, so transforms reuse transform() on one
+ *     plane at a time: every pixel move copies 1 or 2 bytes
+ *     instead of a 12-byte Pnm_rgb, and an operation on a single
+ *     channel only walks that channel's plane. Planes with raw
+ *     storage (the plain suite) skip the suite's at entirely: the
+ *     split and merge walk a row of the image and a row of each
+ *     plane with unit stride, and the transform is the row gather
+ *     of transform_streaming.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "a2plain.h"
+#include "transform.h"
+#include "ppmio.h"
+#include "planar.h"
+
+/* PlaneData is the closure for moving samples between an interleaved
+ * image and its planes
+ */
+typedef struct PlaneData {
+        Planar_T planar;
+        int pixel_size;         /* element size of the interleaved image */
+        int sample_size;        /* element size of each plane */
+} PlaneData;
+
+static void apply_split(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl);
+static void apply_merge(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl);
+static void split_rows(PlaneData *plane_data, A2Methods_UArray2 pixels);
+static void merge_rows(PlaneData *plane_data, A2Methods_UArray2 pixels);
+
+/* get_channels
+ *    Purpose: read the three channels of an interleaved pixel of either
+ *             pixel type
+ */
+static inline void get_channels(const void *pixel, int pixel_size,
+                                unsigned channels[PLANE_COUNT])
+{
+        if (pixel_size == sizeof(struct Pnm_rgb16)) {
+                const struct Pnm_rgb16 *p = pixel;
+                channels[PLANE_RED] = p->red;
+                channels[PLANE_GREEN] = p->green;
+                channels[PLANE_BLUE] = p->blue;
+        } else {
+                const struct Pnm_rgb *p = pixel;
+                channels[PLANE_RED] = p->red;
+                channels[PLANE_GREEN] = p->green;
+                channels[PLANE_BLUE] = p->blue;
+        }
+}
+
+/* set_channels
+ *    Purpose: write the three channels of an interleaved pixel of either
+ *             pixel type
+ */
+static inline void set_channels(void *pixel, int pixel_size,
+                                const unsigned channels[PLANE_COUNT])
+{
+        if (pixel_size == sizeof(struct Pnm_rgb16)) {
+                Pnm_rgb16 p = pixel;
+                p->red = channels[PLANE_RED];
+                p->green = channels[PLANE_GREEN];
+                p->blue = channels[PLANE_BLUE];
+        } else {
+                Pnm_rgb p = pixel;
+                p->red = channels[PLANE_RED];
+                p->green = channels[PLANE_GREEN];
+                p->blue = channels[PLANE_BLUE];
+        }
+}
+
+static inline unsigned get_sample(const void *ptr, int sample_size)
+{
+        return sample_size == 1 ? *(const uint8_t *)ptr
+                                : *(const uint16_t *)ptr;
+}
+
+static inline void set_sample(void *ptr, int sample_size, unsigned value)
+{
+        if (sample_size == 1) {
+                *(uint8_t *)ptr = value;
+        } else {
+                *(uint16_t *)ptr = value;
+        }
+}
+
+/* Planar_from_ppm
+ * Purpose: Split an interleaved image into three planes
+ * Parameters: a pointer to the Pnm_ppm to split
+ * Returns: the planar image
+ *
+ * Expected input: an image read by Ppmio_read (either pixel type)
+ * Success output: none; *ppmp is freed and set to NULL
+ * Failure output: CRE if ppmp or *ppmp is NULL
+ */
+Planar_T Planar_from_ppm(Pnm_ppm *ppmp)
+{
+        assert(ppmp != NULL && *ppmp != NULL);
+        Pnm_ppm ppm = *ppmp;
+        A2Methods_T methods = (A2Methods_T)ppm->methods;
+
+        Planar_T planar;
+        NEW(planar);
+        planar->width = ppm->width;
+        planar->height = ppm->height;
+        planar->denominator = ppm->denominator;
+        planar->methods = methods;
+
+        PlaneData plane_data = { planar, methods->size(ppm->pixels),
+                                 ppm->denominator > 255 ? 2 : 1 };
+        for (int k = 0; k < PLANE_COUNT; k++) {
+                planar->planes[k] = methods->new(ppm->width, ppm->height,
+                                                 plane_data.sample_size);
+        }
+
+        if (methods->data(ppm->pixels) != NULL) {
+                split_rows(&plane_data, ppm->pixels);
+        } else {
+                methods->map_default(ppm->pixels, apply_split, &plane_data);
+        }
+
+        Pnm_ppmfree(ppmp);
+        return planar;
+}
+
+/* Planar_to_ppm
+ * Purpose: Interleave the planes back into an image
+ * Parameters: a pointer to the planar image
+ * Returns: the image, with Pnm_rgb16 pixels if the maxval is above 255
+ *          and Pnm_rgb pixels otherwise
+ *
+ * Expected input: a planar image from Planar_from_ppm
+ * Success output: none; *planarp is freed and set to NULL
+ * Failure output: CRE if planarp or *planarp is NULL
+ */
+Pnm_ppm Planar_to_ppm(Planar_T *planarp)
+{
+        assert(planarp != NULL && *planarp != NULL);
+        Planar_T planar = *planarp;
+        A2Methods_T methods = planar->methods;
+        int sample_size = methods->size(planar->planes[PLANE_RED]);
+
+        Pnm_ppm ppm;
+        NEW(ppm);
+        ppm->width = planar->width;
+        ppm->height = planar->height;
+        ppm->denominator = planar->denominator;
+        ppm->methods = methods;
+        ppm->pixels = methods->new(planar->width, planar->height,
+                                   sample_size == 1 ? sizeof(struct Pnm_rgb)
+                                                : sizeof(struct Pnm_rgb16));
+
+        PlaneData plane_data = { planar, methods->size(ppm->pixels),
+                                 sample_size };
+        if (methods->data(ppm->pixels) != NULL) {
+                merge_rows(&plane_data, ppm->pixels);
+        } else {
+                methods->map_default(ppm->pixels, apply_merge, &plane_data);
+        }
+
+        Planar_free(planarp);
+        return ppm;
+}
+
+/* Planar_transform
+ * Purpose: Apply one transform to all three planes
+ * Parameters: the planar image, the rotation degree, flip type and
+ *             transpose flag as for transform, and the mapping function
+ * Returns: void
+ *
+ * Expected input: the same as transform
+ * Success output: none; the planes and dimensions are updated in place
+ * Failure output: CRE if planar is NULL
+ */
+void Planar_transform(Planar_T planar, int degrees, char *flip,
+                      int do_transpose, A2Methods_mapfun *map)
+{
+        assert(planar != NULL);
+        unsigned width = planar->width;
+        unsigned height = planar->height;
+        Orientation orientation = orientation_of(degrees, flip,
+                                                 do_transpose);
+        int raw = planar->methods == uarray2_methods_plain;
+        if (orientation == ORIENT_0) {
+                return;
+        }
+
+        for (int k = 0; k < PLANE_COUNT; k++) {
+                struct Pnm_ppm plane = { width, height,
+                                         planar->denominator,
+                                         planar->planes[k],
+                                         planar->methods };
+                if (raw) {
+                        transform_streaming(&plane, orientation,
+                                            planar->methods, 0, 0);
+                } else {
+                        transform(&plane, degrees, flip, do_transpose,
+                                  planar->methods, map);
+                }
+                planar->planes[k] = plane.pixels;
+                planar->width = plane.width;
+                planar->height = plane.height;
+        }
+}
+
+/* Planar_free
+ * Purpose: Free a planar image and its planes
+ * Parameters: a pointer to the planar image
+ * Returns: void
+ *
+ * Expected input: a planar image from Planar_from_ppm
+ * Success output: none; *planarp is freed and set to NULL
+ * Failure output: CRE if planarp or *planarp is NULL
+ */
+void Planar_free(Planar_T *planarp)
+{
+        assert(planarp != NULL && *planarp != NULL);
+
+        for (int k = 0; k < PLANE_COUNT; k++) {
+                (*planarp)->methods->free(&(*planarp)->planes[k]);
+        }
+        FREE(*planarp);
+}
+
+/* apply_split
+ *    Purpose: apply function over the interleaved image that stores each
+ *             channel of the pixel in its plane
+ */
+static void apply_split(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl)
+{
+        (void)array2;
+        PlaneData *plane_data = cl;
+        Planar_T planar = plane_data->planar;
+        unsigned channels[PLANE_COUNT];
+
+        get_channels(ptr, plane_data->pixel_size, channels);
+        for (int k = 0; k < PLANE_COUNT; k++) {
+                set_sample(planar->methods->at(planar->planes[k], i, j),
+                           plane_data->sample_size, channels[k]);
+        }
+}
+
+/* apply_merge
+ *    Purpose: apply function over the interleaved image that gathers the
+ *             pixel's channels from the three planes
+ */
+static void apply_merge(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl)
+{
+        (void)array2;
+        PlaneData *plane_data = cl;
+        Planar_T planar = plane_data->planar;
+        unsigned channels[PLANE_COUNT];
+
+        for (int k = 0; k < PLANE_COUNT; k++) {
+                channels[k] = get_sample(planar->methods->at(
+                                                 planar->planes[k], i, j),
+                                         plane_data->sample_size);
+        }
+        set_channels(ptr, plane_data->pixel_size, channels);
+}
+
+/* split_rows
+ *    Purpose: split an image with raw storage a row at a time, reading the
+ *             row of pixels and writing each plane's row in order
+ */
+static void split_rows(PlaneData *plane_data, A2Methods_UArray2 pixels)
+{
+        Planar_T planar = plane_data->planar;
+        A2Methods_T methods = planar->methods;
+        int pixel_size = plane_data->pixel_size;
+        int sample_size = plane_data->sample_size;
+        const char *src = methods->data(pixels);
+        int src_stride = methods->stride(pixels);
+        char *dst[PLANE_COUNT];
+        int dst_stride[PLANE_COUNT];
+        for (int k = 0; k < PLANE_COUNT; k++) {
+                dst[k] = methods->data(planar->planes[k]);
+                dst_stride[k] = methods->stride(planar->planes[k]);
+        }
+
+        for (unsigned j = 0; j < planar->height; j++) {
+                const char *in = src + (size_t)j * src_stride;
+                if (pixel_size == sizeof(struct Pnm_rgb) &&
+                    sample_size == 1) {
+                        const struct Pnm_rgb *p = (const void *)in;
+                        uint8_t *r = (uint8_t *)(dst[PLANE_RED]
+                                     + (size_t)j * dst_stride[PLANE_RED]);
+                        uint8_t *g = (uint8_t *)(dst[PLANE_GREEN]
+                                     + (size_t)j * dst_stride[PLANE_GREEN]);
+                        uint8_t *b = (uint8_t *)(dst[PLANE_BLUE]
+                                     + (size_t)j * dst_stride[PLANE_BLUE]);
+                        for (unsigned i = 0; i < planar->width; i++) {
+                                r[i] = p[i].red;
+                                g[i] = p[i].green;
+                                b[i] = p[i].blue;
+                        }
+                        continue;
+                }
+                for (unsigned i = 0; i < planar->width; i++) {
+                        unsigned channels[PLANE_COUNT];
+                        get_channels(in + (size_t)i * pixel_size,
+                                     pixel_size, channels);
+                        for (int k = 0; k < PLANE_COUNT; k++) {
+                                set_sample(dst[k] + (size_t)j * dst_stride[k]
+                                           + (size_t)i * sample_size,
+                                           sample_size, channels[k]);
+                        }
+                }
+        }
+}
+
+/* merge_rows
+ *    Purpose: interleave planes with raw storage a row at a time, reading
+ *             each plane's row and writing the row of pixels in order
+ */
+static void merge_rows(PlaneData *plane_data, A2Methods_UArray2 pixels)
+{
+        Planar_T planar = plane_data->planar;
+        A2Methods_T methods = planar->methods;
+        int pixel_size = plane_data->pixel_size;
+        int sample_size = plane_data->sample_size;
+        char *dst = methods->data(pixels);
+        int dst_stride = methods->stride(pixels);
+        const char *src[PLANE_COUNT];
+        int src_stride[PLANE_COUNT];
+        for (int k = 0; k < PLANE_COUNT; k++) {
+                src[k] = methods->data(planar->planes[k]);
+                src_stride[k] = methods->stride(planar->planes[k]);
+        }
+
+        for (unsigned j = 0; j < planar->height; j++) {
+                char *out = dst + (size_t)j * dst_stride;
+                if (pixel_size == sizeof(struct Pnm_rgb) &&
+                    sample_size == 1) {
+                        struct Pnm_rgb *p = (void *)out;
+                        const uint8_t *r = (const uint8_t *)(src[PLANE_RED]
+                                     + (size_t)j * src_stride[PLANE_RED]);
+                        const uint8_t *g = (const uint8_t *)(src[PLANE_GREEN]
+                                     + (size_t)j * src_stride[PLANE_GREEN]);
+                        const uint8_t *b = (const uint8_t *)(src[PLANE_BLUE]
+                                     + (size_t)j * src_stride[PLANE_BLUE]);
+                        for (unsigned i = 0; i < planar->width; i++) {
+                                p[i].red = r[i];
+                                p[i].green = g[i];
+                                p[i].blue = b[i];
+                        }
+                        continue;
+                }
+                for (unsigned i = 0; i < planar->width; i++) {
+                        unsigned channels[PLANE_COUNT];
+                        for (int k = 0; k < PLANE_COUNT; k++) {
+                                channels[k] = get_sample(
+                                        src[k] + (size_t)j * src_stride[k]
+                                        + (size_t)i * sample_size,
+                                        sample_size);
+                        }
+                        set_channels(out + (size_t)i * pixel_size,
+                                     pixel_size, channels);
+                }
+        }
+}
@@ -0,0 +1,45 @@
+/**************************************************************
+ *
+ *                     planar.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The planar image interface. A planar image keeps the red,
+ *     green and blue channels in three separate 2D arrays from
+ *     the same methods suite, one sample per cell: 1 byte per
+ *     sample when the maxval fits in 8 bits and 2 bytes otherwise.
+ *
+ **************************************************************/
+
+#ifndef __PLANAR__
+#define __PLANAR__
+
+#include "a2methods.h"
+#include "pnm.h"
+
+typedef struct Planar_T *Planar_T;
+
+enum { PLANE_RED, PLANE_GREEN, PLANE_BLUE, PLANE_COUNT };
+
+struct Planar_T {
+        unsigned width, height, denominator;
+        A2Methods_UArray2 planes[PLANE_COUNT];
+        A2Methods_T methods;
+};
+
+/* Split an image into planes of the same suite and free the image */
+Planar_T Planar_from_ppm(Pnm_ppm *ppmp);
+
+/* Interleave the planes into a new image and free the planar image */
+Pnm_ppm Planar_to_ppm(Planar_T *planarp);
+
+/* Run the same transform over every plane */
+void Planar_transform(Planar_T planar, int degrees, char *flip,
+                      int transpose, A2Methods_mapfun *map);
+
+void Planar_free(Planar_T *planarp);
+
+#endif /* __PLANAR__ */
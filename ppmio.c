@@ -0,0 +1,946 @@
+/**************************************************************
+ *
+ *                     ppmio.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the ppmio interface. The header is parsed
+ *     here so 16-bit P6 images can take a fast path: the whole
+ *     raster is read with one fread, byte swapped in bulk, and
+ *     copied into 6-byte pixels. For any other image the bytes
+ *     already consumed are replayed in front of the stream and
+ *     Pnm_ppmread does the work as before. Tiled images are
+ *     recognized by their magic number and handed to tiled.c.
+ *
+ *     P6 is row-major, so blocked images are read into a plain
+ *     array and relaid out in bulk rather than paying the blocked
+ *     'at' for every pixel. They are written without a copy: each
+ *     row is encoded one block-wide run of cells at a time.
+ *
+ *     Unless -io stdio is asked for, P6 rasters are converted
+ *     here rather than by the Pnm library: rows of 8-bit samples
+ *     widen to Pnm_rgb channels (and narrow back) with SSE2, rows
+ *     of 16-bit samples are byte swapped in bulk, and large bands
+ *     are split among threads by rows. Files with offsets go
+ *     through asyncio: the raster is read many chunks ahead and
+ *     decoded a group of rows at a time as the chunks arrive, and
+ *     each encoded group is queued while the next is encoded.
+ *     Other streams are read with one fread and written with one
+ *     writev of the header and the whole raster.
+ *
+ **************************************************************/
+
+#define _GNU_SOURCE     /* fopencookie */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include "assert.h"
+#include "except.h"
+#include "mem.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "relayout.h"
+#include "uarray2b.h"
+#include "asyncio.h"
+#include "ppmio.h"
+#include "tiled.h"
+#include "trace.h"
+
+#define HEADER_MAX 1024
+#define GROUP_BYTES (8 << 20)   /* raster bytes read or written at once */
+#define PARALLEL_BYTES (1 << 20) /* smaller bands convert on one thread */
+#define MAX_THREADS 8
+
+/* io_mode is how P6 images on files with offsets are read and written */
+static Ppmio_IO io_mode = PPMIO_ASYNC;
+
+/* the CII exception stack is shared by all threads, so only one thread
+ * at a time may be inside the TRY around Pnm_ppmread
+ */
+static pthread_mutex_t pnm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Header holds the parsed P6 header along with every byte that was
+ * consumed to parse it, so the bytes can be handed back to Pnm_ppmread
+ */
+typedef struct Header {
+        char bytes[HEADER_MAX];
+        size_t length;
+        unsigned width, height, maxval;
+        int is_p6;
+} Header;
+
+/* Replay is the cookie for a stream that returns the saved header
+ * bytes first and then the rest of the original stream
+ */
+typedef struct Replay {
+        Header *header;
+        size_t pos;
+        FILE *fp;
+} Replay;
+
+/* Band is a slice of rows converted by one thread, and its raster */
+typedef struct Band {
+        Pnm_ppm pixmap;
+        unsigned char *raster;  /* row j0 of the band */
+        unsigned j0, rows;
+        int wide;               /* Pnm_rgb16 pixels and 16-bit samples */
+        int decode;             /* raster to pixels, or back */
+        pthread_t thread;
+} Band;
+
+/* RasterData is the closure for copying between a row-major raster
+ * buffer and a 2D array of pixels
+ */
+typedef struct RasterData {
+        unsigned char *raster;
+        unsigned width;
+        int to_array;
+} RasterData;
+
+static ssize_t replay_read(void *cookie, char *buf, size_t size);
+static int read_header(FILE *fp, Header *header);
+static Pnm_ppm read16(FILE *fp, Header *header, A2Methods_T methods);
+static Pnm_ppm read_async(FILE *fp, Header *header, A2Methods_T methods);
+static Pnm_ppm read_stream(FILE *fp, Header *header, A2Methods_T methods);
+static int write_async(FILE *fp, Pnm_ppm pixmap, int wide,
+                       const char *header, int header_bytes);
+static int write_vector(FILE *fp, Pnm_ppm pixmap, int wide,
+                        const char *header, int header_bytes);
+static void mark_failed(FILE *fp);
+static int write_fast(FILE *fp, Pnm_ppm pixmap, int wide);
+static void write16(FILE *fp, Pnm_ppm pixmap);
+static void copy_raster(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl);
+static void convert(Pnm_ppm pixmap, unsigned char *raster, unsigned j0,
+                    unsigned rows, int wide, int decode);
+
+/* Ppmio_read
+ * Purpose: Read a PPM or tiled image, storing 16-bit images compactly
+ * Parameters: a file pointer to read from and the methods suite that
+ *             should hold the pixels
+ * Returns: the image as a Pnm_ppm
+ *
+ * Expected input: an open stream positioned at the start of an image
+ * Success output: none
+ * Failure output: Pnm_Badformat is raised if the image is malformed or
+ *                 truncated
+ */
+Pnm_ppm Ppmio_read(FILE *fp, A2Methods_T methods)
+{
+        return Ppmio_read_shaped(fp, methods, 0, 0);
+}
+
+/* Ppmio_read_shaped
+ * Purpose: Read a PPM or tiled image into blocks of a given shape
+ * Parameters: a file pointer to read from, the methods suite that should
+ *             hold the pixels and the columns and rows of its blocks, or
+ *             0 and 0 for the default blocks
+ * Returns: the image as a Pnm_ppm
+ *
+ * Expected input: an open stream positioned at the start of an image
+ * Success output: none
+ * Failure output: Pnm_Badformat is raised if the image is malformed or
+ *                 truncated
+ */
+Pnm_ppm Ppmio_read_shaped(FILE *fp, A2Methods_T methods, int block_width,
+                          int block_height)
+{
+        Pnm_ppm pixmap = Ppmio_read_checked(fp, methods, block_width,
+                                            block_height);
+        if (pixmap == NULL) {
+                RAISE(Pnm_Badformat);
+        }
+        return pixmap;
+}
+
+/* Ppmio_read_checked
+ * Purpose: Read a PPM or tiled image like Ppmio_read_shaped, reporting a
+ *          bad image by its result instead of an exception
+ * Parameters: the same as Ppmio_read_shaped
+ * Returns: the image as a Pnm_ppm, or NULL if it is malformed or truncated
+ *
+ * Expected input: an open stream positioned at the start of an image
+ * Success output: none
+ * Failure output: NULL. P6 and tiled images are read without a TRY, so
+ *                 threads may read them at once; other formats go through
+ *                 Pnm_ppmread, whose TRY is taken one thread at a time
+ */
+Pnm_ppm Ppmio_read_checked(FILE *fp, A2Methods_T methods, int block_width,
+                           int block_height)
+{
+        assert(fp != NULL && methods != NULL);
+
+        Header header;
+        int is_header = read_header(fp, &header);
+        if (header.length == 2 && memcmp(header.bytes, TILED_MAGIC, 2) == 0) {
+                return Tiled_read(fp, header.bytes, header.length, methods,
+                                  block_width, block_height);
+        }
+
+        /* decode in stream order, then change layout in bulk */
+        A2Methods_T read_methods = A2_is_blocked(methods)
+                                   ? uarray2_methods_plain : methods;
+        Pnm_ppm pixmap;
+        if (is_header && header.is_p6 && io_mode != PPMIO_STDIO) {
+                pixmap = AsyncIO_usable(fileno(fp), 0)
+                         ? read_async(fp, &header, read_methods)
+                         : read_stream(fp, &header, read_methods);
+        } else if (is_header && header.is_p6 && header.maxval > 255) {
+                pixmap = read16(fp, &header, read_methods);
+        } else {
+                Replay replay = { &header, 0, fp };
+                cookie_io_functions_t io = { replay_read, NULL, NULL, NULL };
+                FILE *replay_fp = fopencookie(&replay, "r", io);
+                assert(replay_fp != NULL);
+
+                /* the cookie lives on this frame, so close the stream
+                 * even when Pnm_ppmread raises; anything but
+                 * Pnm_Badformat is raised again once the lock is free
+                 */
+                pthread_mutex_lock(&pnm_lock);
+                TRY
+                        pixmap = Pnm_ppmread(replay_fp, read_methods);
+                EXCEPT(Pnm_Badformat)
+                        pixmap = NULL;
+                FINALLY
+                        fclose(replay_fp);
+                        pthread_mutex_unlock(&pnm_lock);
+                END_TRY;
+        }
+        if (pixmap != NULL) {
+                A2_relayout_ppm(pixmap, methods, block_width, block_height);
+        }
+        return pixmap;
+}
+
+/* Ppmio_write
+ * Purpose: Write an image as P6, whichever pixel type it uses
+ * Parameters: a file pointer to write to and the image
+ * Returns: void
+ *
+ * Expected input: an image returned by Ppmio_read or transformed from one
+ * Success output: the image in P6 format
+ * Failure output: CRE if the element size is not a known pixel type; a
+ *                 message on stderr and ferror(fp) set if a write to a
+ *                 pipe or socket fails part way
+ */
+void Ppmio_write(FILE *fp, Pnm_ppm pixmap)
+{
+        assert(fp != NULL && pixmap != NULL);
+
+        /* blocked pixels are encoded straight from their blocks, a
+         * block-wide run of each row at a time
+         */
+        int size = pixmap->methods->size(pixmap->pixels);
+        int wide = size == sizeof(struct Pnm_rgb16);
+        int written = io_mode != PPMIO_STDIO &&
+                      (wide || (size == sizeof(struct Pnm_rgb) &&
+                                pixmap->denominator <= 255)) &&
+                      write_fast(fp, pixmap, wide);
+        if (!written && wide) {
+                write16(fp, pixmap);
+        } else if (!written) {
+                assert(size == sizeof(struct Pnm_rgb));
+                Pnm_ppmwrite(fp, pixmap);
+        }
+}
+
+/* Ppmio_decode_rows
+ * Purpose: Decode rows of a P6 raster held by the caller into an image
+ * Parameters: the image, the raster, and the first row and number of rows
+ *             it holds
+ * Returns: void
+ *
+ * Expected input: an image of Pnm_rgb or Pnm_rgb16 pixels, and a raster
+ *                 of 'rows' rows of the image's width with 8-bit or
+ *                 16-bit samples to match
+ * Success output: none
+ * Failure output: CRE if the element size is not a known pixel type or
+ *                 the rows are not in the image
+ */
+void Ppmio_decode_rows(Pnm_ppm pixmap, unsigned char *raster, unsigned j0,
+                       unsigned rows)
+{
+        assert(pixmap != NULL && raster != NULL);
+        assert(j0 + rows <= pixmap->height);
+        int size = pixmap->methods->size(pixmap->pixels);
+        assert(size == sizeof(struct Pnm_rgb) ||
+               size == sizeof(struct Pnm_rgb16));
+        convert(pixmap, raster, j0, rows, size == sizeof(struct Pnm_rgb16),
+                1);
+}
+
+/* Ppmio_encode_rows
+ * Purpose: Encode rows of an image into a P6 raster held by the caller
+ * Parameters: the image, the raster, and the first row and number of rows
+ *             to encode
+ * Returns: void
+ *
+ * Expected input: as for Ppmio_decode_rows; 8-bit channels above 255
+ *                 saturate
+ * Success output: none
+ * Failure output: CRE if the element size is not a known pixel type or
+ *                 the rows are not in the image
+ */
+void Ppmio_encode_rows(Pnm_ppm pixmap, unsigned char *raster, unsigned j0,
+                       unsigned rows)
+{
+        assert(pixmap != NULL && raster != NULL);
+        assert(j0 + rows <= pixmap->height);
+        int size = pixmap->methods->size(pixmap->pixels);
+        assert(size == sizeof(struct Pnm_rgb) ||
+               size == sizeof(struct Pnm_rgb16));
+        convert(pixmap, raster, j0, rows, size == sizeof(struct Pnm_rgb16),
+                0);
+}
+
+/* Ppmio_set_io
+ * Purpose: Choose how P6 images on files with offsets are read and
+ *          written from now on, by every thread
+ * Parameters: PPMIO_STDIO, PPMIO_ASYNC (the default) or PPMIO_DIRECT
+ * Returns: void
+ *
+ * Expected input: one of the modes
+ * Success output: none
+ * Failure output: none
+ */
+void Ppmio_set_io(Ppmio_IO mode)
+{
+        io_mode = mode;
+}
+
+/* Ppmio_read_header
+ * Purpose: Parse a P6 header for readers that stream the raster
+ *          themselves
+ * Parameters: a file pointer and where to store the width, height and
+ *             maxval
+ * Returns: 1 on success and 0 if the header is not a valid P6 header
+ *
+ * Expected input: an open stream positioned at the start of an image
+ * Success output: none
+ * Failure output: none
+ */
+int Ppmio_read_header(FILE *fp, unsigned *width, unsigned *height,
+                      unsigned *maxval)
+{
+        assert(fp != NULL && width != NULL && height != NULL &&
+               maxval != NULL);
+
+        Header header;
+        if (!read_header(fp, &header) || header.width == 0 ||
+            header.height == 0 || header.maxval == 0 ||
+            header.maxval > 65535) {
+                return 0;
+        }
+        *width = header.width;
+        *height = header.height;
+        *maxval = header.maxval;
+        return 1;
+}
+
+/* Ppmio_swap16
+ * Purpose: Swap the bytes of n 16-bit samples in place, 16 bytes per
+ *          pshufb when SSSE3 is available
+ * Parameters: a pointer to the samples and how many there are
+ * Returns: void
+ *
+ * Expected input: non-null samples if n is not 0
+ * Success output: none
+ * Failure output: none
+ */
+void Ppmio_swap16(uint16_t *samples, size_t n)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        size_t k = 0;
+#ifdef __SSSE3__
+        const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                           9, 8, 11, 10, 13, 12, 15, 14);
+        for (; k + 8 <= n; k += 8) {
+                __m128i *p = (__m128i *)(samples + k);
+                _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p),
+                                                     swap));
+        }
+#endif
+        for (; k < n; k++) {
+                samples[k] = (uint16_t)(samples[k] << 8 | samples[k] >> 8);
+        }
+#else
+        (void)samples;
+        (void)n;
+#endif
+}
+
+/* replay_read
+ *    Purpose: fopencookie read function that returns the saved header
+ *             bytes and then reads through to the underlying stream
+ */
+static ssize_t replay_read(void *cookie, char *buf, size_t size)
+{
+        Replay *replay = cookie;
+        Header *header = replay->header;
+
+        if (replay->pos < header->length) {
+                size_t n = header->length - replay->pos;
+                if (n > size) {
+                        n = size;
+                }
+                memcpy(buf, header->bytes + replay->pos, n);
+                replay->pos += n;
+                return n;
+        }
+        return fread(buf, 1, size, replay->fp);
+}
+
+/* next_byte
+ *    Purpose: read one header byte, remembering it for replay
+ *    Returns: the byte, or EOF if the stream ended or the header is too
+ *             long to be a PPM header
+ */
+static int next_byte(FILE *fp, Header *header)
+{
+        if (header->length == HEADER_MAX) {
+                return EOF;
+        }
+        int c = getc(fp);
+        if (c != EOF) {
+                header->bytes[header->length++] = c;
+        }
+        return c;
+}
+
+/* read_number
+ *    Purpose: read one unsigned decimal header field, skipping whitespace
+ *             and comments in front of it. The single byte that ends the
+ *             number is consumed, as P6 requires after maxval
+ *    Returns: 1 on success and 0 if the field is not a number
+ */
+static int read_number(FILE *fp, Header *header, unsigned *n)
+{
+        int c = next_byte(fp, header);
+        while (c == '#' || isspace(c)) {
+                if (c == '#') {
+                        while (c != '\n' && c != EOF) {
+                                c = next_byte(fp, header);
+                        }
+                }
+                c = next_byte(fp, header);
+        }
+        if (!isdigit(c)) {
+                return 0;
+        }
+        *n = 0;
+        while (isdigit(c)) {
+                *n = *n * 10 + (c - '0');
+                c = next_byte(fp, header);
+        }
+        return 1;
+}
+
+/* read_header
+ *    Purpose: parse a PPM header, recording the bytes it consumed. It stops
+ *             after the magic number unless the image is P6
+ *    Returns: 1 if a complete P6 header was parsed and 0 otherwise
+ */
+static int read_header(FILE *fp, Header *header)
+{
+        header->length = 0;
+        header->is_p6 = 0;
+
+        int c1 = next_byte(fp, header);
+        int c2 = next_byte(fp, header);
+        if (c1 != 'P' || c2 != '6') {
+                return 0;
+        }
+        header->is_p6 = 1;
+        return read_number(fp, header, &header->width)
+            && read_number(fp, header, &header->height)
+            && read_number(fp, header, &header->maxval);
+}
+
+/* read16
+ *    Purpose: read the raster of a 16-bit P6 image into an array of
+ *             Pnm_rgb16 pixels
+ *    Returns: the image, or NULL if it is malformed or truncated
+ */
+static Pnm_ppm read16(FILE *fp, Header *header, A2Methods_T methods)
+{
+        if (header->width == 0 || header->height == 0 ||
+            header->maxval > 65535) {
+                return NULL;
+        }
+
+        size_t samples = (size_t)header->width * header->height * 3;
+        uint16_t *raster = malloc(samples * sizeof(uint16_t));
+        assert(raster != NULL);
+        if (fread(raster, sizeof(uint16_t), samples, fp) != samples) {
+                free(raster);
+                return NULL;
+        }
+        Ppmio_swap16(raster, samples);
+
+        Pnm_ppm pixmap;
+        NEW(pixmap);
+        pixmap->width = header->width;
+        pixmap->height = header->height;
+        pixmap->denominator = header->maxval;
+        pixmap->methods = methods;
+        pixmap->pixels = methods->new(header->width, header->height,
+                                      sizeof(struct Pnm_rgb16));
+
+        if (methods == uarray2_methods_plain) {
+                /* rows of a UArray2 are contiguous */
+                size_t row_bytes = header->width * sizeof(struct Pnm_rgb16);
+                for (unsigned j = 0; j < header->height; j++) {
+                        memcpy(methods->at(pixmap->pixels, 0, j),
+                               (char *)raster + j * row_bytes, row_bytes);
+                }
+        } else {
+                RasterData raster_data = { (unsigned char *)raster,
+                                           header->width, 1 };
+                methods->map_default(pixmap->pixels, copy_raster,
+                                     &raster_data);
+        }
+
+        free(raster);
+        return pixmap;
+}
+
+/* widen_samples
+ *    Purpose: expand n 8-bit samples to the unsigned channels of Pnm_rgb
+ *             pixels, 16 samples per step with SSE2
+ */
+static void widen_samples(const unsigned char *in, unsigned *out, size_t n)
+{
+        size_t k = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        for (; k + 16 <= n; k += 16) {
+                __m128i bytes = _mm_loadu_si128((const __m128i *)(in + k));
+                __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+                __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+                __m128i *dst = (__m128i *)(out + k);
+                _mm_storeu_si128(dst, _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(hi, zero));
+        }
+#endif
+        for (; k < n; k++) {
+                out[k] = in[k];
+        }
+}
+
+/* narrow_samples
+ *    Purpose: pack n Pnm_rgb channels into 8-bit samples, 16 channels
+ *             per step with SSE2. A channel above 255 saturates to 255
+ *             in every lane and in the scalar tail alike
+ */
+static void narrow_samples(const unsigned *in, unsigned char *out, size_t n)
+{
+        size_t k = 0;
+#ifdef __SSE2__
+        for (; k + 16 <= n; k += 16) {
+                const __m128i *src = (const __m128i *)(in + k);
+                __m128i lo = _mm_packs_epi32(_mm_loadu_si128(src),
+                                             _mm_loadu_si128(src + 1));
+                __m128i hi = _mm_packs_epi32(_mm_loadu_si128(src + 2),
+                                             _mm_loadu_si128(src + 3));
+                _mm_storeu_si128((__m128i *)(out + k),
+                                 _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; k < n; k++) {
+                out[k] = in[k] > 255 ? 255 : in[k];
+        }
+}
+
+/* convert_span
+ *    Purpose: decode 'samples' raster samples into consecutive cells, or
+ *             encode the cells into the raster
+ */
+static inline void convert_span(void *cells, unsigned char *raster,
+                                size_t samples, int wide, int decode)
+{
+        if (wide && decode) {
+                memcpy(cells, raster, samples * 2);
+                Ppmio_swap16(cells, samples);
+        } else if (wide) {
+                memcpy(raster, cells, samples * 2);
+                Ppmio_swap16((uint16_t *)raster, samples);
+        } else if (decode) {
+                widen_samples(raster, cells, samples);
+        } else {
+                narrow_samples(cells, raster, samples);
+        }
+}
+
+/* convert_rows
+ *    Purpose: decode 'rows' raster rows into the pixels of rows j0 on, or
+ *             encode those pixels into raster rows, for 8-bit samples
+ *             (Pnm_rgb) or 16-bit ones (Pnm_rgb16). The channels of a
+ *             pixel are in raster order, so a row of a suite with raw
+ *             access converts as one run of samples, and a row of a
+ *             blocked array as one run per block it crosses
+ */
+static void convert_rows(Band *band)
+{
+        uint64_t start = Trace_begin();
+        Pnm_ppm pixmap = band->pixmap;
+        const struct A2Methods_T *methods = pixmap->methods;
+        unsigned width = pixmap->width;
+        size_t samples = (size_t)width * 3;
+        size_t sample_bytes = band->wide ? 2 : 1;
+        size_t row_bytes = samples * sample_bytes;
+        char *data = methods->data(pixmap->pixels);
+        int stride = methods->stride(pixmap->pixels);
+        unsigned block_width = 1;
+        if (data == NULL && A2_is_blocked(methods)) {
+                block_width = UArray2b_block_width(pixmap->pixels);
+        }
+
+        for (unsigned r = 0; r < band->rows; r++) {
+                unsigned j = band->j0 + r;
+                unsigned char *raster = band->raster + r * row_bytes;
+                if (data != NULL) {
+                        convert_span(data + (size_t)j * stride, raster,
+                                     samples, band->wide, band->decode);
+                        continue;
+                }
+                for (unsigned i = 0; i < width; i += block_width) {
+                        unsigned cells = width - i < block_width
+                                         ? width - i : block_width;
+                        convert_span(methods->at(pixmap->pixels, i, j),
+                                     raster + i * 3 * sample_bytes,
+                                     (size_t)cells * 3, band->wide,
+                                     band->decode);
+                }
+        }
+        Trace_end(band->decode ? "decode" : "encode", start, band->j0);
+}
+
+/* convert_thread
+ *    Purpose: thread body for one slice of convert's rows
+ */
+static void *convert_thread(void *cl)
+{
+        convert_rows(cl);
+        return NULL;
+}
+
+/* convert
+ *    Purpose: decode or encode rows j0 .. j0 + rows - 1 of an image, the
+ *             raster holding just those rows. Large bands of suites with
+ *             raw access are split among threads by rows
+ */
+static void convert(Pnm_ppm pixmap, unsigned char *raster, unsigned j0,
+                    unsigned rows, int wide, int decode)
+{
+        size_t row_bytes = (size_t)pixmap->width * 3 * (wide ? 2 : 1);
+        int threads = 1;
+        if (rows * row_bytes >= PARALLEL_BYTES &&
+            (pixmap->methods->data(pixmap->pixels) != NULL ||
+             A2_is_blocked(pixmap->methods))) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                threads = cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS
+                                                            : cpus;
+        }
+
+        Band bands[MAX_THREADS];
+        for (int t = 0; t < threads; t++) {
+                unsigned first = (unsigned long)rows * t / threads;
+                unsigned last = (unsigned long)rows * (t + 1) / threads;
+                bands[t] = (Band){ pixmap, raster + first * row_bytes,
+                                   j0 + first, last - first, wide, decode,
+                                   0 };
+                if (t > 0) {
+                        int rc = pthread_create(&bands[t].thread, NULL,
+                                                convert_thread, &bands[t]);
+                        assert(rc == 0);
+                }
+        }
+        convert_rows(&bands[0]);
+        for (int t = 1; t < threads; t++) {
+                pthread_join(bands[t].thread, NULL);
+        }
+}
+
+/* new_pixmap
+ *    Purpose: an image with the header's size and maxval and pixels of
+ *             the type it needs, not yet filled in, or NULL if the
+ *             header does not describe an image
+ */
+static Pnm_ppm new_pixmap(Header *header, A2Methods_T methods)
+{
+        if (header->width == 0 || header->height == 0 ||
+            header->maxval == 0 || header->maxval > 65535) {
+                return NULL;
+        }
+
+        Pnm_ppm pixmap;
+        NEW(pixmap);
+        pixmap->width = header->width;
+        pixmap->height = header->height;
+        pixmap->denominator = header->maxval;
+        pixmap->methods = methods;
+        pixmap->pixels = methods->new(header->width, header->height,
+                                      header->maxval > 255
+                                      ? sizeof(struct Pnm_rgb16)
+                                      : sizeof(struct Pnm_rgb));
+        return pixmap;
+}
+
+/* read_async
+ *    Purpose: read the raster of a P6 image through asyncio, decoding
+ *             each group of rows while the reads after it are in flight,
+ *             and leave fp just after the raster
+ *    Returns: the image, or NULL if it is malformed or truncated
+ */
+static Pnm_ppm read_async(FILE *fp, Header *header, A2Methods_T methods)
+{
+        Pnm_ppm pixmap = new_pixmap(header, methods);
+        if (pixmap == NULL) {
+                return NULL;
+        }
+        int wide = header->maxval > 255;
+        size_t row_bytes = (size_t)header->width * 3 * (wide ? 2 : 1);
+        unsigned group_rows = GROUP_BYTES / row_bytes > 0
+                              ? GROUP_BYTES / row_bytes : 1;
+        off_t offset = ftello(fp);
+        off_t length = (off_t)row_bytes * header->height;
+
+        unsigned char *group = malloc(group_rows * row_bytes);
+        assert(group != NULL);
+        AsyncIO_T io = AsyncIO_reader(fileno(fp), offset, length,
+                                      io_mode == PPMIO_DIRECT);
+        for (unsigned j = 0; j < header->height; j += group_rows) {
+                unsigned rows = header->height - j < group_rows
+                                ? header->height - j : group_rows;
+                size_t bytes = rows * row_bytes;
+                if (AsyncIO_read(io, group, bytes) != bytes) {
+                        AsyncIO_close(&io);
+                        free(group);
+                        Pnm_ppmfree(&pixmap);
+                        return NULL;
+                }
+                convert(pixmap, group, j, rows, wide, 1);
+        }
+        AsyncIO_close(&io);
+        free(group);
+
+        fseeko(fp, offset + length, SEEK_SET);
+        return pixmap;
+}
+
+/* read_stream
+ *    Purpose: read the raster of a P6 image from a stream without offsets
+ *             with one fread, then decode it
+ *    Returns: the image, or NULL if it is malformed or truncated
+ */
+static Pnm_ppm read_stream(FILE *fp, Header *header, A2Methods_T methods)
+{
+        Pnm_ppm pixmap = new_pixmap(header, methods);
+        if (pixmap == NULL) {
+                return NULL;
+        }
+        int wide = header->maxval > 255;
+        size_t bytes = (size_t)header->width * header->height * 3
+                       * (wide ? 2 : 1);
+
+        unsigned char *raster = malloc(bytes);
+        assert(raster != NULL);
+        if (fread(raster, 1, bytes, fp) != bytes) {
+                free(raster);
+                Pnm_ppmfree(&pixmap);
+                return NULL;
+        }
+        convert(pixmap, raster, 0, header->height, wide, 1);
+        free(raster);
+        return pixmap;
+}
+
+/* write_async
+ *    Purpose: write an image as P6 through asyncio, encoding each group
+ *             of rows while the writes before it are in flight, and leave
+ *             fp just after the image
+ *    Returns: 1 if the image was written, and 0 if a write failed, in
+ *             which case fp is back where it was
+ */
+static int write_async(FILE *fp, Pnm_ppm pixmap, int wide,
+                       const char *header, int header_bytes)
+{
+        size_t row_bytes = (size_t)pixmap->width * 3 * (wide ? 2 : 1);
+        unsigned group_rows = GROUP_BYTES / row_bytes > 0
+                              ? GROUP_BYTES / row_bytes : 1;
+
+        fflush(fp);
+        off_t offset = ftello(fp);
+        AsyncIO_T io = AsyncIO_writer(fileno(fp), offset);
+        AsyncIO_write(io, header, header_bytes);
+
+        unsigned char *group = malloc(group_rows * row_bytes);
+        assert(group != NULL);
+        for (unsigned j = 0; j < pixmap->height; j += group_rows) {
+                unsigned rows = pixmap->height - j < group_rows
+                                ? pixmap->height - j : group_rows;
+                convert(pixmap, group, j, rows, wide, 0);
+                AsyncIO_write(io, group, rows * row_bytes);
+        }
+        int ok = AsyncIO_close(&io);
+        free(group);
+
+        fseeko(fp, ok ? offset + header_bytes
+                        + (off_t)row_bytes * pixmap->height
+                      : offset, SEEK_SET);
+        return ok;
+}
+
+/* write_vector
+ *    Purpose: encode a whole image, then write the header and raster to
+ *             fp's descriptor with writev, for outputs without offsets
+ *    Returns: 0 if nothing was written, so stdio can try instead without
+ *             sending any byte twice, and 1 otherwise; a write that failed
+ *             part way is reported on stderr and left in ferror(fp)
+ */
+static int write_vector(FILE *fp, Pnm_ppm pixmap, int wide,
+                        const char *header, int header_bytes)
+{
+        size_t bytes = (size_t)pixmap->width * pixmap->height * 3
+                       * (wide ? 2 : 1);
+        unsigned char *raster = malloc(bytes);
+        assert(raster != NULL);
+        convert(pixmap, raster, 0, pixmap->height, wide, 0);
+
+        fflush(fp);
+        struct iovec iov[2] = { { (void *)header, header_bytes },
+                                { raster, bytes } };
+        struct iovec *next = iov;
+        int count = 2;
+        size_t sent = 0;
+        int error = 0;
+        while (count > 0) {
+                ssize_t n = writev(fileno(fp), next, count);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        error = n < 0 ? errno : EIO;
+                        break;
+                }
+                /* skip what went out; a pipe may take less than all */
+                sent += n;
+                while (count > 0 && (size_t)n >= next->iov_len) {
+                        n -= next->iov_len;
+                        next++;
+                        count--;
+                }
+                if (count > 0) {
+                        next->iov_base = (char *)next->iov_base + n;
+                        next->iov_len -= n;
+                }
+        }
+        free(raster);
+
+        /* the reader already has part of the image, so writing it again
+         * through stdio would send those bytes twice
+         */
+        if (count > 0 && sent > 0) {
+                fprintf(stderr, "ppmio: write failed after %zu of %zu "
+                        "bytes: %s\n", sent, header_bytes + bytes,
+                        strerror(error));
+                mark_failed(fp);
+        }
+        return count == 0 || sent > 0;
+}
+
+/* mark_failed
+ *    Purpose: set fp's error indicator, so ferror(fp) reports a write
+ *             that failed on its descriptor behind stdio's back
+ */
+static void mark_failed(FILE *fp)
+{
+#ifdef _IO_ERR_SEEN
+        fp->_flags |= _IO_ERR_SEEN;
+#else
+        (void)fp;
+#endif
+}
+
+/* write_fast
+ *    Purpose: write an image as P6 through asyncio if fp's descriptor has
+ *             offsets, and with writev otherwise
+ *    Returns: 1 if the image was written or its write failed part way,
+ *             and 0 if it should be written through stdio instead
+ */
+static int write_fast(FILE *fp, Pnm_ppm pixmap, int wide)
+{
+        if (fileno(fp) < 0) {
+                return 0;
+        }
+        char header[64];
+        int header_bytes = snprintf(header, sizeof(header), "P6\n%u %u\n%u\n",
+                                    pixmap->width, pixmap->height,
+                                    pixmap->denominator);
+        return AsyncIO_usable(fileno(fp), 1)
+               ? write_async(fp, pixmap, wide, header, header_bytes)
+               : write_vector(fp, pixmap, wide, header, header_bytes);
+}
+
+/* write16
+ *    Purpose: write an image of Pnm_rgb16 pixels as a 16-bit P6 image
+ */
+static void write16(FILE *fp, Pnm_ppm pixmap)
+{
+        const struct A2Methods_T *methods = pixmap->methods;
+        size_t samples = (size_t)pixmap->width * pixmap->height * 3;
+        uint16_t *raster = malloc(samples * sizeof(uint16_t));
+        assert(raster != NULL);
+
+        RasterData raster_data = { (unsigned char *)raster, pixmap->width,
+                                   0 };
+        methods->map_default(pixmap->pixels, copy_raster, &raster_data);
+        Ppmio_swap16(raster, samples);
+
+        fprintf(fp, "P6\n%u %u\n%u\n", pixmap->width, pixmap->height,
+                                       pixmap->denominator);
+        fwrite(raster, sizeof(uint16_t), samples, fp);
+        free(raster);
+}
+
+/* copy_raster
+ *    Purpose: apply function that copies one Pnm_rgb16 between its cell
+ *             and its spot in a row-major raster, in the direction given
+ *             by the RasterData closure
+ */
+static void copy_raster(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl)
+{
+        (void)array2;
+        RasterData *raster_data = cl;
+        Pnm_rgb16 pixel = (Pnm_rgb16)raster_data->raster
+                          + (size_t)j * raster_data->width + i;
+
+        if (raster_data->to_array) {
+                *(Pnm_rgb16)ptr = *pixel;
+        } else {
+                *pixel = *(Pnm_rgb16)ptr;
+        }
+}
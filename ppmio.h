@@ -0,0 +1,83 @@
+/**************************************************************
+ *
+ *                     ppmio.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Reading and writing PPM images for ppmtrans. Images whose
+ *     maxval is above 255 are stored with a compact 6-byte pixel
+ *     (Pnm_rgb16) instead of the 12-byte Pnm_rgb; every other
+ *     image goes through the Pnm library unchanged, except that
+ *     P6 images on regular files are read and written with many
+ *     requests in flight (asyncio.h).
+ *
+ **************************************************************/
+
+#ifndef __PPMIO__
+#define __PPMIO__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "a2methods.h"
+#include "pnm.h"
+
+/* colored pixel for images with maxval > 255, channels in host order */
+typedef struct Pnm_rgb16 {
+        uint16_t red, green, blue;
+} *Pnm_rgb16;
+
+/* how P6 images on regular files (and block devices) are read and
+ * written: with stdio, through asyncio, or through asyncio with reads
+ * that bypass the page cache (O_DIRECT)
+ */
+typedef enum Ppmio_IO { PPMIO_STDIO, PPMIO_ASYNC, PPMIO_DIRECT } Ppmio_IO;
+
+/* Read a PPM or tiled image; the 'pixels' element size is
+ * sizeof(struct Pnm_rgb16) for 16-bit input and sizeof(struct Pnm_rgb)
+ * otherwise. The result is freed with Pnm_ppmfree
+ */
+Pnm_ppm Ppmio_read(FILE *fp, A2Methods_T methods);
+
+/* Ppmio_read into blocks of 'block_width' by 'block_height' cells when
+ * 'methods' is blocked; 0 by 0 gives the default blocks
+ */
+Pnm_ppm Ppmio_read_shaped(FILE *fp, A2Methods_T methods, int block_width,
+                          int block_height);
+
+/* Ppmio_read_shaped that returns NULL for a malformed image instead of
+ * raising Pnm_Badformat, so threads need no TRY to read
+ */
+Pnm_ppm Ppmio_read_checked(FILE *fp, A2Methods_T methods, int block_width,
+                           int block_height);
+
+/* Read a P6 header, leaving fp at the first raster byte. Returns 1 on
+ * success and 0 if the stream does not start with a P6 header
+ */
+int Ppmio_read_header(FILE *fp, unsigned *width, unsigned *height,
+                      unsigned *maxval);
+
+/* Write an image of either element size as P6 */
+void Ppmio_write(FILE *fp, Pnm_ppm pixmap);
+
+/* Decode 'rows' rows of a P6 raster into the pixels of rows j0 on, or
+ * encode those pixels into the raster, with the kernels and threads of
+ * Ppmio_read and Ppmio_write. The caller owns the raster, which holds
+ * just those rows: 16-bit samples for Pnm_rgb16 pixels, 8-bit ones for
+ * Pnm_rgb pixels
+ */
+void Ppmio_decode_rows(Pnm_ppm pixmap, unsigned char *raster, unsigned j0,
+                       unsigned rows);
+void Ppmio_encode_rows(Pnm_ppm pixmap, unsigned char *raster, unsigned j0,
+                       unsigned rows);
+
+/* Choose the I/O for every later read and write; PPMIO_ASYNC to start */
+void Ppmio_set_io(Ppmio_IO mode);
+
+/* Convert n big-endian 16-bit samples in place to host order (and back) */
+void Ppmio_swap16(uint16_t *samples, size_t n);
+
+#endif /* __PPMIO__ */
@@ -16,47 +16,64 @@
  *     Example commands:
  *     ./ppmtrans -rotate 270 -row-major -time time.txt in.ppm
  *     ./ppmtrans -transpose -block-major -time time.txt in.ppm
+ *     ./ppmtrans -rotate 90 -tiled-major=32 in.ppm
+ *     ./ppmtrans -rotate 90 -block-major=256x16 in.ppm
+ *     ./ppmtrans -rotate 90 -scale 1/8 in.ppm
+ *     ./ppmtrans -rotate 90 -planar -block-major in.ppm
+ *     ./ppmtrans -rotate 90 -block-major -threads 8 in.ppm
+ *     ./ppmtrans -rotate 90 -write-strategy stream -prefetch 16 in.ppm
+ *     ./ppmtrans -out-format tiled in.ppm > in.tiled
+ *     ./ppmtrans -rotate 90 -block-major in.tiled
+ *     ./ppmtrans -rotate 90 -cache /tmp/ppmcache -time time.txt in.ppm
+ *     ./ppmtrans -rotate 90 -memory-limit 512M huge.ppm > rotated.ppm
+ *     ./ppmtrans -rotate 90 -update out.ppm -dirty 10,20,64x48 -output
+ *                out.ppm edited.ppm
+ *     camera | ./ppmtrans -rotate 180 -stream -time stats.txt > out.ppm
+ *     ./ppmtrans -rotate 90 -threads 4 -trace run.json in.ppm
+ *     ./ppmtrans -emit rotate90:out90.ppm -emit flip-h:fh.ppm in.ppm
+ *     ./ppmtrans -rotate 90 -pyramid mip -output out.ppm in.ppm
+ *     ./ppmtrans --calibrate
+ *     ./ppmtrans --serve /tmp/ppmtrans.sock &
+ *     ./ppmtrans --client /tmp/ppmtrans.sock -rotate 90 < in.ppm > out.ppm
  *     
  **************************************************************/
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "assert.h"
+#include "except.h"
 #include "a2methods.h"
 #include "a2plain.h"
 #include "a2blocked.h"
 #include "pnm.h"
-#include "transform.h"
+#include "ppmio.h"
+#include "options.h"
+#include "server.h"
+#include "cache.h"
+#include "outcore.h"
+#include "frames.h"
 #include "cputiming.h"
+#include "memstats.h"
+#include "costmodel.h"
+#include "trace.h"
+#include "tiled.h"
+#include "pyramid.h"
 
 FILE * open_file(char *filename);
+FILE *open_output(char *filename, char *progname);
+FILE *open_timefile(char *filename, char *progname);
+void entry_size(Options *options, FILE *entry, Pnm_ppm size);
+int run_outcore(Options *options, FILE *input_fp, char *progname);
+int run_update(Options *options, FILE *input_fp, char *progname);
+int run_stream(Options *options, FILE *input_fp, char *progname);
+int run_emit(Options *options, FILE *input_fp, char *progname);
+void write_pyramid(Options *options, Pnm_ppm image, char *progname);
 void write_timefile(FILE *output_fp, char *filename, Pnm_ppm image,
                                                  double time_used);
-
-/* SET_METHODS
- * Purpose: Set the method and mapping function for the transformation
- * Parameters: a A2Methods_T for the method suite containing the
- *             correct function pointers, a function pointer to the
- *             mapping method that will be used, and a C string
- *             representation of the chosen mapping method
- * Expected input: valid mapping method
- * Success output: none
- * Failure output: message to standard error if mapping choosen is not valid
- */
-#define SET_METHODS(METHODS, MAP, WHAT) do {                    \
-        methods = (METHODS);                                    \
-        assert(methods != NULL);                                \
-                                                                \
-        map = methods->MAP;                                     \
-        if (map == NULL) {                                      \
-                fprintf(stderr, "%s does not support "          \
-                                WHAT "mapping\n",               \
-                                argv[0]);                       \
-                exit(1);                                        \
-        }                                                       \
-} while (0)
+void write_memory(FILE *output_fp);
 
 /* usage
  * Purpose: Write to standard error if there is issues with command line
@@ -71,119 +88,182 @@ void write_timefile(FILE *output_fp, char *filename, Pnm_ppm image,
 static void
 usage(const char *progname)
 {
-        fprintf(stderr, "Usage: %s [-rotate <angle>] "
-                        "[-{row,col,block}-major] [filename]\n",
-                        progname);
+        fprintf(stderr, "Usage: %s [-rotate <angle>] [-auto] "
+                        "[-{row,col,block}-major] [-tiled-major[=<N>]] "
+                        "[-block-major=<W>x<H>] "
+                        "[-scale 1/<N>] "
+                        "[-planar] [-threads <N>] "
+                        "[-write-strategy {normal,gather,stream}] [-prefetch <N>] "
+                        "[-time <file>] [-trace <file>] "
+                        "[-out-format {ppm,tiled}] [-output <file>] "
+                        "[-cache <dir> [-cache-max <MB>]] "
+                        "[-memory-limit <bytes>[K|M|G]] "
+                        "[-update <output> -dirty <x,y,WxH> ...] "
+                        "[-stream] [-io {stdio,async,direct}] "
+                        "[-emit <orientation>:<file> ...] "
+                        "[-pyramid <prefix>] "
+                        "[filename]\n"
+                        "       %s --calibrate [<profile>]\n"
+                        "       %s --serve <socket> [--workers <N>]\n"
+                        "       %s --client <socket> [options] [filename]\n",
+                        progname, progname, progname, progname);
         exit(1);
 }
 
 int main(int argc, char *argv[]) 
 {
-        char *time_file_name = NULL;
-        char *filename       = NULL;
-        int   rotation       = 0;
-        char *flip           = NULL;
-        int   transpose      = 0;
-        int   i;
-
-        /* default to UArray2 methods */
-        A2Methods_T methods = uarray2_methods_plain; 
-        assert(methods);
-
-        /* default to best map */
-        A2Methods_mapfun *map = methods->map_default; 
-        assert(map);
-
-        for (i = 1; i < argc; i++) {
-            /* change mapping function to reflect user input */
-            if (strcmp(argv[i], "-row-major") == 0) {
-                SET_METHODS(uarray2_methods_plain, map_row_major, 
-                                                    "row-major");
-            } else if (strcmp(argv[i], "-col-major") == 0) {
-                SET_METHODS(uarray2_methods_plain, map_col_major, 
-                                                 "column-major");
-            } else if (strcmp(argv[i], "-block-major") == 0) {
-                SET_METHODS(uarray2_methods_blocked, map_block_major,
-                                                      "block-major");
-            /* check for rotation value */
-            } else if (strcmp(argv[i], "-rotate") == 0) {
-                if (!(i + 1 < argc)) {      /* no rotate value */
-                    usage(argv[0]);
-                }
-                char *endptr;
-                rotation = strtol(argv[++i], &endptr, 10);
-                if (!(rotation == 0 || rotation == 90 ||
-                    rotation == 180 || rotation == 270)) {
-                    fprintf(stderr, 
-                        "Rotation must be 0, 90 180 or 270\n");
-                    usage(argv[0]);
-                }
-                if (!(*endptr == '\0')) {    /* Not a number */
-                    usage(argv[0]);
-                }
-            /* check for flips */
-            } else if (strcmp(argv[i], "-flip") == 0) {
-                if (!(i + 1 < argc)) {      /* no rotate value */
+        /* server and client modes of a persistent ppmtrans */
+        if (argc >= 3 && strcmp(argv[1], "--serve") == 0) {
+            int workers = 0;
+            if (argc == 5 && strcmp(argv[3], "--workers") == 0) {
+                char *end;
+                long count = strtol(argv[4], &end, 10);
+                if (*argv[4] == '\0' || *end != '\0' || count < 1 ||
+                    count > 4096) {
+                    fprintf(stderr, "%s: --workers must be a positive "
+                                    "number\n", argv[0]);
                     usage(argv[0]);
                 }
-
-                flip = argv[++i];
-                    
-                if (!(strcmp(flip, "horizontal") == 0 ||
-                        strcmp(flip, "vertical") == 0)) {
-                    fprintf(stderr, 
-                    "Flip must be horizontal or vertical\n");
-                    usage(argv[0]);
-                }
-            /* check for transpose */
-            } else if (strcmp(argv[i], "-transpose") == 0) {
-                    transpose = 1;
-            /* check if going to use -time */
-            } else if (strcmp(argv[i], "-time") == 0) {
-                time_file_name = argv[++i];      
-            /* exceptions handling */
-            } else if (*argv[i] == '-') {
-                fprintf(stderr, "%s: unknown option '%s'\n", argv[0],
-                                                            argv[i]);
+                workers = count;
+            } else if (argc != 3) {
                 usage(argv[0]);
-            } else if (argc - i > 1) {
-                printf("argc is %d\n", argc);
-                printf("at %d\n", i);
-                fprintf(stderr, "Too many arguments\n");
+            }
+            return Server_run(argv[2], workers);
+        } else if (argc >= 3 && strcmp(argv[1], "--client") == 0) {
+            return Client_run(argv[2], argc - 3, argv + 3);
+        } else if (argc >= 2 && strcmp(argv[1], "--calibrate") == 0) {
+            if (argc > 3) {
                 usage(argv[0]);
-            } else if (i == argc - 1) {
-                filename = argv[argc - 1];
-            } else {
-                break;
             }
+            if (!Costmodel_calibrate(argc == 3 ? argv[2] : NULL, stderr)) {
+                fprintf(stderr, "%s: cannot write the profile\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+            return 0;
+        }
+
+        Options options;
+        Options_init(&options);
+        if (!Options_parse(&options, argc, argv)) {
+            fprintf(stderr, "%s: %s\n", argv[0], options.error);
+            usage(argv[0]);
+        }
+        Ppmio_set_io(options.io);
+        if (options.trace_file_name != NULL &&
+            !Trace_open(options.trace_file_name)) {
+            fprintf(stderr, "%s: cannot write %s\n", argv[0],
+                            options.trace_file_name);
+            exit(EXIT_FAILURE);
         }
 
-        FILE *input_fp = open_file(filename);
+        FILE *input_fp = open_file(options.filename);
         FILE *output_fp = NULL;
+        if (options.memory_limit > 0) {
+            return run_outcore(&options, input_fp, argv[0]);
+        } else if (options.update_name != NULL) {
+            return run_update(&options, input_fp, argv[0]);
+        } else if (options.stream) {
+            return run_stream(&options, input_fp, argv[0]);
+        } else if (options.emit_count > 0) {
+            return run_emit(&options, input_fp, argv[0]);
+        }
 
-        CPUTime_T timer = CPUTime_New();
+        /* with a result cache, the input is hashed as it is read */
+        Cache_T cache = NULL;
+        FILE *read_fp = input_fp;
+        if (options.cache_dir != NULL) {
+            cache = Cache_new(options.cache_dir,
+                              (uint64_t)options.cache_max << 20);
+            if (cache == NULL) {
+                fprintf(stderr, "%s: cannot use cache directory %s\n",
+                                argv[0], options.cache_dir);
+                exit(EXIT_FAILURE);
+            }
+            read_fp = Cache_reader(cache, input_fp);
+        }
 
-        Pnm_ppm image = Pnm_ppmread(input_fp, methods);
+        uint64_t phase = Trace_begin();
+        Pnm_ppm image = Ppmio_read_shaped(read_fp, options.methods,
+                                          options.block_width,
+                                          options.block_height);
+        Trace_end("read", phase, -1);
+        if (read_fp != input_fp) {
+            fclose(read_fp);
+        }
+        phase = Trace_begin();
+        Options_plan(&options, image);
+        Trace_end("plan", phase, -1);
 
-        if (time_file_name != NULL) {
+        /* on a hit the time recorded is that of the lookup and copy */
+        FILE *entry = NULL;
+        char spec[64];
+        CPUTime_T timer = CPUTime_New();
+        if (cache != NULL) {
+            Options_spec(&options, spec, sizeof(spec));
             CPUTime_Start(timer);
-            image = transform(image, rotation, flip, transpose, methods, map);
-            CPUTime_Stop(timer);
+            entry = Cache_lookup(cache, spec);
+        }
+        int hit = entry != NULL;
 
-            double time_used = CPUTime_Stop(timer);
-            CPUTime_Free(&timer);
+        double time_used = 0;
+        struct Pnm_ppm result;
+        if (!hit) {
+            phase = Trace_begin();
+            image = Options_transform(&options, image, &time_used);
+            Trace_end("transform", phase, -1);
+            result = *image;
+        } else {
+            result = *image;
+            entry_size(&options, entry, &result);
+        }
 
-            output_fp = fopen(time_file_name, "a");
-            write_timefile(output_fp, filename, image, time_used);
-            fclose(output_fp);
+        FILE *image_fp = open_output(options.output_name, argv[0]);
+        phase = Trace_begin();
+        if (cache != NULL && entry == NULL) {
+            /* store the result, then send it on from the entry */
+            entry = Cache_insert(cache, spec);
+            if (entry != NULL) {
+                Options_write(&options, entry, image);
+                entry = Cache_commit(cache, entry);
+            }
+        }
+        if (entry != NULL) {
+            Cache_copy(entry, image_fp);
         } else {
-            image = transform(image, rotation, flip, transpose, methods, map);
+            Options_write(&options, image_fp, image);
+        }
+        if (image_fp != stdout) {
+            fclose(image_fp);
         }
+        Trace_end("write", phase, -1);
+        if (hit) {
+            time_used = CPUTime_Stop(timer);
+        }
+        CPUTime_Free(&timer);
 
-        Pnm_ppmwrite(stdout, image);
+        if (options.time_file_name != NULL) {
+            output_fp = open_timefile(options.time_file_name, argv[0]);
+            write_timefile(output_fp, options.filename, &result, time_used);
+            if (options.plan != NULL) {
+                fprintf(output_fp, "    Plan: %s\n\n", options.plan);
+            }
+            if (cache != NULL) {
+                fprintf(output_fp, "    Cache: %s; %lu hits, %lu misses "
+                                   "in all\n\n", hit ? "hit" : "miss",
+                        Cache_hits(cache), Cache_misses(cache));
+            }
+            fclose(output_fp);
+        }
+
+        if (options.pyramid_name != NULL) {
+            write_pyramid(&options, image, argv[0]);
+        }
         
         fclose(input_fp);
         Pnm_ppmfree(&image);
+        if (cache != NULL) {
+            Cache_free(&cache);
+        }
 
         return(0);
 }
@@ -224,6 +304,363 @@ FILE *open_file(char *filename)
     return fp;
 }
 
+/* open_output
+ * Purpose: Determine where the image should be written. To the file given
+ *          with -output if there is one, otherwise to standard output
+ * Parameters: the -output file name or NULL, and the program name
+ * Returns: a file pointer to write the image to
+ *
+ * Expected input: a valid program name
+ * Success output: none
+ * Failure output: message written to stderr and exit_failure if the file
+ *                 cannot be opened
+ */
+FILE *open_output(char *filename, char *progname)
+{
+    FILE *fp = stdout;
+
+    if (filename != NULL) {
+        fp = fopen(filename, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "%s: cannot write %s\n", progname, filename);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return fp;
+}
+
+/* open_timefile
+ * Purpose: Open the -time file to append this run's record to it
+ * Parameters: the -time file name and the program name
+ * Returns: a file pointer to append to
+ *
+ * Expected input: a non-null file name
+ * Success output: none
+ * Failure output: message written to stderr and exit_failure if the file
+ *                 cannot be opened
+ */
+FILE *open_timefile(char *filename, char *progname)
+{
+    FILE *fp = fopen(filename, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "%s: cannot write %s\n", progname, filename);
+        exit(EXIT_FAILURE);
+    }
+    return fp;
+}
+
+/* entry_size
+ * Purpose: Find the width and height of a cached result from the header
+ *          at its start
+ * Parameters: the parsed options, which give the output format, the cache
+ *             entry, and the image record to set the size in
+ * Returns: void
+ *
+ * Expected input: an entry from Cache_lookup, positioned at its start
+ * Success output: none; the entry is left at its start
+ * Failure output: none; the size is left as it was if the header cannot
+ *                 be read
+ */
+void entry_size(Options *options, FILE *entry, Pnm_ppm size)
+{
+    if (options->out_format == OUT_TILED) {
+        TiledHeader header;
+        if (fread(&header, sizeof(header), 1, entry) == 1 &&
+            memcmp(header.magic, TILED_MAGIC, sizeof(header.magic)) == 0) {
+            size->width = header.width;
+            size->height = header.height;
+        }
+    } else {
+        unsigned maxval;
+        Ppmio_read_header(entry, &size->width, &size->height, &maxval);
+    }
+    rewind(entry);
+}
+
+/* run_outcore
+ * Purpose: Transform an image too large for memory with the out-of-core
+ *          transform, streaming from the input to the output
+ * Parameters: the parsed options, with memory_limit set, the input file
+ *             pointer, and the program name
+ * Returns: the exit status
+ *
+ * Expected input: options accepted by Options_parse and an open input
+ * Success output: the transformed image, and the time file if requested
+ * Failure output: message written to stderr and exit_failure if the input
+ *                 is not a complete P6 image
+ */
+int run_outcore(Options *options, FILE *input_fp, char *progname)
+{
+    FILE *image_fp = open_output(options->output_name, progname);
+    Orientation orientation = orientation_of(options->rotation,
+                                             options->flip,
+                                             options->transpose);
+    struct Pnm_ppm size = { 0, 0, 0, NULL, NULL };
+
+    CPUTime_T timer = CPUTime_New();
+    CPUTime_Start(timer);
+    TRY
+        Outcore_transform(input_fp, image_fp, orientation,
+                          options->memory_limit, &size.width, &size.height);
+    EXCEPT(Pnm_Badformat)
+        fprintf(stderr, "%s: -memory-limit needs a complete P6 image\n",
+                progname);
+        exit(EXIT_FAILURE);
+    END_TRY;
+    double time_used = CPUTime_Stop(timer);
+    CPUTime_Free(&timer);
+
+    if (options->time_file_name != NULL) {
+        FILE *output_fp = open_timefile(options->time_file_name, progname);
+        write_timefile(output_fp, options->filename, &size, time_used);
+        fclose(output_fp);
+    }
+
+    if (image_fp != stdout) {
+        fclose(image_fp);
+    }
+    fclose(input_fp);
+    return 0;
+}
+
+/* run_update
+ * Purpose: Bring a previous output of the same transform up to date with
+ *          an edited input, rewriting only the cells the -dirty rectangles
+ *          cover, and write the result
+ * Parameters: the parsed options, with update_name set, the input file
+ *             pointer, and the program name
+ * Returns: the exit status
+ *
+ * Expected input: options accepted by Options_parse and an open input
+ * Success output: the updated image, and the time file if requested, which
+ *                 records only the time of the update
+ * Failure output: message written to stderr and exit_failure if the
+ *                 previous output cannot be read or does not match the
+ *                 input; Pnm_Badformat if either image is not valid
+ */
+int run_update(Options *options, FILE *input_fp, char *progname)
+{
+    Pnm_ppm source = Ppmio_read_shaped(input_fp, options->methods,
+                                       options->block_width,
+                                       options->block_height);
+    fclose(input_fp);
+    FILE *previous_fp = fopen(options->update_name, "r");
+    if (previous_fp == NULL) {
+        fprintf(stderr, "%s: cannot read %s\n", progname,
+                options->update_name);
+        exit(EXIT_FAILURE);
+    }
+    Pnm_ppm output = Ppmio_read_shaped(previous_fp, options->methods,
+                                       options->block_width,
+                                       options->block_height);
+    fclose(previous_fp);
+
+    Orientation orientation = orientation_of(options->rotation,
+                                             options->flip,
+                                             options->transpose);
+    int swapped = Orientation_swaps(orientation);
+    if (output->width != (swapped ? source->height : source->width) ||
+        output->height != (swapped ? source->width : source->height) ||
+        output->denominator != source->denominator ||
+        output->methods->size(output->pixels) !=
+                source->methods->size(source->pixels)) {
+        fprintf(stderr, "%s: %s is not this transform of the input\n",
+                progname, options->update_name);
+        exit(EXIT_FAILURE);
+    }
+
+    CPUTime_T timer = CPUTime_New();
+    CPUTime_Start(timer);
+    transform_update(source, output, orientation, options->dirty,
+                     options->dirty_count);
+    double time_used = CPUTime_Stop(timer);
+    CPUTime_Free(&timer);
+
+    if (options->time_file_name != NULL) {
+        FILE *output_fp = open_timefile(options->time_file_name, progname);
+        write_timefile(output_fp, options->filename, output, time_used);
+        fclose(output_fp);
+    }
+
+    /* a tiled image may still be mapped from the file it updates, so
+     * replace that file only once the result is fully written
+     */
+    char *output_name = options->output_name;
+    char temp_name[4096];
+    if (output_name != NULL &&
+        strcmp(output_name, options->update_name) == 0) {
+        snprintf(temp_name, sizeof(temp_name), "%s.tmp", output_name);
+        output_name = temp_name;
+    }
+    FILE *image_fp = open_output(output_name, progname);
+    Options_write(options, image_fp, output);
+    if (image_fp != stdout) {
+        fclose(image_fp);
+    }
+    if (output_name == temp_name &&
+        rename(temp_name, options->output_name) != 0) {
+        fprintf(stderr, "%s: cannot replace %s\n", progname,
+                options->output_name);
+        exit(EXIT_FAILURE);
+    }
+
+    Pnm_ppmfree(&source);
+    Pnm_ppmfree(&output);
+    return 0;
+}
+
+/* run_stream
+ * Purpose: Transform every frame of a stream of concatenated P6 images
+ *          and report the throughput and per-frame latency
+ * Parameters: the parsed options, with stream set, the input file pointer,
+ *             and the program name
+ * Returns: the exit status
+ *
+ * Expected input: options accepted by Options_parse and an open input
+ * Success output: the transformed frames, and the frame rate and latency
+ *                 percentiles appended to the time file, or written to
+ *                 standard error without -time
+ * Failure output: Pnm_Badformat if a frame is not a valid P6 image
+ */
+int run_stream(Options *options, FILE *input_fp, char *progname)
+{
+    FILE *image_fp = open_output(options->output_name, progname);
+    Orientation orientation = orientation_of(options->rotation,
+                                             options->flip,
+                                             options->transpose);
+    FrameStats stats;
+    Frames_stream(input_fp, image_fp, orientation, options->methods,
+                  options->block_width, options->block_height, options->map,
+                  &stats);
+
+    FILE *report_fp = stderr;
+    if (options->time_file_name != NULL) {
+        report_fp = open_timefile(options->time_file_name, progname);
+    }
+    fprintf(report_fp, "For stream \"%s\":\n",
+            options->filename != NULL ? options->filename : "stdin");
+    fprintf(report_fp, "    Frames: %u in %f seconds, %f frames/s\n",
+            stats.frames, stats.seconds,
+            stats.seconds > 0 ? stats.frames / stats.seconds : 0.0);
+    fprintf(report_fp, "    Latency: p50 %f ms, p90 %f ms, p99 %f ms, "
+                       "max %f ms\n", stats.latency_p50 / 1e6,
+            stats.latency_p90 / 1e6, stats.latency_p99 / 1e6,
+            stats.latency_max / 1e6);
+    write_memory(report_fp);
+    if (report_fp != stderr) {
+        fclose(report_fp);
+    }
+
+    if (image_fp != stdout) {
+        fclose(image_fp);
+    }
+    fclose(input_fp);
+    return 0;
+}
+
+/* run_emit
+ * Purpose: Write every -emit orientation of the input to its own file,
+ *          decoding the input once and producing all of them in one
+ *          traversal of it
+ * Parameters: the parsed options, with emits, the input file pointer, and
+ *             the program name
+ * Returns: the exit status
+ *
+ * Expected input: options accepted by Options_parse and an open input
+ * Success output: one P6 image per -emit, and the time taken to produce
+ *                 them all appended to the time file
+ * Failure output: message written to stderr and exit_failure if an output
+ *                 cannot be opened
+ */
+int run_emit(Options *options, FILE *input_fp, char *progname)
+{
+    uint64_t phase = Trace_begin();
+    Pnm_ppm source = Ppmio_read_shaped(input_fp, options->methods,
+                                       options->block_width,
+                                       options->block_height);
+    Trace_end("read", phase, -1);
+
+    Orientation orientations[MAX_EMITS];
+    Pnm_ppm outputs[MAX_EMITS];
+    for (int k = 0; k < options->emit_count; k++) {
+        orientations[k] = options->emits[k].orientation;
+    }
+
+    CPUTime_T timer = CPUTime_New();
+    phase = Trace_begin();
+    CPUTime_Start(timer);
+    transform_fanout(source, orientations, options->emit_count, outputs);
+    double time_used = CPUTime_Stop(timer);
+    Trace_end("fanout", phase, options->emit_count);
+    CPUTime_Free(&timer);
+
+    if (options->time_file_name != NULL) {
+        FILE *output_fp = open_timefile(options->time_file_name, progname);
+        write_timefile(output_fp, options->filename, source, time_used);
+        fclose(output_fp);
+    }
+
+    for (int k = 0; k < options->emit_count; k++) {
+        phase = Trace_begin();
+        FILE *image_fp = open_output(options->emits[k].file_name, progname);
+        Ppmio_write(image_fp, outputs[k]);
+        fclose(image_fp);
+        Pnm_ppmfree(&outputs[k]);
+        Trace_end("write", phase, k);
+    }
+
+    fclose(input_fp);
+    Pnm_ppmfree(&source);
+    return 0;
+}
+
+/* write_pyramid
+ * Purpose: Build the mip pyramid of the transformed image and write its
+ *          levels: with -out-format tiled, the image and every level as
+ *          tiled images one after the other in <prefix>.tiled; otherwise
+ *          level k as a P6 image in <prefix>-<k>.ppm
+ * Parameters: the parsed options, with pyramid_name set, the transformed
+ *             image, and the program name
+ * Returns: void
+ *
+ * Expected input: options accepted by Options_parse and the image the run
+ *                 wrote
+ * Success output: the level files; none if the image fits in one block
+ * Failure output: message written to stderr and exit_failure if a file
+ *                 cannot be opened
+ */
+void write_pyramid(Options *options, Pnm_ppm image, char *progname)
+{
+    uint64_t phase = Trace_begin();
+    int count;
+    Pnm_ppm *levels = Pyramid_build(image, &count);
+    Trace_end("pyramid", phase, count);
+
+    phase = Trace_begin();
+    char name[4096];
+    if (options->out_format == OUT_TILED) {
+        snprintf(name, sizeof(name), "%s.tiled", options->pyramid_name);
+        FILE *fp = open_output(name, progname);
+        Tiled_write(fp, image);
+        for (int k = 0; k < count; k++) {
+            Tiled_write(fp, levels[k]);
+        }
+        fclose(fp);
+    } else {
+        for (int k = 0; k < count; k++) {
+            snprintf(name, sizeof(name), "%s-%d.ppm", options->pyramid_name,
+                     k + 1);
+            FILE *fp = open_output(name, progname);
+            Ppmio_write(fp, levels[k]);
+            fclose(fp);
+        }
+    }
+    Trace_end("write", phase, count);
+
+    Pyramid_free(&levels, count);
+}
+
 /* write_timefile
  * Purpose: Write the time file that contains original image information
  *          and time spent associated with the image transformation
@@ -249,6 +686,28 @@ void write_timefile(FILE *output_fp, char *filename, Pnm_ppm image,
     fprintf(output_fp, "    Image has width %d and height %d\n", width, height);
     fprintf(output_fp, "    Width * height = %d\n", total_size);
     fprintf(output_fp, "    Recorded time: %f nanoseconds\n", time_used);
-    fprintf(output_fp, "    Time per input pixel: %f nanoseconds\n\n", 
+    fprintf(output_fp, "    Time per input pixel: %f nanoseconds\n", 
                                        time_used / (float)total_size);
+    write_memory(output_fp);
+}
+
+/* write_memory
+ * Purpose: Write the memory the suites and the transform have used so far
+ *          and the page faults of the process, ending a time file record
+ * Parameters: a file pointer for the output file
+ * Returns: void
+ *
+ * Expected input: a valid file pointer
+ * Success output: the memory line and a blank line appended to the file
+ * Failure output: none
+ */
+void write_memory(FILE *output_fp)
+{
+    MemStats stats;
+    MemStats_get(&stats);
+    fprintf(output_fp, "    Memory: peak %zu bytes, %zu live, %lu "
+                       "allocations\n", stats.peak_bytes, stats.live_bytes,
+                       stats.allocations);
+    fprintf(output_fp, "    Page faults: %ld minor, %ld major\n\n",
+            stats.minor_faults, stats.major_faults);
 }
\ No newline at end of file
@@ -0,0 +1,309 @@
+/**************************************************************
+ *
+ *                     pyramid.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of pyramids. A block at (bx, by) with sides
+ *     divisible by 2^n covers whole pixels of levels 1 to n, so its
+ *     share of those levels depends on its own pixels only: the
+ *     block is averaged 2x2 into the scratch buffer, which is then
+ *     averaged into itself for every further level, the cells of
+ *     each level being written out as they are computed. Reducing
+ *     in place is safe because cell (x, y) is written after every
+ *     cell it reads at (2x, 2y) and on has been read.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "a2methods.h"
+#include "a2blocked.h"
+#include "relayout.h"
+#include "ppmio.h"
+#include "memstats.h"
+#include "trace.h"
+#include "pyramid.h"
+
+/* the block side of the layout the image is put in when its own blocks
+ * cannot be reduced in place for at least MIN_BLOCK_LEVELS levels
+ */
+#define PYRAMID_BLOCK 64
+#define MIN_BLOCK_LEVELS 3
+
+/* Level is an image of the pyramid as the reduction sees it */
+typedef struct Level {
+        const struct A2Methods_T *methods;
+        A2Methods_UArray2 pixels;
+        int width, height;
+        int wide;               /* Pnm_rgb16 pixels */
+} Level;
+
+/* RGB is a pixel in the scratch buffer */
+typedef struct RGB {
+        unsigned red, green, blue;
+} RGB;
+
+/* even_levels
+ *    Purpose: how many times n can be halved evenly, at most 'limit'
+ */
+static int even_levels(int n, int limit)
+{
+        int levels = 0;
+        while (levels < limit && n % 2 == 0) {
+                n /= 2;
+                levels++;
+        }
+        return levels;
+}
+
+/* get_pixel
+ *    Purpose: read the cell at (i, j) of a level
+ */
+static inline RGB get_pixel(Level *level, int i, int j)
+{
+        void *cell = level->methods->at(level->pixels, i, j);
+        if (level->wide) {
+                Pnm_rgb16 pixel = cell;
+                return (RGB){ pixel->red, pixel->green, pixel->blue };
+        }
+        Pnm_rgb pixel = cell;
+        return (RGB){ pixel->red, pixel->green, pixel->blue };
+}
+
+/* put_pixel
+ *    Purpose: write the cell at (i, j) of a level
+ */
+static inline void put_pixel(Level *level, int i, int j, RGB rgb)
+{
+        void *cell = level->methods->at(level->pixels, i, j);
+        if (level->wide) {
+                Pnm_rgb16 pixel = cell;
+                pixel->red = rgb.red;
+                pixel->green = rgb.green;
+                pixel->blue = rgb.blue;
+        } else {
+                Pnm_rgb pixel = cell;
+                pixel->red = rgb.red;
+                pixel->green = rgb.green;
+                pixel->blue = rgb.blue;
+        }
+}
+
+/* average
+ *    Purpose: the rounded average of the n pixels summed in 'sum'
+ */
+static inline RGB average(RGB sum, unsigned n)
+{
+        return (RGB){ (sum.red + n / 2) / n, (sum.green + n / 2) / n,
+                      (sum.blue + n / 2) / n };
+}
+
+/* add
+ *    Purpose: add a pixel into a sum
+ */
+static inline void add(RGB *sum, RGB rgb)
+{
+        sum->red += rgb.red;
+        sum->green += rgb.green;
+        sum->blue += rgb.blue;
+}
+
+/* reduce_block
+ *    Purpose: compute the share of levels 1 .. n of the block at (bx, by)
+ *             of the image, which is bw x bh cells clipped to the image,
+ *             using 'scratch' of (bw / 2) x (bh / 2) pixels
+ */
+static void reduce_block(Level *image, Level *levels, int n, int bx, int by,
+                         int bw, int bh, RGB *scratch)
+{
+        int stride = bw / 2;
+        int w = bw < image->width - bx ? bw : image->width - bx;
+        int h = bh < image->height - by ? bh : image->height - by;
+
+        /* level 1 from the image's cells */
+        int cw = (w + 1) / 2, ch = (h + 1) / 2;
+        for (int y = 0; y < ch; y++) {
+                for (int x = 0; x < cw; x++) {
+                        RGB sum = { 0, 0, 0 };
+                        unsigned count = 0;
+                        for (int dy = 0; dy < 2 && 2 * y + dy < h; dy++) {
+                                for (int dx = 0; dx < 2 && 2 * x + dx < w;
+                                     dx++) {
+                                        add(&sum, get_pixel(image,
+                                                            bx + 2 * x + dx,
+                                                            by + 2 * y + dy));
+                                        count++;
+                                }
+                        }
+                        RGB rgb = average(sum, count);
+                        scratch[y * stride + x] = rgb;
+                        put_pixel(&levels[0], bx / 2 + x, by / 2 + y, rgb);
+                }
+        }
+
+        /* levels 2 .. n from the scratch buffer, in place */
+        for (int k = 2; k <= n; k++) {
+                w = cw;
+                h = ch;
+                cw = (w + 1) / 2;
+                ch = (h + 1) / 2;
+                for (int y = 0; y < ch; y++) {
+                        for (int x = 0; x < cw; x++) {
+                                RGB sum = { 0, 0, 0 };
+                                unsigned count = 0;
+                                for (int dy = 0; dy < 2 && 2 * y + dy < h;
+                                     dy++) {
+                                        for (int dx = 0;
+                                             dx < 2 && 2 * x + dx < w; dx++) {
+                                                add(&sum, scratch[(2 * y + dy)
+                                                                  * stride
+                                                                  + 2 * x
+                                                                  + dx]);
+                                                count++;
+                                        }
+                                }
+                                RGB rgb = average(sum, count);
+                                scratch[y * stride + x] = rgb;
+                                put_pixel(&levels[k - 1], (bx >> k) + x,
+                                          (by >> k) + y, rgb);
+                        }
+                }
+        }
+}
+
+/* reduce_level
+ *    Purpose: compute a whole level from the level above it
+ */
+static void reduce_level(Level *from, Level *to)
+{
+        for (int y = 0; y < to->height; y++) {
+                for (int x = 0; x < to->width; x++) {
+                        RGB sum = { 0, 0, 0 };
+                        unsigned count = 0;
+                        for (int dy = 0; dy < 2 && 2 * y + dy < from->height;
+                             dy++) {
+                                for (int dx = 0;
+                                     dx < 2 && 2 * x + dx < from->width;
+                                     dx++) {
+                                        add(&sum, get_pixel(from, 2 * x + dx,
+                                                            2 * y + dy));
+                                        count++;
+                                }
+                        }
+                        put_pixel(to, x, y, average(sum, count));
+                }
+        }
+}
+
+/* Pyramid_build
+ * Purpose: Build the levels of an image's mip pyramid in one pass over its
+ *          blocks
+ * Parameters: the image and where to put the number of levels
+ * Returns: the levels 1 and down, or NULL if the image fits in one block
+ *
+ * Expected input: an image of Pnm_rgb or Pnm_rgb16 pixels and a non-null
+ *                 count
+ * Success output: none; the image may be laid out in other blocks
+ * Failure output: CRE if memory runs out
+ */
+Pnm_ppm *Pyramid_build(Pnm_ppm image, int *count)
+{
+        assert(image != NULL && count != NULL);
+        int size = image->methods->size(image->pixels);
+        assert(size == sizeof(struct Pnm_rgb) ||
+               size == sizeof(struct Pnm_rgb16));
+
+        int bw = 1, bh = 1;
+        if (A2_is_blocked(image->methods)) {
+                image->methods->block_shape(image->pixels, &bw, &bh);
+        }
+        if (even_levels(bw, MIN_BLOCK_LEVELS) < MIN_BLOCK_LEVELS ||
+            even_levels(bh, MIN_BLOCK_LEVELS) < MIN_BLOCK_LEVELS) {
+                A2_relayout_ppm(image, uarray2_methods_blocked,
+                                PYRAMID_BLOCK, PYRAMID_BLOCK);
+                image->methods->block_shape(image->pixels, &bw, &bh);
+        }
+        const struct A2Methods_T *methods = image->methods;
+
+        /* down to the first level that fits in one block */
+        int n = 0;
+        for (int w = image->width, h = image->height; w > bw || h > bh;
+             w = (w + 1) / 2, h = (h + 1) / 2) {
+                n++;
+        }
+        *count = n;
+        if (n == 0) {
+                return NULL;
+        }
+
+        Level top = { methods, image->pixels, image->width, image->height,
+                      size == sizeof(struct Pnm_rgb16) };
+        Level *levels = MemStats_malloc(n * sizeof(Level));
+        Pnm_ppm *pyramid = ALLOC(n * sizeof(Pnm_ppm));
+        for (int k = 0; k < n; k++) {
+                Level *above = k == 0 ? &top : &levels[k - 1];
+                levels[k] = top;
+                levels[k].width = (above->width + 1) / 2;
+                levels[k].height = (above->height + 1) / 2;
+                levels[k].pixels = methods->new_with_block_shape(
+                                levels[k].width, levels[k].height, size, bw,
+                                bh);
+                NEW(pyramid[k]);
+                pyramid[k]->width = levels[k].width;
+                pyramid[k]->height = levels[k].height;
+                pyramid[k]->denominator = image->denominator;
+                pyramid[k]->pixels = levels[k].pixels;
+                pyramid[k]->methods = methods;
+        }
+
+        /* the one pass over the image's blocks */
+        int in_block = even_levels(bw, n);
+        int in_block_h = even_levels(bh, n);
+        in_block = in_block < in_block_h ? in_block : in_block_h;
+        if (in_block > 0) {
+                size_t scratch_bytes = (size_t)(bw / 2) * (bh / 2)
+                                       * sizeof(RGB);
+                RGB *scratch = MemStats_malloc(scratch_bytes);
+                for (int by = 0; by < top.height; by += bh) {
+                        uint64_t start = Trace_begin();
+                        for (int bx = 0; bx < top.width; bx += bw) {
+                                reduce_block(&top, levels, in_block, bx, by,
+                                             bw, bh, scratch);
+                        }
+                        Trace_end("pyramid", start, by / bh);
+                }
+                MemStats_free(scratch, scratch_bytes);
+        }
+
+        for (int k = in_block; k < n; k++) {
+                reduce_level(k == 0 ? &top : &levels[k - 1], &levels[k]);
+        }
+        MemStats_free(levels, n * sizeof(Level));
+        return pyramid;
+}
+
+/* Pyramid_free
+ * Purpose: Free the levels of a pyramid
+ * Parameters: a pointer to the levels and their number
+ * Returns: void
+ *
+ * Expected input: levels from Pyramid_build, or NULL with a count of 0
+ * Success output: none
+ * Failure output: none
+ */
+void Pyramid_free(Pnm_ppm **levels, int count)
+{
+        assert(levels != NULL);
+        for (int k = 0; k < count; k++) {
+                Pnm_ppmfree(&(*levels)[k]);
+        }
+        if (*levels != NULL) {
+                FREE(*levels);
+        }
+}
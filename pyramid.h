@@ -0,0 +1,40 @@
+/**************************************************************
+ *
+ *                     pyramid.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Mip pyramids of images in blocked layout. Level k of the
+ *     pyramid of an image is 1/2^k of its size (rounded up), each
+ *     pixel the rounded average of the up to 2x2 pixels of level
+ *     k - 1 it covers, level 0 being the image. The levels go down
+ *     to the first one that fits in a single block.
+ *
+ *     The image is walked once, block by block. A block whose
+ *     sides are divisible by 2^n yields its share of levels 1 to n
+ *     while it is in cache, each level reduced from the last in a
+ *     small scratch buffer; only the levels below that, which are
+ *     at most 1/4^n of the image, are reduced from whole arrays.
+ *
+ **************************************************************/
+
+#ifndef __PYRAMID__
+#define __PYRAMID__
+
+#include "pnm.h"
+
+/* Build levels 1 and down of the pyramid of 'image', whose pixels are
+ * Pnm_rgb or Pnm_rgb16. The image is first laid out in 64x64 blocks
+ * unless its blocks' sides are multiples of 8 already. Returns the levels,
+ * in the image's blocked suite and block shape, and their number in
+ * *count; NULL and 0 if the image fits in one block
+ */
+extern Pnm_ppm *Pyramid_build(Pnm_ppm image, int *count);
+
+/* Free the levels from Pyramid_build and the array holding them */
+extern void Pyramid_free(Pnm_ppm **levels, int count);
+
+#endif /* __PYRAMID__ */
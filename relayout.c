@@ -0,0 +1,248 @@
+/**************************************************************
+ *
+ *                     relayout.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the bulk relayout. A row of a plain array
+ *     is contiguous, and within a block of a blocked array each
+ *     of its rows is contiguous too, so every row of a block row
+ *     is a run of spans, each one block wide, that can be copied
+ *     with memcpy. Block rows are independent and are split
+ *     among threads when the array is large.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "assert.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "uarray2b.h"
+#include "relayout.h"
+#include "trace.h"
+
+/* arrays with fewer cells are converted on the calling thread */
+#define PARALLEL_CELLS (1 << 18)
+#define MAX_THREADS 8
+
+/* Span is the work of one thread: block rows first .. last - 1 */
+typedef struct Span {
+        A2Methods_UArray2 plain, blocked;
+        int to_blocked;                 /* direction of the copy */
+        int first, last;
+        pthread_t thread;
+} Span;
+
+/* CopyData is the closure for copying cell by cell */
+typedef struct CopyData {
+        A2Methods_UArray2 source;
+        const struct A2Methods_T *source_methods;
+        int size;
+} CopyData;
+
+static void *copy_block_rows(void *cl);
+static void copy_cell(int i, int j, A2Methods_UArray2 array2,
+                      A2Methods_Object *ptr, void *cl);
+
+/* A2_new_shaped
+ * Purpose: Make an array whose blocks, if it has any, have a given shape
+ * Parameters: the suite, the width, height and cell size of the array, and
+ *             the columns and rows of a block, or 0 and 0 for the
+ *             suite's default blocks
+ * Returns: the new array
+ *
+ * Expected input: a non-null suite and a shape that is 0 by 0 or has
+ *                 both sides positive
+ * Success output: none
+ * Failure output: CRE if memory runs out
+ */
+A2Methods_UArray2 A2_new_shaped(A2Methods_T methods, int width, int height,
+                                int size, int block_width, int block_height)
+{
+        assert(methods != NULL);
+        if (block_width == 0 && block_height == 0) {
+                return methods->new(width, height, size);
+        }
+        return methods->new_with_block_shape(width, height, size,
+                                             block_width, block_height);
+}
+
+/* A2_relayout
+ * Purpose: Copy an array into a new array of another methods suite, or of
+ *          the same suite with other blocks
+ * Parameters: the source array's suite, the source array, the suite of
+ *             the copy and the shape of its blocks as for A2_new_shaped
+ * Returns: the copy
+ *
+ * Expected input: a non-null array of a non-null suite, a suite and a
+ *                 shape A2_new_shaped accepts
+ * Success output: none
+ * Failure output: CRE if memory runs out
+ */
+A2Methods_UArray2 A2_relayout(const struct A2Methods_T *src_methods,
+                              A2Methods_UArray2 src, A2Methods_T dst_methods,
+                              int block_width, int block_height)
+{
+        assert(src_methods != NULL && src != NULL && dst_methods != NULL);
+
+        int width = src_methods->width(src);
+        int height = src_methods->height(src);
+        int size = src_methods->size(src);
+        A2Methods_UArray2 dst = A2_new_shaped(dst_methods, width, height,
+                                              size, block_width,
+                                              block_height);
+
+        int to_blocked = src_methods == uarray2_methods_plain &&
+                         A2_is_blocked(dst_methods);
+        int to_plain = A2_is_blocked(src_methods) &&
+                       dst_methods == uarray2_methods_plain;
+        if (!to_blocked && !to_plain) {
+                CopyData copy_data = { src, src_methods, size };
+                dst_methods->map_default(dst, copy_cell, &copy_data);
+                return dst;
+        }
+
+        A2Methods_UArray2 blocked = to_blocked ? dst : src;
+        int rows_per_block = UArray2b_block_height(blocked);
+        int block_rows = (height + rows_per_block - 1) / rows_per_block;
+
+        int nthreads = 1;
+        if ((long)width * height >= PARALLEL_CELLS) {
+                long online = sysconf(_SC_NPROCESSORS_ONLN);
+                nthreads = online < 1 ? 1
+                         : online > MAX_THREADS ? MAX_THREADS : online;
+        }
+        if (nthreads > block_rows) {
+                nthreads = block_rows;
+        }
+
+        Span spans[MAX_THREADS];
+        for (int t = 0; t < nthreads; t++) {
+                spans[t].plain = to_blocked ? src : dst;
+                spans[t].blocked = blocked;
+                spans[t].to_blocked = to_blocked;
+                spans[t].first = (long)block_rows * t / nthreads;
+                spans[t].last = (long)block_rows * (t + 1) / nthreads;
+                if (t > 0) {
+                        int rc = pthread_create(&spans[t].thread, NULL,
+                                                copy_block_rows, &spans[t]);
+                        assert(rc == 0);
+                }
+        }
+        copy_block_rows(&spans[0]);
+        for (int t = 1; t < nthreads; t++) {
+                pthread_join(spans[t].thread, NULL);
+        }
+        return dst;
+}
+
+/* A2_is_blocked
+ * Purpose: Tell whether a suite's arrays are UArray2b arrays
+ * Parameters: the suite
+ * Returns: 1 if they are and 0 otherwise
+ *
+ * Expected input: a non-null suite
+ * Success output: none
+ * Failure output: none
+ */
+int A2_is_blocked(const struct A2Methods_T *methods)
+{
+        assert(methods != NULL);
+        return methods == uarray2_methods_blocked;
+}
+
+/* A2_relayout_ppm
+ * Purpose: Move an image's pixels into an array of another suite, or into
+ *          blocks of another shape
+ * Parameters: the image, the suite it should use and the shape of its
+ *             blocks as for A2_new_shaped
+ * Returns: void
+ *
+ * Expected input: a valid image, a suite and a shape A2_new_shaped accepts
+ * Success output: none
+ * Failure output: CRE if memory runs out
+ */
+void A2_relayout_ppm(Pnm_ppm pixmap, A2Methods_T methods, int block_width,
+                     int block_height)
+{
+        assert(pixmap != NULL && methods != NULL);
+        if (pixmap->methods == methods) {
+                int old_width, old_height;
+                methods->block_shape(pixmap->pixels, &old_width,
+                                     &old_height);
+                if (!A2_is_blocked(methods) ||
+                    (block_width == 0 && block_height == 0) ||
+                    (block_width == old_width &&
+                     block_height == old_height)) {
+                        return;
+                }
+        }
+        A2Methods_UArray2 pixels = A2_relayout(pixmap->methods,
+                                               pixmap->pixels, methods,
+                                               block_width, block_height);
+        pixmap->methods->free(&pixmap->pixels);
+        pixmap->pixels = pixels;
+        pixmap->methods = methods;
+}
+
+/* copy_block_rows
+ *    Purpose: copy a range of block rows between a plain and a blocked
+ *             array, one block-wide span of a row per memcpy
+ *    Returns: NULL, so it can be a thread body
+ */
+static void *copy_block_rows(void *cl)
+{
+        Span *span = cl;
+        A2Methods_UArray2 plain = span->plain;
+        A2Methods_UArray2 blocked = span->blocked;
+        int width = UArray2b_width(blocked);
+        int height = UArray2b_height(blocked);
+        int size = UArray2b_size(blocked);
+        int block_width = UArray2b_block_width(blocked);
+        int block_height = UArray2b_block_height(blocked);
+        char *data = uarray2_methods_plain->data(plain);
+        int stride = uarray2_methods_plain->stride(plain);
+        uint64_t start = Trace_begin();
+
+        for (int br = span->first; br < span->last; br++) {
+                int j_end = (br + 1) * block_height < height
+                            ? (br + 1) * block_height : height;
+                for (int j = br * block_height; j < j_end; j++) {
+                        char *row = data + (size_t)j * stride;
+                        for (int i = 0; i < width; i += block_width) {
+                                int cells = i + block_width < width
+                                            ? block_width : width - i;
+                                char *cell = UArray2b_at(blocked, i, j);
+                                if (span->to_blocked) {
+                                        memcpy(cell, row + (size_t)i * size,
+                                               (size_t)cells * size);
+                                } else {
+                                        memcpy(row + (size_t)i * size, cell,
+                                               (size_t)cells * size);
+                                }
+                        }
+                }
+        }
+        Trace_end("relayout", start, span->first);
+        return NULL;
+}
+
+/* copy_cell
+ *    Purpose: apply function that copies the cell at (i, j) of the source
+ *             array in the CopyData closure into this cell
+ */
+static void copy_cell(int i, int j, A2Methods_UArray2 array2,
+                      A2Methods_Object *ptr, void *cl)
+{
+        (void)array2;
+        CopyData *copy_data = cl;
+        memcpy(ptr, copy_data->source_methods->at(copy_data->source, i, j),
+               copy_data->size);
+}
@@ -0,0 +1,49 @@
+/**************************************************************
+ *
+ *                     relayout.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Bulk conversion of a 2D array from one methods suite to
+ *     another. Between the plain and blocked suites, whole spans
+ *     of a row (one block wide) are copied with memcpy, block row
+ *     by block row, in parallel on large arrays, instead of one
+ *     'at' call per cell. Any other pair of suites is copied
+ *     cell by cell.
+ *
+ **************************************************************/
+
+#ifndef __RELAYOUT__
+#define __RELAYOUT__
+
+#include "a2methods.h"
+#include "pnm.h"
+
+/* A new array of 'methods' with blocks of 'block_width' by 'block_height'
+ * cells if the suite is blocked. 0 by 0 gives the suite's default blocks
+ */
+A2Methods_UArray2 A2_new_shaped(A2Methods_T methods, int width, int height,
+                                int size, int block_width, int block_height);
+
+/* A new array of 'dst_methods' holding the same cells as 'src', which
+ * belongs to 'src_methods' and is left unchanged. The copy's blocks are
+ * shaped as for A2_new_shaped
+ */
+A2Methods_UArray2 A2_relayout(const struct A2Methods_T *src_methods,
+                              A2Methods_UArray2 src, A2Methods_T dst_methods,
+                              int block_width, int block_height);
+
+/* 1 if the suite's arrays are UArray2b arrays */
+int A2_is_blocked(const struct A2Methods_T *methods);
+
+/* Move an image's pixels to 'methods', with blocks shaped as for
+ * A2_new_shaped, freeing the old array. Nothing is done if the image
+ * already uses 'methods' and, when a shape is given, has that shape
+ */
+void A2_relayout_ppm(Pnm_ppm pixmap, A2Methods_T methods, int block_width,
+                     int block_height);
+
+#endif /* __RELAYOUT__ */
@@ -0,0 +1,520 @@
+/**************************************************************
+ *
+ *                     server.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the ppmtrans server interface. Every
+ *     worker thread blocks in accept() and serves whole
+ *     connections. Freed pixel arrays stay in the heap rather than
+ *     going back to the kernel, so the next request reuses pages
+ *     that are already mapped instead of faulting in fresh ones.
+ *
+ **************************************************************/
+
+#define _GNU_SOURCE     /* openat flags */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "assert.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "options.h"
+#include "memstats.h"
+#include "server.h"
+
+#define MAX_REQUEST (64 * 1024)
+#define MAX_ARGS 64
+#define MAX_FDS 3
+#define REPLY_MAX 512
+
+enum { FD_INPUT, FD_OUTPUT, FD_DIRECTORY };
+
+/* Request is one decoded request: its arguments and the descriptors
+ * that came with it (-1 where none was sent)
+ */
+typedef struct Request {
+        char *payload;
+        int argc;
+        char *argv[MAX_ARGS + 1];
+        int fds[MAX_FDS];
+} Request;
+
+static void *serve_worker(void *cl);
+static void serve_connection(int conn);
+static int recv_request(int conn, Request *request);
+static void free_request(Request *request);
+static void handle_request(Request *request, char *reply);
+static int send_message(int sock, const char *data, uint32_t length,
+                        const int *fds, int nfds);
+static int read_full(int fd, void *buf, size_t length);
+
+static double now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Server_run
+ * Purpose: Accept and serve requests on a Unix domain socket forever
+ * Parameters: the socket path, which is replaced if it exists, and the
+ *             number of worker threads (0 for one per online CPU)
+ * Returns: 1 if the socket cannot be created; otherwise never returns
+ *
+ * Expected input: a path the process may create
+ * Success output: none
+ * Failure output: a message on stderr if the socket cannot be created
+ */
+int Server_run(const char *socket_path, int workers)
+{
+        assert(socket_path != NULL);
+        if (workers < 1) {
+                workers = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        if (workers < 1) {
+                workers = 1;
+        }
+
+        /* keep freed pixel arrays in the workers' heaps, never trimmed or
+         * unmapped, so the next request reuses them warm; each worker
+         * keeps its own arena, so they do not contend on one malloc lock
+         */
+        mallopt(M_MMAP_MAX, 0);
+        mallopt(M_TRIM_THRESHOLD, -1);
+
+        signal(SIGPIPE, SIG_IGN);
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+                fprintf(stderr, "socket path too long: %s\n", socket_path);
+                return 1;
+        }
+        strcpy(addr.sun_path, socket_path);
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path);
+        if (listener < 0 ||
+            bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(listener, SOMAXCONN) != 0) {
+                fprintf(stderr, "cannot serve on %s: %s\n", socket_path,
+                                                         strerror(errno));
+                return 1;
+        }
+
+        pthread_t *threads = malloc(workers * sizeof(pthread_t));
+        assert(threads != NULL);
+        for (int t = 0; t < workers; t++) {
+                int rc = pthread_create(&threads[t], NULL, serve_worker,
+                                        &listener);
+                assert(rc == 0);
+        }
+        for (int t = 0; t < workers; t++) {
+                pthread_join(threads[t], NULL);
+        }
+        free(threads);
+        return 0;
+}
+
+/* Client_run
+ * Purpose: Send one request to a server and report its reply
+ * Parameters: the socket path and the ppmtrans arguments to send
+ * Returns: 0 if the server reported "ok" and 1 otherwise
+ *
+ * Expected input: a socket a server is listening on
+ * Success output: the reply on standard error; the image is written by
+ *                 the server straight to this process's standard output
+ * Failure output: a message on standard error
+ */
+int Client_run(const char *socket_path, int argc, char *argv[])
+{
+        assert(socket_path != NULL);
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0 ||
+            connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+                fprintf(stderr, "cannot connect to %s: %s\n", socket_path,
+                                                           strerror(errno));
+                return 1;
+        }
+
+        char *payload = malloc(MAX_REQUEST);
+        assert(payload != NULL);
+        uint32_t length = 0;
+        for (int i = 0; i < argc; i++) {
+                size_t n = strlen(argv[i]) + 1;
+                if (length + n > MAX_REQUEST || i == MAX_ARGS) {
+                        fprintf(stderr, "request too long\n");
+                        return 1;
+                }
+                memcpy(payload + length, argv[i], n);
+                length += n;
+        }
+
+        int fds[MAX_FDS] = { STDIN_FILENO, STDOUT_FILENO,
+                             open(".", O_RDONLY | O_DIRECTORY) };
+        int ok = send_message(sock, payload, length, fds,
+                              fds[FD_DIRECTORY] < 0 ? 2 : 3);
+        free(payload);
+
+        char reply[REPLY_MAX + 1];
+        uint32_t reply_length;
+        if (!ok || !read_full(sock, &reply_length, sizeof(reply_length)) ||
+            reply_length > REPLY_MAX ||
+            !read_full(sock, reply, reply_length)) {
+                fprintf(stderr, "no reply from %s\n", socket_path);
+                return 1;
+        }
+        reply[reply_length] = '\0';
+        fprintf(stderr, "%s\n", reply);
+        close(sock);
+
+        return strstr(reply, "\"status\":\"ok\"") != NULL ? 0 : 1;
+}
+
+/* serve_worker
+ *    Purpose: thread body: accept connections and serve each until the
+ *             client closes it
+ */
+static void *serve_worker(void *cl)
+{
+        int listener = *(int *)cl;
+        for (;;) {
+                int conn = accept(listener, NULL, NULL);
+                if (conn < 0) {
+                        continue;
+                }
+                serve_connection(conn);
+                close(conn);
+        }
+        return NULL;
+}
+
+/* serve_connection
+ *    Purpose: answer requests on one connection until it is closed
+ */
+static void serve_connection(int conn)
+{
+        Request request;
+        char reply[REPLY_MAX];
+
+        while (recv_request(conn, &request)) {
+                handle_request(&request, reply);
+                int ok = send_message(conn, reply, strlen(reply), NULL, 0);
+                free_request(&request);
+                if (!ok) {
+                        break;
+                }
+        }
+}
+
+/* open_at
+ *    Purpose: open a file named in a request, relative to the client's
+ *             directory when it sent one
+ *    Returns: a stream, or NULL if the file cannot be opened
+ */
+static FILE *open_at(Request *request, const char *name, int output)
+{
+        int flags = output ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+        int dir = request->fds[FD_DIRECTORY] >= 0 ? request->fds[FD_DIRECTORY]
+                                                  : AT_FDCWD;
+        int fd = openat(dir, name, flags, 0666);
+        if (fd < 0) {
+                return NULL;
+        }
+        return fdopen(fd, output ? "w" : "r");
+}
+
+/* open_passed
+ *    Purpose: open a stream on a copy of a descriptor sent by the client
+ *    Returns: a stream, or NULL if no such descriptor was sent
+ */
+static FILE *open_passed(Request *request, int which, const char *mode)
+{
+        if (request->fds[which] < 0) {
+                return NULL;
+        }
+        int fd = dup(request->fds[which]);
+        return fd < 0 ? NULL : fdopen(fd, mode);
+}
+
+/* reply_error
+ *    Purpose: write an error reply, replacing characters that would need
+ *             escaping in a JSON string
+ */
+static void reply_error(char *reply, const char *message)
+{
+        char clean[REPLY_MAX / 2];
+        size_t k;
+        for (k = 0; message[k] != '\0' && k < sizeof(clean) - 1; k++) {
+                char c = message[k];
+                clean[k] = (c == '"' || c == '\\' || c < ' ') ? '\'' : c;
+        }
+        clean[k] = '\0';
+        snprintf(reply, REPLY_MAX, "{\"status\":\"error\",\"error\":\"%s\"}",
+                 clean);
+}
+
+/* handle_request
+ *    Purpose: run one request and write its JSON reply into 'reply'
+ */
+static void handle_request(Request *request, char *reply)
+{
+        double start = now_ns();
+        MemStats before;
+        MemStats_get_thread(&before);
+        Options options;
+        Options_init(&options);
+
+        if (!Options_parse(&options, request->argc, request->argv)) {
+                reply_error(reply, options.error);
+                return;
+        }
+        if (options.time_file_name != NULL) {
+                reply_error(reply, "-time is reported in the reply");
+                return;
+        }
+        if (options.trace_file_name != NULL) {
+                reply_error(reply, "-trace is not supported by the server");
+                return;
+        }
+        if (options.cache_dir != NULL || options.memory_limit > 0 ||
+            options.update_name != NULL || options.stream ||
+            options.io != PPMIO_ASYNC || options.emit_count > 0 ||
+            options.pyramid_name != NULL) {
+                reply_error(reply, "-cache, -memory-limit, -update, "
+                                   "-stream, -io, -emit and -pyramid are "
+                                   "not supported by the server");
+                return;
+        }
+
+        FILE *input_fp = options.filename != NULL
+                ? open_at(request, options.filename, 0)
+                : open_passed(request, FD_INPUT, "r");
+        if (input_fp == NULL) {
+                reply_error(reply, "cannot open input");
+                return;
+        }
+
+        /* no TRY here: the exception stack is shared by all threads */
+        Pnm_ppm image = Ppmio_read_checked(input_fp, options.methods,
+                                           options.block_width,
+                                           options.block_height);
+        fclose(input_fp);
+        if (image == NULL) {
+                reply_error(reply, "input is not a PPM or tiled image");
+                return;
+        }
+        Options_plan(&options, image);
+        double read_done = now_ns();
+
+        double cpu_time;
+        image = Options_transform(&options, image, &cpu_time);
+        double transform_done = now_ns();
+
+        FILE *output_fp = options.output_name != NULL
+                ? open_at(request, options.output_name, 1)
+                : open_passed(request, FD_OUTPUT, "w");
+        if (output_fp == NULL) {
+                Pnm_ppmfree(&image);
+                reply_error(reply, "cannot open output");
+                return;
+        }
+        Options_write(&options, output_fp, image);
+        fclose(output_fp);
+        double write_done = now_ns();
+        MemStats after;
+        MemStats_get_thread(&after);
+
+        snprintf(reply, REPLY_MAX,
+                 "{\"status\":\"ok\",\"width\":%u,\"height\":%u,"
+                 "\"read_ns\":%.0f,\"transform_ns\":%.0f,"
+                 "\"write_ns\":%.0f,\"total_ns\":%.0f,"
+                 "\"allocations\":%lu,\"minor_faults\":%ld,"
+                 "\"major_faults\":%ld,\"plan\":\"%s\"}",
+                 image->width, image->height, read_done - start,
+                 transform_done - read_done, write_done - transform_done,
+                 write_done - start,
+                 after.allocations - before.allocations,
+                 after.minor_faults - before.minor_faults,
+                 after.major_faults - before.major_faults,
+                 options.plan != NULL ? options.plan : "");
+        Pnm_ppmfree(&image);
+}
+
+/* recv_request
+ *    Purpose: receive one request and any descriptors sent with it
+ *    Returns: 1 on success and 0 if the connection closed or the request
+ *             is malformed, in which case whatever came with it is
+ *             already released
+ */
+static int recv_request(int conn, Request *request)
+{
+        uint32_t length;
+        union {
+                char buf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+                struct cmsghdr align;
+        } control;
+        struct iovec iov = { &length, sizeof(length) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        for (int k = 0; k < MAX_FDS; k++) {
+                request->fds[k] = -1;
+        }
+        request->payload = NULL;
+
+        ssize_t n = recvmsg(conn, &msg, MSG_WAITALL);
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL;
+             c = CMSG_NXTHDR(&msg, c)) {
+                if (c->cmsg_level == SOL_SOCKET &&
+                    c->cmsg_type == SCM_RIGHTS) {
+                        int count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                        for (int k = 0; k < count; k++) {
+                                int fd;
+                                memcpy(&fd, CMSG_DATA(c) + k * sizeof(int),
+                                       sizeof(int));
+                                if (k < MAX_FDS) {
+                                        request->fds[k] = fd;
+                                } else {
+                                        close(fd);
+                                }
+                        }
+                }
+        }
+        if (n != sizeof(length) || length > MAX_REQUEST) {
+                free_request(request);
+                return 0;
+        }
+
+        request->payload = malloc(length + 1);
+        assert(request->payload != NULL);
+        if (!read_full(conn, request->payload, length)) {
+                free_request(request);
+                return 0;
+        }
+        request->payload[length] = '\0';
+
+        /* split the NUL-terminated arguments behind a program name */
+        request->argv[0] = "ppmtrans";
+        request->argc = 1;
+        for (uint32_t pos = 0; pos < length;
+             pos += strlen(request->payload + pos) + 1) {
+                if (request->argc == MAX_ARGS) {
+                        free_request(request);
+                        return 0;
+                }
+                request->argv[request->argc++] = request->payload + pos;
+        }
+        request->argv[request->argc] = NULL;
+        return 1;
+}
+
+/* free_request
+ *    Purpose: close the descriptors that came with a request and free its
+ *             payload
+ */
+static void free_request(Request *request)
+{
+        for (int k = 0; k < MAX_FDS; k++) {
+                if (request->fds[k] >= 0) {
+                        close(request->fds[k]);
+                        request->fds[k] = -1;
+                }
+        }
+        free(request->payload);
+        request->payload = NULL;
+}
+
+/* send_message
+ *    Purpose: send a length-prefixed message, with descriptors if any
+ *    Returns: 1 on success and 0 on failure
+ */
+static int send_message(int sock, const char *data, uint32_t length,
+                        const int *fds, int nfds)
+{
+        union {
+                char buf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+                struct cmsghdr align;
+        } control;
+        struct iovec iov[2] = { { &length, sizeof(length) },
+                                { (void *)data, length } };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+
+        if (nfds > 0) {
+                memset(&control, 0, sizeof(control));
+                msg.msg_control = control.buf;
+                msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+                struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+                c->cmsg_level = SOL_SOCKET;
+                c->cmsg_type = SCM_RIGHTS;
+                c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+                memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+        }
+
+        ssize_t total = sizeof(length) + length;
+        ssize_t sent = sendmsg(sock, &msg, 0);
+        if (sent < (ssize_t)sizeof(length)) {
+                return 0;
+        }
+        /* a short send can only cut the data; finish it without fds */
+        while (sent < total) {
+                size_t done = sent - sizeof(length);
+                ssize_t n = write(sock, data + done, length - done);
+                if (n <= 0) {
+                        return 0;
+                }
+                sent += n;
+        }
+        return 1;
+}
+
+/* read_full
+ *    Purpose: read exactly 'length' bytes
+ *    Returns: 1 on success and 0 on end of file or error
+ */
+static int read_full(int fd, void *buf, size_t length)
+{
+        char *p = buf;
+        while (length > 0) {
+                ssize_t n = read(fd, p, length);
+                if (n <= 0) {
+                        if (n < 0 && errno == EINTR) {
+                                continue;
+                        }
+                        return 0;
+                }
+                p += n;
+                length -= n;
+        }
+        return 1;
+}
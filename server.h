@@ -0,0 +1,49 @@
+/**************************************************************
+ *
+ *                     server.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The ppmtrans server interface. A server keeps a pool of
+ *     worker threads and warm heap memory alive between requests,
+ *     so a small image costs only its transform instead of a
+ *     process start.
+ *
+ *     Protocol (Unix domain stream socket, any number of requests
+ *     per connection):
+ *       request  a 32-bit length in host order, then that many bytes
+ *                of NUL-terminated ppmtrans arguments. The message may
+ *                carry, with SCM_RIGHTS, up to three descriptors: the
+ *                input image, the output image, and the directory that
+ *                relative file names in the arguments are resolved in.
+ *                A file name argument replaces the input descriptor,
+ *                and -output replaces the output descriptor
+ *       reply    a 32-bit length in host order, then one line of JSON
+ *                with "status" ("ok" or "error"), "error" when it
+ *                failed, and the output size and read, transform,
+ *                write and total wall-clock times in nanoseconds. Then
+ *                the "allocations" made and page faults taken while
+ *                serving, both by the serving worker thread only (not
+ *                the I/O, relayout or transform threads it used), and
+ *                the "plan" -auto chose, empty without -auto
+ *
+ **************************************************************/
+
+#ifndef __SERVER__
+#define __SERVER__
+
+/* Serve on the socket at 'socket_path' with 'workers' threads (0 for one
+ * per CPU). Returns only if the socket cannot be set up
+ */
+int Server_run(const char *socket_path, int workers);
+
+/* Send one request with ppmtrans arguments argv[0] .. argv[argc - 1],
+ * passing standard input, standard output and the current directory.
+ * The reply is printed on standard error; returns 0 if it was "ok"
+ */
+int Client_run(const char *socket_path, int argc, char *argv[]);
+
+#endif /* __SERVER__ */
@@ -0,0 +1,271 @@
+/**************************************************************
+ *
+ *                     tiled.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the tiled image format. A file read from
+ *     the start of a regular file is mapped privately and wrapped
+ *     in a UArray2b whose release function unmaps it; any other
+ *     stream is read into memory with one fread.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "a2blocked.h"
+#include "uarray2b.h"
+#include "ppmio.h"
+#include "relayout.h"
+#include "memstats.h"
+#include "tiled.h"
+
+/* Mapping is the release closure for storage inside a mapped file */
+typedef struct Mapping {
+        void *base;
+        size_t length;
+} Mapping;
+
+static int check_header(const TiledHeader *header);
+static int block_height(const TiledHeader *header);
+static void *map_file(FILE *fp, const TiledHeader *header,
+                      Mapping **mapping);
+static void *read_data(FILE *fp, const TiledHeader *header);
+static void unmap_storage(void *storage, void *cl);
+static void free_storage(void *storage, void *cl);
+
+/* Tiled_read
+ * Purpose: Read a tiled image, mapping its pixel data when possible
+ * Parameters: the stream, the bytes of the image already read from it
+ *             and how many there are, the methods suite that should
+ *             hold the pixels and the shape of its blocks, 0 by 0 to
+ *             keep the file's blocks
+ * Returns: the image as a Pnm_ppm, freed with Pnm_ppmfree, or NULL if
+ *          the header is not valid or the pixel data is truncated
+ *
+ * Expected input: a stream positioned 'consumed' bytes into a tiled image
+ * Success output: none
+ * Failure output: NULL; nothing is raised, so a server thread may read
+ *                 without a TRY
+ */
+Pnm_ppm Tiled_read(FILE *fp, const char *bytes, size_t consumed,
+                   A2Methods_T methods, int shape_width, int shape_height)
+{
+        assert(fp != NULL && methods != NULL);
+        assert(consumed <= sizeof(TiledHeader));
+
+        TiledHeader header;
+        memcpy(&header, bytes, consumed);
+        if (fread((char *)&header + consumed, sizeof(header) - consumed, 1,
+                  fp) != 1 || !check_header(&header)) {
+                return NULL;
+        }
+
+        Mapping *mapping = NULL;
+        void *storage = map_file(fp, &header, &mapping);
+        if (storage == NULL) {
+                storage = read_data(fp, &header);
+        }
+        if (storage == NULL) {
+                return NULL;
+        }
+
+        Pnm_ppm pixmap;
+        NEW(pixmap);
+        pixmap->width = header.width;
+        pixmap->height = header.height;
+        pixmap->denominator = header.maxval;
+        pixmap->methods = uarray2_methods_blocked;
+        pixmap->pixels = UArray2b_wrap(header.width, header.height,
+                                       header.element_size, header.blocksize,
+                                       block_height(&header), storage,
+                                       mapping != NULL ? unmap_storage
+                                                       : free_storage,
+                                       mapping);
+        /* the suite's free counts the release */
+        MemStats_allocated(header.data_bytes);
+
+        A2_relayout_ppm(pixmap, methods, shape_width, shape_height);
+        return pixmap;
+}
+
+/* Tiled_write
+ * Purpose: Write an image in the tiled format. Blocked pixels are written
+ *          straight from their storage; others are first copied into a
+ *          blocked array
+ * Parameters: a file pointer to write to and the image
+ * Returns: void
+ *
+ * Expected input: an image of Pnm_rgb or Pnm_rgb16 pixels
+ * Success output: the image in the tiled format
+ * Failure output: CRE if the element size is not a known pixel type
+ */
+void Tiled_write(FILE *fp, Pnm_ppm pixmap)
+{
+        assert(fp != NULL && pixmap != NULL);
+
+        int size = pixmap->methods->size(pixmap->pixels);
+        assert(size == sizeof(struct Pnm_rgb) ||
+               size == sizeof(struct Pnm_rgb16));
+
+        A2Methods_UArray2 blocks = pixmap->pixels;
+        if (!A2_is_blocked(pixmap->methods)) {
+                blocks = A2_relayout(pixmap->methods, pixmap->pixels,
+                                     uarray2_methods_blocked, 0, 0);
+        }
+
+        TiledHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TILED_MAGIC, sizeof(header.magic));
+        header.version = TILED_VERSION;
+        header.header_size = TILED_HEADER_SIZE;
+        header.byte_order = TILED_BYTE_ORDER;
+        header.width = pixmap->width;
+        header.height = pixmap->height;
+        header.maxval = pixmap->denominator;
+        header.pixel_format = size == sizeof(struct Pnm_rgb) ? TILED_RGB
+                                                             : TILED_RGB16;
+        header.element_size = size;
+        header.blocksize = UArray2b_block_width(blocks);
+        if (UArray2b_block_height(blocks) != UArray2b_block_width(blocks)) {
+                header.block_height = UArray2b_block_height(blocks);
+        }
+        header.data_bytes = UArray2b_storage_size(pixmap->width,
+                                                  pixmap->height, size,
+                                                  header.blocksize,
+                                                  block_height(&header));
+
+        static const char padding[TILED_HEADER_SIZE];
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(padding, 1, TILED_HEADER_SIZE - sizeof(header), fp);
+        fwrite(UArray2b_storage(blocks), 1, header.data_bytes, fp);
+
+        if (blocks != pixmap->pixels) {
+                uarray2_methods_blocked->free(&blocks);
+        }
+}
+
+/* check_header
+ *    Purpose: validate a header against what this reader understands
+ *    Returns: 1 if the image can be read and 0 otherwise
+ */
+static int check_header(const TiledHeader *header)
+{
+        if (memcmp(header->magic, TILED_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != TILED_VERSION ||
+            header->header_size != TILED_HEADER_SIZE ||
+            header->byte_order != TILED_BYTE_ORDER ||
+            header->width == 0 || header->height == 0 ||
+            header->width > 1 << 30 || header->height > 1 << 30 ||
+            header->maxval == 0 || header->maxval > 65535 ||
+            header->blocksize == 0 || header->blocksize > 1 << 15 ||
+            header->block_height > 1 << 15) {
+                return 0;
+        }
+        if (!(header->pixel_format == TILED_RGB &&
+              header->element_size == sizeof(struct Pnm_rgb)) &&
+            !(header->pixel_format == TILED_RGB16 &&
+              header->element_size == sizeof(struct Pnm_rgb16))) {
+                return 0;
+        }
+        return header->data_bytes ==
+               UArray2b_storage_size(header->width, header->height,
+                                     header->element_size, header->blocksize,
+                                     block_height(header));
+}
+
+/* block_height
+ *    Purpose: the block height a header records; 0 in the field left from
+ *             the first version means square blocks
+ */
+static int block_height(const TiledHeader *header)
+{
+        return header->block_height != 0 ? (int)header->block_height
+                                     : (int)header->blocksize;
+}
+
+/* map_file
+ *    Purpose: map the pixel data of a regular file that was read from its
+ *             start. The mapping is private, so writes to the pixels never
+ *             reach the file
+ *    Returns: the pixel data and its Mapping, or NULL if the stream cannot
+ *             be mapped, which includes a file too short for its header's
+ *             data; read_data then finds the truncation
+ */
+static void *map_file(FILE *fp, const TiledHeader *header,
+                      Mapping **mapping)
+{
+        struct stat st;
+        long position = ftell(fp);
+        if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode) ||
+            position != (long)sizeof(*header)) {
+                return NULL;
+        }
+
+        size_t length = header->header_size + header->data_bytes;
+        if ((size_t)st.st_size < length) {
+                return NULL;
+        }
+
+        void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                          fileno(fp), 0);
+        if (base == MAP_FAILED) {
+                return NULL;
+        }
+        madvise(base, length, MADV_WILLNEED);
+
+        NEW(*mapping);
+        (*mapping)->base = base;
+        (*mapping)->length = length;
+        return (char *)base + header->header_size;
+}
+
+/* read_data
+ *    Purpose: read the pixel data of a stream that cannot be mapped
+ *    Returns: a malloc'd copy of the pixel data, or NULL if it is
+ *             truncated
+ */
+static void *read_data(FILE *fp, const TiledHeader *header)
+{
+        char padding[TILED_HEADER_SIZE];
+        size_t skip = header->header_size - sizeof(*header);
+        void *storage = malloc(header->data_bytes);
+        assert(storage != NULL);
+
+        if (fread(padding, 1, skip, fp) != skip ||
+            fread(storage, 1, header->data_bytes, fp) != header->data_bytes) {
+                free(storage);
+                return NULL;
+        }
+        return storage;
+}
+
+/* unmap_storage
+ *    Purpose: UArray2b release function for storage in a mapped file
+ */
+static void unmap_storage(void *storage, void *cl)
+{
+        (void)storage;
+        Mapping *mapping = cl;
+        munmap(mapping->base, mapping->length);
+        FREE(mapping);
+}
+
+/* free_storage
+ *    Purpose: UArray2b release function for storage read into memory
+ */
+static void free_storage(void *storage, void *cl)
+{
+        (void)cl;
+        free(storage);
+}
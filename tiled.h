@@ -0,0 +1,65 @@
+/**************************************************************
+ *
+ *                     tiled.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     A binary image format whose pixel data is the storage of a
+ *     UArray2b, block for block. Loading a file is a single mmap
+ *     with no parsing, and pages are only read when they are used.
+ *
+ *     File layout
+ *       bytes 0 .. 55    the header below, in the writer's byte order
+ *       bytes 56 .. 4095 zero
+ *       bytes 4096 ..    UArray2b storage (see uarray2b.h), data_bytes
+ *                        long
+ *
+ **************************************************************/
+
+#ifndef __TILED__
+#define __TILED__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "a2methods.h"
+#include "pnm.h"
+
+#define TILED_MAGIC "L40TILED"
+#define TILED_VERSION 1
+#define TILED_HEADER_SIZE 4096
+#define TILED_BYTE_ORDER 0x01020304u
+
+/* pixel formats */
+enum { TILED_RGB = 1,           /* struct Pnm_rgb, 12 bytes */
+       TILED_RGB16 = 2 };       /* struct Pnm_rgb16, 6 bytes */
+
+typedef struct TiledHeader {
+        char magic[8];          /* TILED_MAGIC, not NUL-terminated */
+        uint32_t version;
+        uint32_t header_size;   /* offset of the pixel data */
+        uint32_t byte_order;    /* TILED_BYTE_ORDER as the writer saw it */
+        uint32_t width, height, maxval;
+        uint32_t pixel_format;
+        uint32_t element_size;
+        uint32_t blocksize;     /* block width */
+        uint32_t block_height;  /* 0 for square blocks */
+        uint64_t data_bytes;
+} TiledHeader;
+
+/* Read a tiled image whose first 'consumed' bytes, saved in 'bytes', were
+ * already read from fp. A regular file is mapped rather than read. The
+ * pixels are copied out of the mapping only if 'methods' is not the
+ * blocked suite or a block shape other than 0 by 0 and the file's is
+ * asked for. Returns NULL if the image is malformed
+ */
+Pnm_ppm Tiled_read(FILE *fp, const char *bytes, size_t consumed,
+                   A2Methods_T methods, int block_width, int block_height);
+
+/* Write an image of either pixel type in the tiled format */
+void Tiled_write(FILE *fp, Pnm_ppm pixmap);
+
+#endif /* __TILED__ */
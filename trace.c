@@ -0,0 +1,256 @@
+/**************************************************************
+ *
+ *                     trace.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the trace. A thread's ring is allocated on
+ *     its first event and put on a list of all rings under a lock;
+ *     after that only the owning thread writes it. When the thread
+ *     exits its ring is retired: cut down, under the lock, to just
+ *     the events it holds, so the workers of a parallel transform
+ *     leave their events for the trace but not 512KB each. Closing
+ *     the trace writes every ring under the lock and frees only the
+ *     retired ones, since a running thread may still hold its own.
+ *     Events are written as complete ("X") events with times in
+ *     microseconds since the trace was opened.
+ *
+ **************************************************************/
+
+#define _GNU_SOURCE             /* syscall */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "assert.h"
+#include "trace.h"
+
+/* events kept per thread: 32 bytes each, so 512KB per ring */
+#define RING_EVENTS 16384
+
+typedef struct Event {
+        const char *name;
+        uint64_t start;
+        uint64_t duration;
+        long arg;
+} Event;
+
+typedef struct Ring {
+        struct Ring *next;
+        long tid;
+        unsigned long recorded;         /* events ever recorded */
+        unsigned long size;             /* RING_EVENTS, or fewer once
+                                           the thread has exited */
+        int retired;
+        Event *events;
+} Ring;
+
+static int recording;
+static FILE *trace_fp;
+static uint64_t origin;
+static Ring *rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;          /* retires a ring at thread exit */
+static __thread Ring *ring;
+
+/* now_ns
+ *    Purpose: the time on the monotonic clock in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* retire
+ *    Purpose: thread-exit destructor that cuts a thread's ring down to
+ *             the events it holds, each at the same place modulo the new
+ *             size, so the ring is read back as before
+ */
+static void retire(void *cl)
+{
+        Ring *r = cl;
+        unsigned long first = r->recorded > r->size
+                              ? r->recorded - r->size : 0;
+        unsigned long kept = r->recorded - first;
+        Event *events = malloc(kept * sizeof(Event));
+        assert(events != NULL);
+        for (unsigned long k = first; k < r->recorded; k++) {
+                events[k % kept] = r->events[k % r->size];
+        }
+
+        pthread_mutex_lock(&rings_lock);
+        free(r->events);
+        r->events = events;
+        r->size = kept;
+        r->retired = 1;
+        pthread_mutex_unlock(&rings_lock);
+        ring = NULL;
+}
+
+/* make_key
+ *    Purpose: create the key whose destructor retires a ring
+ */
+static void make_key(void)
+{
+        int rc = pthread_key_create(&ring_key, retire);
+        assert(rc == 0);
+}
+
+/* close_at_exit
+ *    Purpose: atexit handler that writes the trace if it is still open
+ */
+static void close_at_exit(void)
+{
+        Trace_close();
+}
+
+/* Trace_open
+ * Purpose: Start recording events for a trace file
+ * Parameters: the path of the trace file
+ * Returns: 1 on success and 0 if the file cannot be created
+ *
+ * Expected input: a non-null path, called once before any other thread
+ *                 records events
+ * Success output: none until the trace is closed
+ * Failure output: 0 if the file cannot be created
+ */
+int Trace_open(const char *path)
+{
+        assert(path != NULL && trace_fp == NULL);
+        trace_fp = fopen(path, "w");
+        if (trace_fp == NULL) {
+                return 0;
+        }
+        origin = now_ns();
+        recording = 1;
+        atexit(close_at_exit);
+        return 1;
+}
+
+/* Trace_begin
+ * Purpose: Give the start time of a phase
+ * Parameters: none
+ * Returns: the time in nanoseconds, or 0 if no trace is open
+ *
+ * Expected input: none
+ * Success output: none
+ * Failure output: none
+ */
+uint64_t Trace_begin(void)
+{
+        return recording ? now_ns() : 0;
+}
+
+/* Trace_end
+ * Purpose: Record a phase of the calling thread in its ring
+ * Parameters: the phase's name, its start from Trace_begin, and an
+ *             argument or -1
+ * Returns: void
+ *
+ * Expected input: a name that outlives the trace
+ * Success output: none
+ * Failure output: CRE if the thread's ring cannot be allocated
+ */
+void Trace_end(const char *name, uint64_t start, long arg)
+{
+        if (start == 0 || !recording) {
+                return;
+        }
+        uint64_t end = now_ns();
+        if (ring == NULL) {
+                ring = calloc(1, sizeof(*ring));
+                assert(ring != NULL);
+                ring->events = malloc(RING_EVENTS * sizeof(Event));
+                assert(ring->events != NULL);
+                ring->tid = syscall(SYS_gettid);
+                ring->size = RING_EVENTS;
+                pthread_once(&key_once, make_key);
+                pthread_setspecific(ring_key, ring);
+                pthread_mutex_lock(&rings_lock);
+                ring->next = rings;
+                rings = ring;
+                pthread_mutex_unlock(&rings_lock);
+        }
+        Event *event = &ring->events[ring->recorded % RING_EVENTS];
+        event->name = name;
+        event->start = start;
+        event->duration = end - start;
+        event->arg = arg;
+        ring->recorded++;
+}
+
+/* Trace_close
+ * Purpose: Write the recorded events of every thread as Chrome trace JSON
+ *          and stop recording
+ * Parameters: none
+ * Returns: void
+ *
+ * Expected input: none; a thread still recording keeps its ring, and
+ *                 events it records as the trace closes may be left out
+ * Success output: the trace file; nothing if no trace is open
+ * Failure output: none
+ */
+void Trace_close(void)
+{
+        if (trace_fp == NULL) {
+                return;
+        }
+        recording = 0;
+
+        long pid = getpid();
+        unsigned long dropped = 0;
+        fprintf(trace_fp, "{\"traceEvents\":[\n"
+                          "{\"name\":\"process_name\",\"ph\":\"M\","
+                          "\"pid\":%ld,\"tid\":%ld,"
+                          "\"args\":{\"name\":\"ppmtrans\"}}", pid, pid);
+        pthread_mutex_lock(&rings_lock);
+        for (Ring *r = rings; r != NULL; r = r->next) {
+                unsigned long first = r->recorded > r->size
+                                      ? r->recorded - r->size : 0;
+                dropped += first;
+                for (unsigned long k = first; k < r->recorded; k++) {
+                        Event *event = &r->events[k % r->size];
+                        fprintf(trace_fp, ",\n{\"name\":\"%s\",\"cat\":"
+                                          "\"ppmtrans\",\"ph\":\"X\","
+                                          "\"ts\":%.3f,\"dur\":%.3f,"
+                                          "\"pid\":%ld,\"tid\":%ld",
+                                event->name,
+                                (event->start - origin) / 1e3,
+                                event->duration / 1e3, pid, r->tid);
+                        if (event->arg >= 0) {
+                                fprintf(trace_fp, ",\"args\":{\"n\":%ld}",
+                                        event->arg);
+                        }
+                        fputc('}', trace_fp);
+                }
+        }
+        /* a running thread's ring stays; its thread frees nothing */
+        Ring **link = &rings;
+        while (*link != NULL) {
+                Ring *r = *link;
+                if (r->retired) {
+                        *link = r->next;
+                        free(r->events);
+                        free(r);
+                } else {
+                        link = &r->next;
+                }
+        }
+        pthread_mutex_unlock(&rings_lock);
+
+        fprintf(trace_fp, "\n],\"displayTimeUnit\":\"ms\","
+                          "\"otherData\":{\"dropped_events\":%lu}}\n",
+                dropped);
+        fclose(trace_fp);
+        trace_fp = NULL;
+}
@@ -0,0 +1,53 @@
+/**************************************************************
+ *
+ *                     trace.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     A timeline of where a run spends its time, written as Chrome
+ *     trace events (JSON) that chrome://tracing and Perfetto load.
+ *     Each thread records its events into its own ring buffer, so
+ *     recording takes no lock; when a ring fills, its oldest
+ *     events are overwritten and counted as dropped. The rings are
+ *     written out when the trace is closed, at exit at the latest.
+ *
+ *     A phase is recorded as
+ *
+ *         uint64_t start = Trace_begin();
+ *         ...
+ *         Trace_end("transform", start, -1);
+ *
+ *     which costs one test of a flag when no trace is open.
+ *
+ **************************************************************/
+
+#ifndef __TRACE__
+#define __TRACE__
+
+#include <stdint.h>
+
+/* Start recording events, to be written to 'path' by Trace_close or at
+ * exit. Returns 1 on success and 0 if the file cannot be created
+ */
+extern int Trace_open(const char *path);
+
+/* The start time of a phase to pass to Trace_end: nanoseconds on the
+ * monotonic clock, or 0 if no trace is open
+ */
+extern uint64_t Trace_begin(void);
+
+/* Record the phase 'name' (a string that outlives the trace, normally a
+ * literal) of the calling thread from 'start' until now, with 'arg' (a
+ * row, band or block index) or -1 for none. Does nothing if start is 0
+ */
+extern void Trace_end(const char *name, uint64_t start, long arg);
+
+/* Write every thread's events and stop recording. Threads still running
+ * must not record events while this runs
+ */
+extern void Trace_close(void);
+
+#endif /* __TRACE__ */
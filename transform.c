@@ -16,8 +16,20 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
  
+#include "mem.h"
 #include "transform.h"
+#include "ppmio.h"
+#include "numaplace.h"
+#include "memstats.h"
+#include "trace.h"
 
 /* ArrayData stores the transformed array of pixels and the methods
  * suite. It is passed through mapping functions as the closure
@@ -26,8 +38,104 @@
 struct ArrayData {
     A2Methods_UArray2 output_array;
     A2Methods_T methods;
+    int size;
+};
+
+/* ScaleData is the closure for the fused downscale-and-transform pass.
+ * Each output cell holds the running channel sums of the scale x scale
+ * box of oriented source pixels that fall into it
+ */
+struct ScaleData {
+    A2Methods_UArray2 output_array;
+    A2Methods_T methods;
+    Orientation orientation;
+    int scale;
+    int size;           /* element size of the image being scaled */
+    int width;          /* oriented, unscaled width and height */
+    int height;
+};
+
+/* FanoutData is the closure for transform_fanout: the output array of
+ * every requested orientation, each filled from a source cell while the
+ * traversal is on it
+ */
+struct FanoutData {
+    const struct A2Methods_T *methods;
+    const Orientation *orientations;
+    A2Methods_UArray2 *outputs;
+    int count;
+    int width;          /* of the source */
+    int height;
+    int size;
 };
 
+/* TransformTask is the closure for one worker of transform_parallel.
+ * The worker owns the output block rows [first_band, last_band), all of
+ * which are placed on its NUMA node, and fills them by pulling each
+ * output cell from the source
+ */
+struct TransformTask {
+    A2Methods_UArray2 input_array;
+    A2Methods_UArray2 output_array;
+    A2Methods_T methods;
+    Orientation orientation;
+    int size;
+    int first_band, last_band;
+    Numa_T numa;
+    int node;
+    pthread_t thread;
+};
+
+/* STAGE_BYTES is how much of an output row transform_streaming gathers
+ * in a cache-resident buffer before streaming it out
+ */
+#define STAGE_BYTES 4096
+
+/* new_like
+ *    Purpose: Make an output array for an image, with the image's block
+ *             shape when the output is in the image's suite, so a
+ *             -block-major=WxH image keeps its blocks through a transform
+ *    Returns: the new array
+ */
+static A2Methods_UArray2 new_like(const struct A2Methods_T *methods,
+                                  Pnm_ppm like, int width, int height,
+                                  int size)
+{
+    if (like->methods != methods) {
+        return methods->new(width, height, size);
+    }
+    int block_width, block_height;
+    methods->block_shape(like->pixels, &block_width, &block_height);
+    return methods->new_with_block_shape(width, height, size, block_width,
+                                         block_height);
+}
+
+/* copy_pixel
+ *    Purpose: Copy one pixel of the given element size. The known pixel
+ *             types get their own fixed-size copies so the compiler emits
+ *             plain moves instead of a call to memcpy
+ */
+static inline void copy_pixel(void *dst, const void *src, int size)
+{
+    switch (size) {
+    case sizeof(uint8_t):       /* one plane of a planar image */
+        *(uint8_t *)dst = *(const uint8_t *)src;
+        break;
+    case sizeof(uint16_t):
+        *(uint16_t *)dst = *(const uint16_t *)src;
+        break;
+    case sizeof(struct Pnm_rgb):
+        *(Pnm_rgb)dst = *(const struct Pnm_rgb *)src;
+        break;
+    case sizeof(struct Pnm_rgb16):
+        *(Pnm_rgb16)dst = *(const struct Pnm_rgb16 *)src;
+        break;
+    default:
+        memcpy(dst, src, size);
+        break;
+    }
+}
+
 /* transform
  * Purpose: Process the image transformation
  * Parameters: a Pnm_ppm for the input image, an int for the rotation degree,
@@ -112,16 +220,15 @@ Pnm_ppm rotate_90(Pnm_ppm input_ppm, A2Methods_T methods, A2Methods_mapfun *map)
     A2Methods_UArray2 input_array = input_ppm->pixels;
     A2Methods_UArray2 output_array;
     
-    ArrayData array_data = malloc(sizeof(A2Methods_UArray2)
-                                    + sizeof(A2Methods_T));
-    assert(array_data);
+    ArrayData array_data = MemStats_malloc(sizeof(struct ArrayData));
     array_data->methods = methods;
 
     int width = input_ppm->width;
     int height = input_ppm->height;
     int size = methods->size(input_array);
-    output_array = methods->new(height, width, size);
+    output_array = new_like(methods, input_ppm, height, width, size);
     array_data->output_array = output_array;
+    array_data->size = size;
     
     map(input_array, apply90, &array_data);
     
@@ -130,7 +237,7 @@ Pnm_ppm rotate_90(Pnm_ppm input_ppm, A2Methods_T methods, A2Methods_mapfun *map)
     input_ppm->pixels = output_array;
 
     methods->free(&input_array);
-    free(array_data);
+    MemStats_free(array_data, sizeof(struct ArrayData));
     
     return input_ppm;
 }
@@ -163,7 +270,7 @@ void apply90(int i, int j, A2Methods_UArray2 array2, A2Methods_Object *ptr,
     int new_i = height - j - 1;
     int new_j = i;
 
-    *(Pnm_rgb)methods->at(output_array, new_i, new_j) = *(Pnm_rgb)ptr;
+    copy_pixel(methods->at(output_array, new_i, new_j), ptr, array_data->size);
 }
 
 /* rotate_180
@@ -184,23 +291,22 @@ Pnm_ppm rotate_180(Pnm_ppm input_ppm, A2Methods_T methods,
     A2Methods_UArray2 input_array = input_ppm->pixels;
     A2Methods_UArray2 output_array;
     
-    ArrayData array_data = malloc(sizeof(A2Methods_UArray2)
-                                     + sizeof(A2Methods_T));
-    assert(array_data);
+    ArrayData array_data = MemStats_malloc(sizeof(struct ArrayData));
     array_data->methods = methods;
 
     int width = input_ppm->width;
     int height = input_ppm->height;
     int size = methods->size(input_array);
-    output_array = methods->new(width, height, size);
+    output_array = new_like(methods, input_ppm, width, height, size);
     array_data->output_array = output_array;
+    array_data->size = size;
     
     map(input_array, apply180, &array_data);
     
     input_ppm->pixels = output_array;
 
     methods->free(&input_array);
-    free(array_data);
+    MemStats_free(array_data, sizeof(struct ArrayData));
     
     return input_ppm;
 }
@@ -235,7 +341,7 @@ void apply180(int i, int j, A2Methods_UArray2 array2, A2Methods_Object *ptr,
     int new_i = width - i - 1;
     int new_j = height - j - 1;
 
-    *(Pnm_rgb)methods->at(output_array, new_i, new_j) = *(Pnm_rgb)ptr;
+    copy_pixel(methods->at(output_array, new_i, new_j), ptr, array_data->size);
 }
 
 /* rotate_270
@@ -256,16 +362,15 @@ Pnm_ppm rotate_270(Pnm_ppm input_ppm, A2Methods_T methods,
     A2Methods_UArray2 input_array = input_ppm->pixels;
     A2Methods_UArray2 output_array;
     
-    ArrayData array_data = malloc(sizeof(A2Methods_UArray2)
-                                     + sizeof(A2Methods_T));
-    assert(array_data);
+    ArrayData array_data = MemStats_malloc(sizeof(struct ArrayData));
     array_data->methods = methods;
 
     int width = input_ppm->width;
     int height = input_ppm->height;
     int size = methods->size(input_array);
-    output_array = methods->new(height, width, size);
+    output_array = new_like(methods, input_ppm, height, width, size);
     array_data->output_array = output_array;
+    array_data->size = size;
     
     map(input_array, apply270, &array_data);
     
@@ -274,7 +379,7 @@ Pnm_ppm rotate_270(Pnm_ppm input_ppm, A2Methods_T methods,
     input_ppm->pixels = output_array;
 
     methods->free(&input_array);
-    free(array_data);
+    MemStats_free(array_data, sizeof(struct ArrayData));
 
     return input_ppm;
 }
@@ -307,7 +412,7 @@ void apply270(int i, int j, A2Methods_UArray2 array2, A2Methods_Object *ptr,
     int new_i = j;
     int new_j = width - i - 1;
 
-    *(Pnm_rgb)methods->at(output_array, new_i, new_j) = *(Pnm_rgb)ptr;
+    copy_pixel(methods->at(output_array, new_i, new_j), ptr, array_data->size);
 }
 
 /* flip_vertical
@@ -328,16 +433,15 @@ Pnm_ppm flip_vertical(Pnm_ppm input_ppm, A2Methods_T methods,
     A2Methods_UArray2 input_array = input_ppm->pixels;
     A2Methods_UArray2 output_array;
     
-    ArrayData array_data = malloc(sizeof(A2Methods_UArray2)
-                                     + sizeof(A2Methods_T));
-    assert(array_data);
+    ArrayData array_data = MemStats_malloc(sizeof(struct ArrayData));
     array_data->methods = methods;
 
     int width = input_ppm->width;
     int height = input_ppm->height;
     int size = methods->size(input_array);
-    output_array = methods->new(width, height, size);
+    output_array = new_like(methods, input_ppm, width, height, size);
     array_data->output_array = output_array;
+    array_data->size = size;
     
     map(input_array, apply_vertical, &array_data);
     
@@ -346,7 +450,7 @@ Pnm_ppm flip_vertical(Pnm_ppm input_ppm, A2Methods_T methods,
     input_ppm->pixels = output_array;
 
     methods->free(&input_array);
-    free(array_data);
+    MemStats_free(array_data, sizeof(struct ArrayData));
 
     return input_ppm;
 }
@@ -379,7 +483,7 @@ void apply_vertical(int i, int j, A2Methods_UArray2 array2,
     int new_i = i;
     int new_j = height - j - 1;
 
-    *(Pnm_rgb)methods->at(output_array, new_i, new_j) = *(Pnm_rgb)ptr;
+    copy_pixel(methods->at(output_array, new_i, new_j), ptr, array_data->size);
 }
 
 /* flip_horizontal
@@ -400,17 +504,16 @@ Pnm_ppm flip_horizontal(Pnm_ppm input_ppm, A2Methods_T methods,
     A2Methods_UArray2 input_array = input_ppm->pixels;
     A2Methods_UArray2 output_array;
     
-    ArrayData array_data = malloc(sizeof(A2Methods_UArray2)
-                                     + sizeof(A2Methods_T));
-    assert(array_data);
+    ArrayData array_data = MemStats_malloc(sizeof(struct ArrayData));
     array_data->methods = methods;
 
     int width = input_ppm->width;
     int height = input_ppm->height;
 
     int size = methods->size(input_array);
-    output_array = methods->new(width, height, size);
+    output_array = new_like(methods, input_ppm, width, height, size);
     array_data->output_array = output_array;
+    array_data->size = size;
     
     map(input_array, apply_horizontal, &array_data);
     
@@ -419,7 +522,7 @@ Pnm_ppm flip_horizontal(Pnm_ppm input_ppm, A2Methods_T methods,
     input_ppm->pixels = output_array;
 
     methods->free(&input_array);
-    free(array_data);
+    MemStats_free(array_data, sizeof(struct ArrayData));
 
     return input_ppm;
 }
@@ -452,7 +555,7 @@ void apply_horizontal(int i, int j, A2Methods_UArray2 array2,
     int new_i = width - i - 1;
     int new_j = j;
 
-    *(Pnm_rgb)methods->at(output_array, new_i, new_j) = *(Pnm_rgb)ptr;
+    copy_pixel(methods->at(output_array, new_i, new_j), ptr, array_data->size);
 }
 
 /* transpose
@@ -473,16 +576,15 @@ Pnm_ppm transpose(Pnm_ppm input_ppm, A2Methods_T methods,
     A2Methods_UArray2 input_array = input_ppm->pixels;
     A2Methods_UArray2 output_array;
     
-    ArrayData array_data = malloc(sizeof(A2Methods_UArray2)
-                                    + sizeof(A2Methods_T));
-    assert(array_data);
+    ArrayData array_data = MemStats_malloc(sizeof(struct ArrayData));
     array_data->methods = methods;
     
     int width = input_ppm->width;
     int height = input_ppm->height;
     int size = methods->size(input_array);
-    output_array = methods->new(height, width, size);
+    output_array = new_like(methods, input_ppm, height, width, size);
     array_data->output_array = output_array;
+    array_data->size = size;
     
     map(input_array, apply_transpose, &array_data);
     
@@ -491,7 +593,7 @@ Pnm_ppm transpose(Pnm_ppm input_ppm, A2Methods_T methods,
     input_ppm->pixels = output_array;
     
     methods->free(&input_array);
-    free(array_data);
+    MemStats_free(array_data, sizeof(struct ArrayData));
 
     return input_ppm;
 }
@@ -520,5 +622,840 @@ void apply_transpose(int i, int j, A2Methods_UArray2 array2,
     A2Methods_UArray2 output_array = array_data->output_array;
     A2Methods_T methods = array_data->methods;
 
-    *(Pnm_rgb)methods->at(output_array, j, i) = *(Pnm_rgb)ptr;
-}
\ No newline at end of file
+    copy_pixel(methods->at(output_array, j, i), ptr, array_data->size);
+}
+
+/* Orientation_swaps
+ *    Purpose: Tell whether an orientation exchanges width and height
+ * Parameters: the Orientation
+ *    Returns: 1 for the quarter turns, transpose and transverse, else 0
+ *
+ * Expected input: any Orientation
+ * Success output: none
+ * Failure output: none
+ */
+int Orientation_swaps(Orientation orientation)
+{
+    return orientation == ORIENT_90 || orientation == ORIENT_270 ||
+           orientation == ORIENT_TRANSPOSE ||
+           orientation == ORIENT_TRANSVERSE;
+}
+
+/* orientation_of
+ *    Purpose: Name the layout selected by the ppmtrans options, using the
+ *             same precedence as transform (rotation, then flip, then
+ *             transpose)
+ * Parameters: an int for the rotation degree, a C string for the flip type
+ *             (or NULL), and an int for whether transpose was requested
+ *    Returns: the Orientation to apply
+ *
+ * Expected input: degrees of 0, 90, 180, or 270
+ * Success output: none
+ * Failure output: none
+ */
+Orientation orientation_of(int degrees, char *flip, int do_transpose)
+{
+    if (degrees == 90) {
+        return ORIENT_90;
+    } else if (degrees == 180) {
+        return ORIENT_180;
+    } else if (degrees == 270) {
+        return ORIENT_270;
+    } else if (flip != NULL) {
+        return strcmp(flip, "horizontal") == 0 ? ORIENT_FLIP_H
+                                               : ORIENT_FLIP_V;
+    } else if (do_transpose == 1) {
+        return ORIENT_TRANSPOSE;
+    }
+    return ORIENT_0;
+}
+
+/* orient_coords
+ *    Purpose: Map a source cell to the cell it lands on in the output
+ *             image; this is the arithmetic of apply90, apply180, etc.
+ * Parameters: an Orientation, the column and row of the source cell, the
+ *             width and height of the source image, and pointers to where
+ *             the output column and row should be stored
+ *    Returns: void
+ *
+ * Expected input: a source cell that is in bounds and non-null pointers
+ * Success output: none
+ * Failure output: none
+ */
+void orient_coords(Orientation orientation, int i, int j, int width,
+                            int height, int *new_i, int *new_j)
+{
+    switch (orientation) {
+    case ORIENT_90:
+        *new_i = height - j - 1;
+        *new_j = i;
+        break;
+    case ORIENT_180:
+        *new_i = width - i - 1;
+        *new_j = height - j - 1;
+        break;
+    case ORIENT_270:
+        *new_i = j;
+        *new_j = width - i - 1;
+        break;
+    case ORIENT_FLIP_H:
+        *new_i = width - i - 1;
+        *new_j = j;
+        break;
+    case ORIENT_FLIP_V:
+        *new_i = i;
+        *new_j = height - j - 1;
+        break;
+    case ORIENT_TRANSPOSE:
+        *new_i = j;
+        *new_j = i;
+        break;
+    case ORIENT_TRANSVERSE:
+        *new_i = height - j - 1;
+        *new_j = width - i - 1;
+        break;
+    default:
+        *new_i = i;
+        *new_j = j;
+        break;
+    }
+}
+
+/* zero_pixel
+ *    Purpose: small apply function that clears a pixel's channel sums
+ */
+static void zero_pixel(A2Methods_Object *ptr, void *cl)
+{
+    (void)cl;
+    Pnm_rgb pixel = ptr;
+    pixel->red = pixel->green = pixel->blue = 0;
+}
+
+/* scale_transform
+ *    Purpose: Transform the image and box-filter it down by 'scale' in a
+ *             single traversal of the source. The full-size transformed
+ *             image is never built: every source pixel is added straight
+ *             into the downscaled output cell that covers it, and the sums
+ *             are divided once at the end
+ * Parameters: a Pnm_ppm for the input image, an int for the rotation degree,
+ *             a C string for the flip type, an int for whether or not
+ *             transpose should be performed, an int for the downscale
+ *             factor N (output is 1/N of the transformed size along each
+ *             side), an A2Methods_T for the methods suite, and an
+ *             A2Methods_mapfun ptr for the mapping function chosen
+ *    Returns: the processed image
+ *
+ * Expected input: the same as transform, and a scale of 1 to MAX_SCALE
+ * Success output: a processed Pnm_ppm whose sides are ceil(1/N) of the
+ *                 transformed image; cells on the right and bottom edges
+ *                 average over the pixels that exist
+ * Failure output: CRE if scale is out of range or scale_data isn't valid
+ */
+Pnm_ppm scale_transform(Pnm_ppm input_ppm, int degrees, char *flip,
+                        int do_transpose, int scale, A2Methods_T methods,
+                                                   A2Methods_mapfun *map)
+{
+    assert(input_ppm && methods);
+    assert(map != NULL && *map != NULL);
+    assert(scale >= 1 && scale <= MAX_SCALE);
+
+    A2Methods_UArray2 input_array = input_ppm->pixels;
+    A2Methods_UArray2 output_array;
+
+    ScaleData scale_data = MemStats_malloc(sizeof(struct ScaleData));
+    scale_data->methods = methods;
+    scale_data->scale = scale;
+    scale_data->orientation = orientation_of(degrees, flip, do_transpose);
+
+    int width = input_ppm->width;
+    int height = input_ppm->height;
+    if (Orientation_swaps(scale_data->orientation)) {
+        scale_data->width = height;
+        scale_data->height = width;
+    } else {
+        scale_data->width = width;
+        scale_data->height = height;
+    }
+
+    /* channel sums need the full width of a Pnm_rgb, whatever the
+     * pixel type of the image is
+     */
+    int size = methods->size(input_array);
+    scale_data->size = size;
+    A2Methods_UArray2 sum_array;
+    sum_array = new_like(methods, input_ppm,
+                         (scale_data->width + scale - 1) / scale,
+                         (scale_data->height + scale - 1) / scale,
+                         sizeof(struct Pnm_rgb));
+    methods->small_map_default(sum_array, zero_pixel, NULL);
+    scale_data->output_array = sum_array;
+
+    map(input_array, apply_scaled, &scale_data);
+    methods->map_default(sum_array, apply_average, &scale_data);
+
+    if (size == sizeof(struct Pnm_rgb)) {
+        output_array = sum_array;
+    } else {
+        output_array = new_like(methods, input_ppm,
+                                methods->width(sum_array),
+                                methods->height(sum_array), size);
+        scale_data->output_array = output_array;
+        methods->map_default(sum_array, apply_narrow, &scale_data);
+        methods->free(&sum_array);
+    }
+
+    input_ppm->width = methods->width(output_array);
+    input_ppm->height = methods->height(output_array);
+    input_ppm->pixels = output_array;
+
+    methods->free(&input_array);
+    MemStats_free(scale_data, sizeof(struct ScaleData));
+
+    return input_ppm;
+}
+
+/* apply_scaled
+ *    Purpose: apply function for the fused downscale – finds where the
+ *             current source cell lands after the transform and adds it
+ *             to the output cell whose box covers that spot
+ * Parameters: an int for the column number, and int for the row number,
+ *             an A2Methods_UArray2 for the original image, an A2Methods_Object
+ *             for the current element being processed, and a void pointer
+ *             closure which points to a ScaleData
+ *    Returns: void
+ *
+ * Expected input: two ints for column and row that are in bound for the
+ *                 original image, a valid A2Methods_UArray2, a valid
+ *                 A2Methods_Object for the current element
+ * Success output: none
+ * Failure output: none
+ */
+void apply_scaled(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl)
+{
+    ScaleData scale_data = *(ScaleData *)cl;
+    A2Methods_T methods = scale_data->methods;
+    int new_i, new_j;
+
+    orient_coords(scale_data->orientation, i, j, methods->width(array2),
+                  methods->height(array2), &new_i, &new_j);
+
+    Pnm_rgb sum = methods->at(scale_data->output_array,
+                              new_i / scale_data->scale,
+                              new_j / scale_data->scale);
+    if (scale_data->size == sizeof(struct Pnm_rgb16)) {
+        Pnm_rgb16 pixel = ptr;
+        sum->red += pixel->red;
+        sum->green += pixel->green;
+        sum->blue += pixel->blue;
+    } else {
+        Pnm_rgb pixel = ptr;
+        sum->red += pixel->red;
+        sum->green += pixel->green;
+        sum->blue += pixel->blue;
+    }
+}
+
+/* apply_average
+ *    Purpose: apply function that turns an output cell's channel sums into
+ *             the box average, counting only the source pixels that fall
+ *             inside the image on the right and bottom edges
+ * Parameters: the column and row of the output cell, the output array,
+ *             the cell, and a closure which points to a ScaleData
+ *    Returns: void
+ */
+void apply_average(int i, int j, A2Methods_UArray2 array2,
+                         A2Methods_Object *ptr, void *cl)
+{
+    (void)array2;
+    ScaleData scale_data = *(ScaleData *)cl;
+    int scale = scale_data->scale;
+
+    int box_width = scale_data->width - i * scale;
+    int box_height = scale_data->height - j * scale;
+    if (box_width > scale) {
+        box_width = scale;
+    }
+    if (box_height > scale) {
+        box_height = scale;
+    }
+    unsigned count = box_width * box_height;
+
+    Pnm_rgb pixel = ptr;
+    pixel->red = (pixel->red + count / 2) / count;
+    pixel->green = (pixel->green + count / 2) / count;
+    pixel->blue = (pixel->blue + count / 2) / count;
+}
+
+/* apply_narrow
+ *    Purpose: apply function that copies an averaged Pnm_rgb cell into the
+ *             Pnm_rgb16 output cell at the same position
+ * Parameters: the column and row of the cell, the array of averages, the
+ *             averaged cell, and a closure which points to a ScaleData
+ *    Returns: void
+ */
+void apply_narrow(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl)
+{
+    (void)array2;
+    ScaleData scale_data = *(ScaleData *)cl;
+    A2Methods_T methods = scale_data->methods;
+    Pnm_rgb average = ptr;
+    Pnm_rgb16 pixel = methods->at(scale_data->output_array, i, j);
+
+    pixel->red = average->red;
+    pixel->green = average->green;
+    pixel->blue = average->blue;
+}
+
+/* source_coords
+ *    Purpose: The inverse of orient_coords: find the source cell that
+ *             lands on a given output cell
+ * Parameters: an Orientation, the column and row of the output cell, the
+ *             width and height of the source image, and pointers to where
+ *             the source column and row should be stored
+ *    Returns: void
+ *
+ * Expected input: an output cell that is in bounds and non-null pointers
+ * Success output: none
+ * Failure output: none
+ */
+void source_coords(Orientation orientation, int new_i, int new_j, int width,
+                              int height, int *i, int *j)
+{
+    switch (orientation) {
+    case ORIENT_90:
+        *i = new_j;
+        *j = height - new_i - 1;
+        break;
+    case ORIENT_180:
+        *i = width - new_i - 1;
+        *j = height - new_j - 1;
+        break;
+    case ORIENT_270:
+        *i = width - new_j - 1;
+        *j = new_i;
+        break;
+    case ORIENT_FLIP_H:
+        *i = width - new_i - 1;
+        *j = new_j;
+        break;
+    case ORIENT_FLIP_V:
+        *i = new_i;
+        *j = height - new_j - 1;
+        break;
+    case ORIENT_TRANSPOSE:
+        *i = new_j;
+        *j = new_i;
+        break;
+    case ORIENT_TRANSVERSE:
+        *i = width - new_j - 1;
+        *j = height - new_i - 1;
+        break;
+    default:
+        *i = new_i;
+        *j = new_j;
+        break;
+    }
+}
+
+/* band_geometry
+ *    Purpose: Describe how the output array is cut into block rows: a
+ *             block row of a blocked array is one row of blocks, and for
+ *             an unblocked array it is a single row, which is also one
+ *             "block" as wide as the image
+ */
+static void band_geometry(const struct A2Methods_T *methods,
+                          A2Methods_UArray2 array, int *band_height,
+                          int *block_width)
+{
+    methods->block_shape(array, block_width, band_height);
+    if (*block_width == 1 && *band_height == 1) {
+        *block_width = methods->width(array);
+    }
+}
+
+/* transform_worker
+ *    Purpose: thread body for transform_parallel. Pins itself to its node,
+ *             binds its output block rows there, and fills them one block
+ *             at a time. Writing the blocks from this thread is also the
+ *             first touch of their pages, which places them on this node
+ *             when libnuma is not available
+ * Parameters: a void pointer to the worker's TransformTask
+ *    Returns: NULL
+ */
+static void *transform_worker(void *cl)
+{
+    struct TransformTask *task = cl;
+    A2Methods_T methods = task->methods;
+    A2Methods_UArray2 input_array = task->input_array;
+    A2Methods_UArray2 output_array = task->output_array;
+    int width = methods->width(input_array);
+    int height = methods->height(input_array);
+    int out_width = methods->width(output_array);
+    int out_height = methods->height(output_array);
+    int band_height, block_width;
+    band_geometry(methods, output_array, &band_height, &block_width);
+
+    Numa_pin(task->numa, task->node);
+
+    for (int band = task->first_band; band < task->last_band; band++) {
+        int y0 = band * band_height;
+        for (int x0 = 0; x0 < out_width; x0 += block_width) {
+            Numa_bind(task->numa, methods->at(output_array, x0, y0),
+                      (size_t)block_width * band_height * task->size,
+                      task->node);
+        }
+    }
+
+    for (int band = task->first_band; band < task->last_band; band++) {
+        uint64_t start = Trace_begin();
+        int y0 = band * band_height;
+        int y1 = y0 + band_height < out_height ? y0 + band_height
+                                               : out_height;
+        for (int x0 = 0; x0 < out_width; x0 += block_width) {
+            int x1 = x0 + block_width < out_width ? x0 + block_width
+                                                  : out_width;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    int i, j;
+                    source_coords(task->orientation, x, y, width, height,
+                                  &i, &j);
+                    copy_pixel(methods->at(output_array, x, y),
+                               methods->at(input_array, i, j), task->size);
+                }
+            }
+        }
+        Trace_end("band", start, band);
+    }
+    return NULL;
+}
+
+/* transform_parallel
+ *    Purpose: Transform the image with several threads, spreading the
+ *             output across the machine's NUMA nodes. The output's block
+ *             rows are split into one contiguous range per node, and the
+ *             workers pinned to a node split that node's range among
+ *             themselves, so every worker writes only memory on its own
+ *             node. On a single-node machine this is a plain split of the
+ *             block rows across the threads
+ * Parameters: a Pnm_ppm for the input image, an Orientation, an
+ *             A2Methods_T for the methods suite, and the number of threads
+ *    Returns: the processed image
+ *
+ * Expected input: a valid ppm image and methods suite, and at least one
+ *                 thread
+ * Success output: a processed Pnm_ppm, the same as transform would give
+ * Failure output: CRE if nthreads is less than 1 or memory runs out
+ */
+Pnm_ppm transform_parallel(Pnm_ppm input_ppm, Orientation orientation,
+                                   A2Methods_T methods, int nthreads)
+{
+    assert(input_ppm && methods);
+    assert(nthreads >= 1);
+
+    A2Methods_UArray2 input_array = input_ppm->pixels;
+    int width = input_ppm->width;
+    int height = input_ppm->height;
+    int size = methods->size(input_array);
+    A2Methods_UArray2 output_array;
+    if (Orientation_swaps(orientation)) {
+        output_array = new_like(methods, input_ppm, height, width, size);
+    } else {
+        output_array = new_like(methods, input_ppm, width, height, size);
+    }
+
+    int band_height, block_width;
+    band_geometry(methods, output_array, &band_height, &block_width);
+    int bands = (methods->height(output_array) + band_height - 1)
+                / band_height;
+
+    Numa_T numa = Numa_new();
+    int nodes = Numa_nodes(numa);
+    if (nodes > nthreads) {
+        nodes = nthreads;
+    }
+
+    struct TransformTask *tasks = MemStats_malloc(nthreads * sizeof(*tasks));
+    int t = 0;
+    for (int node = 0; node < nodes; node++) {
+        int node_first = (long)bands * node / nodes;
+        int node_last = (long)bands * (node + 1) / nodes;
+        int workers = nthreads / nodes + (node < nthreads % nodes);
+        for (int w = 0; w < workers; w++, t++) {
+            tasks[t].input_array = input_array;
+            tasks[t].output_array = output_array;
+            tasks[t].methods = methods;
+            tasks[t].orientation = orientation;
+            tasks[t].size = size;
+            tasks[t].first_band = node_first
+                    + (long)(node_last - node_first) * w / workers;
+            tasks[t].last_band = node_first
+                    + (long)(node_last - node_first) * (w + 1) / workers;
+            tasks[t].numa = numa;
+            tasks[t].node = node;
+            int rc = pthread_create(&tasks[t].thread, NULL,
+                                    transform_worker, &tasks[t]);
+            assert(rc == 0);
+        }
+    }
+    for (t = 0; t < nthreads; t++) {
+        pthread_join(tasks[t].thread, NULL);
+    }
+    MemStats_free(tasks, nthreads * sizeof(*tasks));
+    Numa_free(&numa);
+
+    input_ppm->width = methods->width(output_array);
+    input_ppm->height = methods->height(output_array);
+    input_ppm->pixels = output_array;
+    methods->free(&input_array);
+
+    return input_ppm;
+}
+
+/* stream_out
+ *    Purpose: Copy n bytes to the output with non-temporal stores, which
+ *             go to memory through write-combining buffers without
+ *             allocating cache lines. The unaligned head and tail of the
+ *             range are copied normally
+ */
+static inline void stream_out(char *dst, const char *src, size_t n)
+{
+#ifdef __SSE2__
+    size_t head = (16 - (uintptr_t)dst % 16) % 16;
+    if (head > n) {
+        head = n;
+    }
+    memcpy(dst, src, head);
+    size_t k = head;
+    for (; k + 16 <= n; k += 16) {
+        _mm_stream_si128((__m128i *)(dst + k),
+                         _mm_loadu_si128((const __m128i *)(src + k)));
+    }
+    memcpy(dst + k, src + k, n - k);
+#else
+    memcpy(dst, src, n);
+#endif
+}
+
+/* transform_streaming
+ *    Purpose: Transform an image in the plain suite by filling each output
+ *             row in order, pulling its pixels from the source. Source
+ *             reads in the 90/270 cases walk a column, so the cell
+ *             'prefetch' pixels ahead is prefetched. The output row is
+ *             gathered in a small buffer and copied out with normal
+ *             stores, or with non-temporal stores so it does not evict
+ *             source lines still in use
+ * Parameters: a Pnm_ppm for the input image, the orientation, the methods
+ *             suite, the prefetch distance in pixels (0 for none), and
+ *             whether to use non-temporal stores
+ *    Returns: the processed image
+ *
+ * Expected input: a valid ppm image held in the plain (UArray2) suite
+ * Success output: a processed Pnm_ppm, the same as transform would give
+ * Failure output: CRE if the image is not in the plain suite
+ */
+Pnm_ppm transform_streaming(Pnm_ppm input_ppm, Orientation orientation,
+                            A2Methods_T methods, int prefetch,
+                            int nontemporal)
+{
+    assert(input_ppm && methods);
+    assert(methods == uarray2_methods_plain && prefetch >= 0);
+
+    A2Methods_UArray2 input_array = input_ppm->pixels;
+    int width = input_ppm->width;
+    int height = input_ppm->height;
+    int size = methods->size(input_array);
+    A2Methods_UArray2 output_array;
+    if (Orientation_swaps(orientation)) {
+        output_array = new_like(methods, input_ppm, height, width, size);
+    } else {
+        output_array = new_like(methods, input_ppm, width, height, size);
+    }
+    int out_width = methods->width(output_array);
+    int out_height = methods->height(output_array);
+
+    const char *src = methods->data(input_array);
+    int src_stride = methods->stride(input_array);
+    char *dst = methods->data(output_array);
+    int dst_stride = methods->stride(output_array);
+
+    int stage_pixels = STAGE_BYTES / size > 0 ? STAGE_BYTES / size : 1;
+    char *stage = MemStats_malloc((size_t)stage_pixels * size);
+
+    for (int r = 0; r < out_height; r++) {
+        char *out_row = dst + (size_t)r * dst_stride;
+
+        /* the source moves by (di, dj) per output column */
+        int i, j, next_i, next_j;
+        source_coords(orientation, 0, r, width, height, &i, &j);
+        if (out_width > 1) {
+            source_coords(orientation, 1, r, width, height,
+                          &next_i, &next_j);
+        } else {
+            next_i = i;
+            next_j = j;
+        }
+        int di = next_i - i;
+        int dj = next_j - j;
+
+        for (int c0 = 0; c0 < out_width; c0 += stage_pixels) {
+            int n = out_width - c0 < stage_pixels ? out_width - c0
+                                                  : stage_pixels;
+            for (int k = 0; k < n; k++) {
+                if (prefetch > 0) {
+                    int ahead_i = i + di * prefetch;
+                    int ahead_j = j + dj * prefetch;
+                    if (ahead_i >= 0 && ahead_i < width &&
+                        ahead_j >= 0 && ahead_j < height) {
+                        __builtin_prefetch(src + (size_t)ahead_j * src_stride
+                                           + (size_t)ahead_i * size);
+                    }
+                }
+                copy_pixel(stage + (size_t)k * size,
+                           src + (size_t)j * src_stride + (size_t)i * size,
+                           size);
+                i += di;
+                j += dj;
+            }
+            if (nontemporal) {
+                stream_out(out_row + (size_t)c0 * size, stage,
+                           (size_t)n * size);
+            } else {
+                memcpy(out_row + (size_t)c0 * size, stage, (size_t)n * size);
+            }
+        }
+    }
+#ifdef __SSE2__
+    /* order the streaming stores before anyone reads the output */
+    if (nontemporal) {
+        _mm_sfence();
+    }
+#endif
+
+    MemStats_free(stage, (size_t)stage_pixels * size);
+
+    input_ppm->width = out_width;
+    input_ppm->height = out_height;
+    input_ppm->pixels = output_array;
+    methods->free(&input_array);
+
+    return input_ppm;
+}
+
+/* transform_update
+ *    Purpose: Bring a transformed image up to date after parts of its
+ *             source changed. Each dirty rectangle, in source coordinates,
+ *             is clipped to the source and its corners are mapped with
+ *             orient_coords to the rectangle it covers in the output;
+ *             only those output cells are rewritten, a block (or, for an
+ *             unblocked array, a row) at a time, so the cost follows the
+ *             edited area and not the image size
+ * Parameters: the edited source image, the output transformed from it
+ *             with 'orientation', and the dirty rectangles and their count
+ *    Returns: the number of output cells rewritten
+ *
+ * Expected input: an output whose size is the oriented size of the source,
+ *                 with elements of the same size
+ * Success output: none
+ * Failure output: CRE if the output does not match the source
+ */
+long transform_update(Pnm_ppm source, Pnm_ppm output, Orientation orientation,
+                      const Rect *dirty, int count)
+{
+    assert(source && output && (dirty || count == 0));
+
+    const struct A2Methods_T *in_methods = source->methods;
+    const struct A2Methods_T *out_methods = output->methods;
+    int width = source->width;
+    int height = source->height;
+    int size = in_methods->size(source->pixels);
+    assert(out_methods->size(output->pixels) == size);
+    if (Orientation_swaps(orientation)) {
+        assert((int)output->width == height && (int)output->height == width);
+    } else {
+        assert((int)output->width == width && (int)output->height == height);
+    }
+
+    int band_height, block_width;
+    band_geometry(out_methods, output->pixels, &band_height, &block_width);
+
+    long cells = 0;
+    for (int r = 0; r < count; r++) {
+        int x0 = dirty[r].x < 0 ? 0 : dirty[r].x;
+        int y0 = dirty[r].y < 0 ? 0 : dirty[r].y;
+        /* the far edges are summed in long so they cannot overflow */
+        long far_x = (long)dirty[r].x + dirty[r].width;
+        long far_y = (long)dirty[r].y + dirty[r].height;
+        int x1 = far_x > width ? width : far_x;
+        int y1 = far_y > height ? height : far_y;
+        if (x0 >= x1 || y0 >= y1) {
+            continue;
+        }
+
+        /* opposite corners map to opposite corners of the output box */
+        int ax, ay, bx, by;
+        orient_coords(orientation, x0, y0, width, height, &ax, &ay);
+        orient_coords(orientation, x1 - 1, y1 - 1, width, height, &bx, &by);
+        int out_x0 = ax < bx ? ax : bx, out_x1 = (ax < bx ? bx : ax) + 1;
+        int out_y0 = ay < by ? ay : by, out_y1 = (ay < by ? by : ay) + 1;
+
+        /* visit the box one output block (or row) at a time */
+        int band_start = out_y0 - out_y0 % band_height;
+        int block_start = out_x0 - out_x0 % block_width;
+        for (int by0 = band_start; by0 < out_y1; by0 += band_height) {
+            int ylo = by0 > out_y0 ? by0 : out_y0;
+            int yhi = by0 + band_height < out_y1 ? by0 + band_height
+                                                 : out_y1;
+            for (int bx0 = block_start; bx0 < out_x1; bx0 += block_width) {
+                int xlo = bx0 > out_x0 ? bx0 : out_x0;
+                int xhi = bx0 + block_width < out_x1 ? bx0 + block_width
+                                                     : out_x1;
+                for (int y = ylo; y < yhi; y++) {
+                    for (int x = xlo; x < xhi; x++) {
+                        int i, j;
+                        source_coords(orientation, x, y, width, height,
+                                      &i, &j);
+                        copy_pixel(out_methods->at(output->pixels, x, y),
+                                   in_methods->at(source->pixels, i, j),
+                                   size);
+                    }
+                }
+                cells += (long)(xhi - xlo) * (yhi - ylo);
+            }
+        }
+    }
+    return cells;
+}
+
+/* FANOUT_TILE is the side of the source tiles transform_fanout copies
+ * through raw storage
+ */
+#define FANOUT_TILE 64
+
+/* fanout_raw
+ *    Purpose: transform_fanout for arrays with raw storage: copy each
+ *             source tile to every output in turn, a source row at a time
+ *             with the output pointer stepping by the fixed distance one
+ *             source column moves it (orient_coords is affine)
+ */
+static void fanout_raw(struct FanoutData *data, A2Methods_UArray2 input)
+{
+    const struct A2Methods_T *methods = data->methods;
+    const char *src = methods->data(input);
+    int src_stride = methods->stride(input);
+    int width = data->width, height = data->height, size = data->size;
+
+    for (int tj = 0; tj < height; tj += FANOUT_TILE) {
+        int j_end = tj + FANOUT_TILE < height ? tj + FANOUT_TILE : height;
+        for (int ti = 0; ti < width; ti += FANOUT_TILE) {
+            int i_end = ti + FANOUT_TILE < width ? ti + FANOUT_TILE : width;
+            for (int k = 0; k < data->count; k++) {
+                Orientation orientation = data->orientations[k];
+                char *dst = methods->data(data->outputs[k]);
+                int dst_stride = methods->stride(data->outputs[k]);
+                int i0, j0, i1, j1;
+                orient_coords(orientation, 0, 0, width, height, &i0, &j0);
+                orient_coords(orientation, 1, 0, width, height, &i1, &j1);
+                ptrdiff_t step = (ptrdiff_t)(i1 - i0) * size
+                                 + (ptrdiff_t)(j1 - j0) * dst_stride;
+                for (int j = tj; j < j_end; j++) {
+                    int new_i, new_j;
+                    orient_coords(orientation, ti, j, width, height,
+                                  &new_i, &new_j);
+                    const char *in = src + (size_t)j * src_stride
+                                     + (size_t)ti * size;
+                    char *out = dst + (size_t)new_j * dst_stride
+                                + (size_t)new_i * size;
+                    for (int i = ti; i < i_end; i++, in += size,
+                                                out += step) {
+                        copy_pixel(out, in, size);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* transform_fanout
+ *    Purpose: Produce several orientations of one image in a single
+ *             traversal of it. The source is visited tile by tile (block
+ *             by block for a blocked suite), and each tile is copied to
+ *             every output while it is in cache; the tile lands on a tile
+ *             of each output, so the writes are local too
+ * Parameters: a Pnm_ppm for the source image, the orientations, how many
+ *             there are, and where to store the output images
+ *    Returns: void
+ *
+ * Expected input: a valid ppm image whose methods suite is the one to
+ *                 use, at least one orientation, and room for as many
+ *                 images in 'outputs'
+ * Success output: count new images, freed with Pnm_ppmfree; the source is
+ *                 not changed
+ * Failure output: CRE if the arguments are invalid or memory runs out
+ */
+void transform_fanout(Pnm_ppm input_ppm, const Orientation *orientations,
+                      int count, Pnm_ppm *outputs)
+{
+    assert(input_ppm && orientations && outputs && count >= 1);
+    const struct A2Methods_T *methods = input_ppm->methods;
+    A2Methods_UArray2 input_array = input_ppm->pixels;
+
+    struct FanoutData data;
+    data.methods = methods;
+    data.orientations = orientations;
+    data.count = count;
+    data.width = input_ppm->width;
+    data.height = input_ppm->height;
+    data.size = methods->size(input_array);
+    data.outputs = MemStats_malloc(count * sizeof(A2Methods_UArray2));
+
+    for (int k = 0; k < count; k++) {
+        int swaps = Orientation_swaps(orientations[k]);
+        data.outputs[k] = new_like(methods, input_ppm,
+                                   swaps ? data.height : data.width,
+                                   swaps ? data.width : data.height,
+                                   data.size);
+    }
+
+    if (methods->data(input_array) != NULL) {
+        fanout_raw(&data, input_array);
+    } else if (methods->map_tiled != NULL) {
+        methods->map_tiled(input_array, 0, apply_fanout, &data);
+    } else {
+        methods->map_block_major(input_array, apply_fanout, &data);
+    }
+
+    for (int k = 0; k < count; k++) {
+        Pnm_ppm output;
+        NEW(output);
+        output->width = methods->width(data.outputs[k]);
+        output->height = methods->height(data.outputs[k]);
+        output->denominator = input_ppm->denominator;
+        output->pixels = data.outputs[k];
+        output->methods = methods;
+        outputs[k] = output;
+    }
+    MemStats_free(data.outputs, count * sizeof(A2Methods_UArray2));
+}
+
+/* apply_fanout
+ *    Purpose: copy one source cell to where each orientation of the
+ *             FanoutData closure puts it
+ * Parameters: the cell's column and row, the source array, the cell, and
+ *             the FanoutData closure
+ *    Returns: void
+ */
+void apply_fanout(int i, int j, A2Methods_UArray2 array2,
+                  A2Methods_Object *ptr, void *cl)
+{
+    (void) array2;
+    struct FanoutData *data = cl;
+    for (int k = 0; k < data->count; k++) {
+        int new_i, new_j;
+        orient_coords(data->orientations[k], i, j, data->width,
+                      data->height, &new_i, &new_j);
+        copy_pixel(data->methods->at(data->outputs[k], new_i, new_j), ptr,
+                   data->size);
+    }
+}
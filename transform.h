@@ -24,6 +24,28 @@
 #include "pnm.h"
 
 typedef struct ArrayData *ArrayData;
+typedef struct ScaleData *ScaleData;
+
+/* The eight layouts ppmtrans can produce, named after the option that
+ * selects them; the transverse (the flip about the other diagonal) is
+ * only produced by -emit
+ */
+typedef enum Orientation {
+        ORIENT_0, ORIENT_90, ORIENT_180, ORIENT_270,
+        ORIENT_FLIP_H, ORIENT_FLIP_V, ORIENT_TRANSPOSE, ORIENT_TRANSVERSE
+} Orientation;
+
+/* A rectangle of cells: columns x .. x + width - 1, rows y .. y + height - 1 */
+typedef struct Rect {
+        int x, y, width, height;
+} Rect;
+
+Orientation orientation_of(int degrees, char *flip, int transpose);
+int Orientation_swaps(Orientation orientation);
+void orient_coords(Orientation orientation, int i, int j, int width,
+                            int height, int *new_i, int *new_j);
+void source_coords(Orientation orientation, int new_i, int new_j, int width,
+                              int height, int *i, int *j);
 
 Pnm_ppm transform(Pnm_ppm input_ppm, int degrees, char *flip, int transpose,
                                 A2Methods_T methods, A2Methods_mapfun *map);
@@ -61,4 +83,31 @@ Pnm_ppm transpose(Pnm_ppm input_ppm, A2Methods_T methods,
 void apply_transpose(int i, int j, A2Methods_UArray2 array2,
                            A2Methods_Object *ptr, void *cl);
 
+/* the largest -scale N: the N x N sums of 16-bit channels must fit in the
+ * unsigned channels of a Pnm_rgb (65535 * 256 * 256 < 2^32)
+ */
+#define MAX_SCALE 256
+
+Pnm_ppm scale_transform(Pnm_ppm input_ppm, int degrees, char *flip,
+                        int transpose, int scale, A2Methods_T methods,
+                                                A2Methods_mapfun *map);
+void apply_scaled(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl);
+void apply_average(int i, int j, A2Methods_UArray2 array2,
+                         A2Methods_Object *ptr, void *cl);
+void apply_narrow(int i, int j, A2Methods_UArray2 array2,
+                        A2Methods_Object *ptr, void *cl);
+
+Pnm_ppm transform_parallel(Pnm_ppm input_ppm, Orientation orientation,
+                                   A2Methods_T methods, int nthreads);
+Pnm_ppm transform_streaming(Pnm_ppm input_ppm, Orientation orientation,
+                            A2Methods_T methods, int prefetch,
+                            int nontemporal);
+long transform_update(Pnm_ppm source, Pnm_ppm output,
+                      Orientation orientation, const Rect *dirty, int count);
+void transform_fanout(Pnm_ppm input_ppm, const Orientation *orientations,
+                      int count, Pnm_ppm *outputs);
+void apply_fanout(int i, int j, A2Methods_UArray2 array2,
+                  A2Methods_Object *ptr, void *cl);
+
 #endif /* __TRANSFORM */
\ No newline at end of file
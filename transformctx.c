@@ -0,0 +1,353 @@
+/**************************************************************
+ *
+ *                     transformctx.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of transform contexts. The destination is
+ *     cut into bands of rows, one row of blocks for a blocked
+ *     array and TILE rows for a plain one, and every band is
+ *     filled tile by tile, a tile being a block or TILE x TILE
+ *     cells, so the source cells a tile reads stay in cache while
+ *     it is written. The workers and the caller take bands from a
+ *     shared counter until none are left, so a slow thread delays
+ *     only its own band.
+ *
+ *     There are two kernels, chosen for each transform: when both
+ *     arrays have raw access (the plain suite), a row of a tile
+ *     is copied by stepping a source pointer by the fixed distance
+ *     one output column moves it; otherwise every cell goes
+ *     through the suite's at.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "assert.h"
+#include "mem.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "trace.h"
+#include "transformctx.h"
+
+#define T TransformCtx_T
+
+/* the tile side, in cells, for arrays without blocks */
+#define TILE 64
+
+/* Job is one transform_into call, shared by the threads running it */
+typedef struct Job {
+        A2Methods_T methods;
+        A2Methods_UArray2 dst, src;
+        Orientation orientation;
+        int width, height;              /* of the source */
+        int out_width, out_height;
+        int size;
+        int band_height, tile_width;
+        int bands;
+        int next_band;                  /* taken with an atomic add */
+        int raw;                        /* both arrays have raw access */
+        char *dst_data;
+        const char *src_data;
+        int dst_stride, src_stride;
+        ptrdiff_t step;                 /* source bytes per output column */
+} Job;
+
+struct T {
+        A2Methods_T methods;
+        int threads;
+        pthread_t *workers;             /* threads - 1 of them */
+        pthread_mutex_t lock;
+        pthread_cond_t start, done;
+        unsigned long generation;       /* bumped for every job */
+        int running;                    /* workers still on the job */
+        int stop;
+        Job job;
+};
+
+static void *worker(void *cl);
+static void run_bands(Job *job);
+
+/* TransformCtx_new
+ * Purpose: Make a transform context and start its worker threads
+ * Parameters: the methods suite of the arrays to transform and the number
+ *             of threads, the caller's included
+ * Returns: the context, freed with TransformCtx_free
+ *
+ * Expected input: a non-null suite and at least one thread
+ * Success output: none
+ * Failure output: CRE if the arguments are invalid or a thread cannot be
+ *                 started
+ */
+T TransformCtx_new(A2Methods_T methods, int threads)
+{
+        assert(methods != NULL && threads >= 1);
+        T ctx;
+        NEW0(ctx);
+        ctx->methods = methods;
+        ctx->threads = threads;
+        pthread_mutex_init(&ctx->lock, NULL);
+        pthread_cond_init(&ctx->start, NULL);
+        pthread_cond_init(&ctx->done, NULL);
+        if (threads > 1) {
+                ctx->workers = ALLOC((threads - 1) * sizeof(pthread_t));
+                for (int t = 0; t < threads - 1; t++) {
+                        int rc = pthread_create(&ctx->workers[t], NULL,
+                                                worker, ctx);
+                        assert(rc == 0);
+                }
+        }
+        return ctx;
+}
+
+/* TransformCtx_free
+ * Purpose: Stop a context's workers and free the context
+ * Parameters: a pointer to the context
+ * Returns: void
+ *
+ * Expected input: a context from TransformCtx_new with no transform
+ *                 running
+ * Success output: none
+ * Failure output: CRE if the context is NULL
+ */
+void TransformCtx_free(T *ctx)
+{
+        assert(ctx != NULL && *ctx != NULL);
+        T c = *ctx;
+        pthread_mutex_lock(&c->lock);
+        c->stop = 1;
+        pthread_cond_broadcast(&c->start);
+        pthread_mutex_unlock(&c->lock);
+        for (int t = 0; t < c->threads - 1; t++) {
+                pthread_join(c->workers[t], NULL);
+        }
+        if (c->workers != NULL) {
+                FREE(c->workers);
+        }
+        pthread_cond_destroy(&c->done);
+        pthread_cond_destroy(&c->start);
+        pthread_mutex_destroy(&c->lock);
+        FREE(*ctx);
+}
+
+/* TransformCtx_shape
+ * Purpose: Give the shape of an array once transformed
+ * Parameters: the orientation, the array's width and height, and where to
+ *             put the transformed width and height
+ * Returns: void
+ *
+ * Expected input: non-null pointers
+ * Success output: none
+ * Failure output: none
+ */
+void TransformCtx_shape(Orientation orientation, int width, int height,
+                        int *out_width, int *out_height)
+{
+        assert(out_width != NULL && out_height != NULL);
+        int swaps = Orientation_swaps(orientation);
+        *out_width = swaps ? height : width;
+        *out_height = swaps ? width : height;
+}
+
+/* transform_into
+ * Purpose: Transform a source array into a destination array, leaving the
+ *          source unchanged, on the context's threads
+ * Parameters: the context, the destination and source arrays, and the
+ *             orientation
+ * Returns: void
+ *
+ * Expected input: arrays of the context's suite with the same element
+ *                 size that do not overlap, the destination having the
+ *                 transformed shape of the source
+ * Success output: none
+ * Failure output: CRE if the arrays do not fit together
+ */
+void transform_into(T ctx, A2Methods_UArray2 dst, A2Methods_UArray2 src,
+                    Orientation orientation)
+{
+        assert(ctx != NULL && dst != NULL && src != NULL && dst != src);
+        A2Methods_T methods = ctx->methods;
+        Job *job = &ctx->job;
+
+        job->methods = methods;
+        job->dst = dst;
+        job->src = src;
+        job->orientation = orientation;
+        job->width = methods->width(src);
+        job->height = methods->height(src);
+        job->size = methods->size(src);
+        job->out_width = methods->width(dst);
+        job->out_height = methods->height(dst);
+        int out_width, out_height;
+        TransformCtx_shape(orientation, job->width, job->height,
+                           &out_width, &out_height);
+        assert(job->out_width == out_width && job->out_height == out_height);
+        assert(methods->size(dst) == job->size);
+
+        methods->block_shape(dst, &job->tile_width, &job->band_height);
+        if (job->tile_width == 1 && job->band_height == 1) {
+                job->tile_width = job->band_height = TILE;
+        }
+        job->bands = (out_height + job->band_height - 1) / job->band_height;
+        job->next_band = 0;
+
+        job->dst_data = methods->data(dst);
+        job->src_data = methods->data(src);
+        job->raw = job->dst_data != NULL && job->src_data != NULL;
+        if (job->raw) {
+                job->dst_stride = methods->stride(dst);
+                job->src_stride = methods->stride(src);
+                /* source_coords is affine, so one output column always
+                 * moves the source cell by the same number of bytes
+                 */
+                int i0, j0, i1, j1;
+                source_coords(orientation, 0, 0, job->width, job->height,
+                              &i0, &j0);
+                source_coords(orientation, 1, 0, job->width, job->height,
+                              &i1, &j1);
+                job->step = (ptrdiff_t)(i1 - i0) * job->size
+                            + (ptrdiff_t)(j1 - j0) * job->src_stride;
+        }
+
+        if (ctx->threads == 1 || job->bands == 1) {
+                run_bands(job);
+                return;
+        }
+        pthread_mutex_lock(&ctx->lock);
+        ctx->running = ctx->threads - 1;
+        ctx->generation++;
+        pthread_cond_broadcast(&ctx->start);
+        pthread_mutex_unlock(&ctx->lock);
+
+        run_bands(job);
+
+        pthread_mutex_lock(&ctx->lock);
+        while (ctx->running > 0) {
+                pthread_cond_wait(&ctx->done, &ctx->lock);
+        }
+        pthread_mutex_unlock(&ctx->lock);
+}
+
+/* worker
+ *    Purpose: worker thread body: run the bands of each job it is woken
+ *             for until the context is freed
+ *    Returns: NULL
+ */
+static void *worker(void *cl)
+{
+        T ctx = cl;
+        unsigned long seen = 0;
+        pthread_mutex_lock(&ctx->lock);
+        for (;;) {
+                while (!ctx->stop && ctx->generation == seen) {
+                        pthread_cond_wait(&ctx->start, &ctx->lock);
+                }
+                if (ctx->stop) {
+                        break;
+                }
+                seen = ctx->generation;
+                pthread_mutex_unlock(&ctx->lock);
+
+                run_bands(&ctx->job);
+
+                pthread_mutex_lock(&ctx->lock);
+                if (--ctx->running == 0) {
+                        pthread_cond_signal(&ctx->done);
+                }
+        }
+        pthread_mutex_unlock(&ctx->lock);
+        return NULL;
+}
+
+/* copy_cell
+ *    Purpose: copy one cell; the pixel types get fixed-size copies so the
+ *             compiler emits plain moves instead of a call to memcpy
+ */
+static inline void copy_cell(void *dst, const void *src, int size)
+{
+        switch (size) {
+        case sizeof(struct Pnm_rgb):
+                *(Pnm_rgb)dst = *(const struct Pnm_rgb *)src;
+                break;
+        case sizeof(struct Pnm_rgb16):
+                *(Pnm_rgb16)dst = *(const struct Pnm_rgb16 *)src;
+                break;
+        default:
+                memcpy(dst, src, size);
+                break;
+        }
+}
+
+/* raw_tile
+ *    Purpose: fill columns x0 .. x1 - 1 of rows y0 .. y1 - 1 of the
+ *             destination through the arrays' raw storage
+ */
+static void raw_tile(Job *job, int x0, int x1, int y0, int y1)
+{
+        int size = job->size;
+        for (int y = y0; y < y1; y++) {
+                int i, j;
+                source_coords(job->orientation, x0, y, job->width,
+                              job->height, &i, &j);
+                const char *in = job->src_data + (size_t)j * job->src_stride
+                                 + (size_t)i * size;
+                char *out = job->dst_data + (size_t)y * job->dst_stride
+                            + (size_t)x0 * size;
+                for (int x = x0; x < x1; x++, out += size, in += job->step) {
+                        copy_cell(out, in, size);
+                }
+        }
+}
+
+/* methods_tile
+ *    Purpose: fill the same cells as raw_tile through the suite's at
+ */
+static void methods_tile(Job *job, int x0, int x1, int y0, int y1)
+{
+        A2Methods_T methods = job->methods;
+        for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                        int i, j;
+                        source_coords(job->orientation, x, y, job->width,
+                                      job->height, &i, &j);
+                        copy_cell(methods->at(job->dst, x, y),
+                                  methods->at(job->src, i, j), job->size);
+                }
+        }
+}
+
+/* run_bands
+ *    Purpose: take bands of the job until none are left and fill each one
+ *             tile by tile
+ */
+static void run_bands(Job *job)
+{
+        for (;;) {
+                int band = __atomic_fetch_add(&job->next_band, 1,
+                                              __ATOMIC_RELAXED);
+                if (band >= job->bands) {
+                        return;
+                }
+                uint64_t start = Trace_begin();
+                int y0 = band * job->band_height;
+                int y1 = y0 + job->band_height < job->out_height
+                         ? y0 + job->band_height : job->out_height;
+                for (int x0 = 0; x0 < job->out_width; x0 += job->tile_width) {
+                        int x1 = x0 + job->tile_width < job->out_width
+                                 ? x0 + job->tile_width : job->out_width;
+                        if (job->raw) {
+                                raw_tile(job, x0, x1, y0, y1);
+                        } else {
+                                methods_tile(job, x0, x1, y0, y1);
+                        }
+                }
+                Trace_end("band", start, band);
+        }
+}
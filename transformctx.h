@@ -0,0 +1,55 @@
+/**************************************************************
+ *
+ *                     transformctx.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The transform as a library, for programs that transform many
+ *     images. Unlike transform, which consumes its input image and
+ *     allocates the output, transform_into reads a source array
+ *     without changing it and writes into a destination array the
+ *     caller owns, which may be wrapped around the caller's own
+ *     memory (UArray2_wrap, UArray2b_wrap). A context holds what
+ *     transforms have in common: the methods suite and a pool of
+ *     worker threads, started once and reused, so a transform
+ *     allocates nothing.
+ *
+ *     Built into libppmtrans.a and libppmtrans.so (make lib).
+ *
+ **************************************************************/
+
+#ifndef __TRANSFORMCTX__
+#define __TRANSFORMCTX__
+
+#include "a2methods.h"
+#include "transform.h"
+
+#define T TransformCtx_T
+typedef struct T *T;
+
+/* A context for transforming arrays of the 'methods' suite on 'threads'
+ * threads, the caller's included (1 for no workers). A thread count below
+ * 1 or a NULL suite is a checked run-time error
+ */
+extern T TransformCtx_new(A2Methods_T methods, int threads);
+
+/* Stop the context's workers and free it */
+extern void TransformCtx_free(T *ctx);
+
+/* The width and height of a width x height array once transformed */
+extern void TransformCtx_shape(Orientation orientation, int width,
+                               int height, int *out_width, int *out_height);
+
+/* Write the 'orientation' transform of 'src' into 'dst', both arrays of
+ * the context's suite with the same element size; 'dst' must have the
+ * shape TransformCtx_shape gives and must not overlap 'src', which is
+ * left unchanged. A context runs one transform at a time
+ */
+extern void transform_into(T ctx, A2Methods_UArray2 dst,
+                           A2Methods_UArray2 src, Orientation orientation);
+
+#undef T
+#endif /* __TRANSFORMCTX__ */
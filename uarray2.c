@@ -1,72 +1,108 @@
-#line 50 "www/solutions/uarray2.nw"
+/**************************************************************
+ *
+ *                     uarray2.c
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     Implementation of the plain 2D array. The cells are kept in
+ *     one allocation with a padded row stride, so finding a cell
+ *     is one multiply-add instead of a lookup of its row, and a
+ *     column walk steps through memory by a constant distance.
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+
 #include "assert.h"
 #include "mem.h"
-#include "uarray.h"
 #include "uarray2.h"
 
 #define T UArray2_T
 
-/* 
- * Element (i, j) in the world of ideas maps to
- * rows[j][i] where the square brackets stand for access
- * to a Hanson UArray_T
+/* CACHE_LINE is the alignment of the storage and of every row */
+#define CACHE_LINE 64
+
+/*
+ * Element (i, j) in the world of ideas lives at
+ * cells + j * stride + i * size
  */
 struct T {
         int width, height;
         int size;
-        UArray_T rows; /* UArray_T of 'height' UArray_Ts,
-                          each of length 'width' and size 'size' */
+        int stride;             /* bytes from one row to the next */
+        char *cells;
+        int wrapped;            /* the caller owns the cells */
+        void (*release)(void *storage, void *cl);
+        void *release_cl;
 };
-#line 79 "www/solutions/uarray2.nw"
-static inline UArray_T row(T a, int j)
+
+static inline char *cell(T a, int i, int j)
 {
-        UArray_T *prow = UArray_at(a->rows, j);   /* Ramsey idiom */
-        return *prow;
+        return a->cells + (size_t)j * a->stride + (size_t)i * a->size;
 }
-#line 92 "www/solutions/uarray2.nw"
-static int is_ok(T a)
+
+T UArray2_new(int width, int height, int size)
 {
-        return a && UArray_length(a->rows) == a->height &&
-               UArray_size(a->rows) == sizeof(UArray_T) &&
-               (a->height == 0 || (UArray_length(row(a, 0)) == a->width
-                                   && UArray_size  (row(a, 0)) == a->size));
+        assert(width >= 0 && height >= 0 && size > 0);
+        assert((long)width * size <= (1L << 30));
+
+        T array;
+        NEW(array);
+        array->width  = width;
+        array->height = height;
+        array->size   = size;
+        array->stride = (width * size + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+
+        size_t bytes = (size_t)array->stride * height;
+        void *cells = NULL;
+        int rc = posix_memalign(&cells, CACHE_LINE, bytes > 0 ? bytes : 1);
+        assert(rc == 0 && cells != NULL);
+        array->cells = cells;
+        array->wrapped = 0;
+        return array;
 }
-#line 109 "www/solutions/uarray2.nw"
-T UArray2_new(int width, int height, int size)
+
+T UArray2_wrap(int width, int height, int size, int stride, void *storage,
+               void release(void *storage, void *cl), void *cl)
 {
-        int i;  /* interates over row number */
+        assert(width >= 0 && height >= 0 && size > 0);
+        assert(stride >= (long)width * size && storage != NULL);
+
         T array;
         NEW(array);
         array->width  = width;
         array->height = height;
         array->size   = size;
-        array->rows   = UArray_new(height, sizeof(UArray_T));
-        for (i = 0; i < height; i++) {
-                UArray_T *rowp = UArray_at(array->rows, i);
-                *rowp = UArray_new(width, size);
-        }
-        assert(is_ok(array));
+        array->stride = stride;
+        array->cells  = storage;
+        array->wrapped = 1;
+        array->release = release;
+        array->release_cl = cl;
         return array;
 }
-#line 131 "www/solutions/uarray2.nw"
+
 void UArray2_free(T *array2)
 {
-        int i;
         assert(array2 && *array2);
-        for (i = 0; i < (*array2)->height; i++) {
-                UArray_T p = row(*array2, i);
-                UArray_free(&p);
+        T array = *array2;
+        if (!array->wrapped) {
+                free(array->cells);
+        } else if (array->release != NULL) {
+                array->release(array->cells, array->release_cl);
         }
-        UArray_free(&(*array2)->rows);
         FREE(*array2);
 }
-#line 151 "www/solutions/uarray2.nw"
+
 void *UArray2_at(T array2, int i, int j)
 {
         assert(array2);
-        return UArray_at(row(array2, j), i);
+        assert(i >= 0 && i < array2->width && j >= 0 && j < array2->height);
+        return cell(array2, i, j);
 }
-#line 162 "www/solutions/uarray2.nw"
+
 int UArray2_height(T array2)
 {
         assert(array2);
@@ -84,32 +120,62 @@ int UArray2_size(T array2)
         assert(array2);
         return array2->size;
 }
-#line 193 "www/solutions/uarray2.nw"
-void UArray2_map_row_major(T array2, 
-                           void apply(int i, int j, T array2, 
-                                      void *elem, void *cl), 
-                           void *cl)
+
+void *UArray2_data(T array2)
+{
+        assert(array2);
+        return array2->cells;
+}
+
+int UArray2_stride(T array2)
+{
+        assert(array2);
+        return array2->stride;
+}
+
+void UArray2_map_row_major(T array2, UArray2_applyfun apply, void *cl)
 {
         assert(array2);
         int h = array2->height;  /* keeping height and width in registers */
         int w = array2->width;   /* avoids extra memory traffic           */
+        int size = array2->size;
         for (int j = 0; j < h; j++) {
-                /* don't want row/UArray_at in inner loop */
-                UArray_T thisrow = row(array2, j); 
-                for (int i = 0; i < w; i++)
-                        apply(i, j, array2, UArray_at(thisrow, i), cl);
+                char *p = cell(array2, 0, j);
+                for (int i = 0; i < w; i++, p += size)
+                        apply(i, j, array2, p, cl);
         }
 }
-#line 211 "www/solutions/uarray2.nw"
-void UArray2_map_col_major(T array2, 
-                           void apply(int i, int j, T array2, 
-                                      void *elem, void *cl), 
-                           void *cl)
+
+void UArray2_map_col_major(T array2, UArray2_applyfun apply, void *cl)
 {
         assert(array2);
-        int h = array2->height;  /* keeping height and width in registers */
-        int w = array2->width;   /* avoids extra memory traffic           */
-        for (int i = 0; i < w; i++)
-                for (int j = 0; j < h; j++)
-                        apply(i, j, array2, UArray_at(row(array2, j), i), cl);
-}
\ No newline at end of file
+        int h = array2->height;
+        int w = array2->width;
+        int stride = array2->stride;
+        for (int i = 0; i < w; i++) {
+                char *p = cell(array2, i, 0);
+                for (int j = 0; j < h; j++, p += stride)
+                        apply(i, j, array2, p, cl);
+        }
+}
+
+void UArray2_map_tiled(T array2, int tile, UArray2_applyfun apply, void *cl)
+{
+        assert(array2 && tile >= 1);
+        int h = array2->height;
+        int w = array2->width;
+        int size = array2->size;
+        for (int tj = 0; tj < h; tj += tile) {
+                int jend = tj + tile < h ? tj + tile : h;
+                for (int ti = 0; ti < w; ti += tile) {
+                        int iend = ti + tile < w ? ti + tile : w;
+                        for (int j = tj; j < jend; j++) {
+                                char *p = cell(array2, ti, j);
+                                for (int i = ti; i < iend; i++, p += size)
+                                        apply(i, j, array2, p, cl);
+                        }
+                }
+        }
+}
+
+#undef T
@@ -0,0 +1,78 @@
+/**************************************************************
+ *
+ *                     uarray2.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 15, 2021
+ *
+ *     Summary
+ *     The plain 2D array interface. This is the course interface
+ *     extended with raw access to the array's storage.
+ *
+ *     Storage layout
+ *     All cells live in one contiguous allocation, aligned to a
+ *     cache line. Each row holds 'width' cells in order and starts
+ *     UArray2_stride bytes after the row before it; the stride is
+ *     width * size rounded up to a whole number of cache lines, so
+ *     every row starts on a line of its own.
+ *
+ **************************************************************/
+
+#ifndef UARRAY2_INCLUDED
+#define UARRAY2_INCLUDED
+
+#define T UArray2_T
+typedef struct T *T;
+
+typedef void UArray2_applyfun(int i, int j, T array2, void *elem, void *cl);
+
+/* new 2d array of width * height cells of 'size' bytes each, which are
+ * not initialized. A negative width or height, or a size below 1, is a
+ * checked runtime error
+ */
+extern T UArray2_new(int width, int height, int size);
+
+/* new 2d array over storage the caller provides, with rows 'stride'
+ * bytes apart (at least width * size). The array does not own the
+ * storage: freeing the array calls 'release' (if not NULL) with the
+ * storage and 'cl'. Such an array is freed with UArray2_free, since the
+ * plain methods suite counts only the arrays it allocates
+ */
+extern T UArray2_wrap(int width, int height, int size, int stride,
+                      void *storage, void release(void *storage, void *cl),
+                      void *cl);
+
+extern void UArray2_free(T *array2);
+
+extern int UArray2_width (T array2);
+extern int UArray2_height(T array2);
+extern int UArray2_size  (T array2);
+
+/* the cell in column 0, row 0, and the bytes from one row to the next */
+extern void *UArray2_data  (T array2);
+extern int   UArray2_stride(T array2);
+
+/* return a pointer to the cell in the given column and row.
+ * index out of range is a checked run-time error
+ */
+extern void *UArray2_at(T array2, int i, int j);
+
+/* visit every cell, row by row or column by column */
+extern void UArray2_map_row_major(T array2, UArray2_applyfun apply, void *cl);
+extern void UArray2_map_col_major(T array2, UArray2_applyfun apply, void *cl);
+
+/* visit every cell, tile by tile: tiles of tile * tile cells (smaller on
+ * the right and bottom edges) in row-major order, each in row-major
+ * order. A tile below 1 is a checked run-time error
+ */
+extern void UArray2_map_tiled(T array2, int tile, UArray2_applyfun apply,
+                              void *cl);
+
+/*
+ * it is a checked run-time error to pass a NULL T
+ * to any function in this interface
+ */
+
+#undef T
+#endif
@@ -11,9 +11,14 @@
  *
  *     Note
  *     The blocksize parameter counts the number of cells on 
- *     one side of a block. Some memory is wasted at the right 
- *     and bottom edges: not all the cells in those blocks are used.
- *     
+ *     one side of a block; blocks may also be rectangles of
+ *     block_width * block_height cells. Some memory is wasted at
+ *     the right and bottom edges: not all the cells in those
+ *     blocks are used.
+ *
+ *     All blocks share one contiguous allocation, laid out as
+ *     uarray2b.h describes, so a whole array can be written to or
+ *     mapped from a file as a single region.
  *
  **************************************************************/
 
@@ -23,22 +28,32 @@
 #include <assert.h>
 #include <math.h>
 
-#include <uarray.h>
-#include <uarray2.h>
-#include <uarray2b.h>
+#include "uarray2b.h"
 #define T UArray2b_T
 
 struct T {
     int width;
     int height;
     int size;
-    int blocksize;
+    int block_width;
+    int block_height;
     int num_vert_blocks;
     int num_hort_blocks;
-    
-    UArray2_T block_array;
+
+    char *storage;                              /* every block, in order */
+    void (*release)(void *storage, void *cl);   /* NULL if we own it */
+    void *release_cl;
 };
 
+/* block_bytes
+ *    Purpose: the number of bytes in one block, unused cells included
+ */
+static inline size_t block_bytes(T array2b)
+{
+    return (size_t)array2b->block_width * array2b->block_height
+           * array2b->size;
+}
+
 /*
 * new blocked 2d array
 * blocksize = square root of # of cells in block.
@@ -46,32 +61,26 @@ struct T {
 */
 extern T UArray2b_new (int width, int height, int size, int blocksize)
 {
-    assert(blocksize >= 1 && width >= 1 && height >= 1 && size > 0);
-    
-    int num_vert_blocks = ceil((float) height / (float) blocksize);
-    int num_hort_blocks = ceil((float) width / (float) blocksize);
-
-    UArray2_T block_array = UArray2_new(num_hort_blocks, num_vert_blocks,
-                                                       sizeof(UArray_T));
+    return UArray2b_new_shape(width, height, size, blocksize, blocksize);
+}
 
-    for (int i = 0; i < num_vert_blocks; i++) {
-        for (int j = 0; j < num_hort_blocks; j++) {
-            UArray_T new_array = UArray_new(blocksize * blocksize, size);
-            *(UArray_T *)(UArray2_at(block_array, j, i)) = new_array;
-        }
-    }
+/*
+* new blocked 2d array with blocks of block_width columns and
+* block_height rows. Either below 1 is a checked runtime error
+*/
+extern T UArray2b_new_shape(int width, int height, int size,
+                            int block_width, int block_height)
+{
+    assert(block_width >= 1 && block_height >= 1);
+    assert(width >= 1 && height >= 1 && size > 0);
 
-    T array = malloc(sizeof(struct T));
-    assert(array != NULL); 
-    
-    array->width = width;
-    array->height = height;
-    array->size = size;
-    array->blocksize = blocksize;
-    array->block_array = block_array;
-    array->num_vert_blocks = ceil((float) height / (float) blocksize);
-    array->num_hort_blocks = ceil((float) width / (float) blocksize);
+    void *storage = calloc(1, UArray2b_storage_size(width, height, size,
+                                                    block_width,
+                                                    block_height));
+    assert(storage != NULL);
 
+    T array = UArray2b_wrap(width, height, size, block_width, block_height,
+                            storage, NULL, NULL);
     return array;
 }
 
@@ -83,24 +92,47 @@ extern T UArray2b_new_64K_block(int width, int height, int size){
     return UArray2b_new(width, height, size, blocksize);
 }
 
-extern void UArray2b_free (T *array2b)
+/* new blocked 2d array over storage the caller provides; freeing the
+*  array hands the storage back through 'release'
+*/
+extern T UArray2b_wrap(int width, int height, int size, int block_width,
+                       int block_height, void *storage,
+                       void release(void *storage, void *cl), void *cl)
 {
-    assert(array2b != NULL && *array2b != NULL);
+    assert(block_width >= 1 && block_height >= 1);
+    assert(width >= 1 && height >= 1 && size > 0);
+    assert(storage != NULL);
 
-    UArray2_T block_array = (*array2b)->block_array;
+    T array = malloc(sizeof(struct T));
+    assert(array != NULL);
 
-    int num_vert_blocks = (*array2b)->num_vert_blocks;
-    int num_hort_blocks = (*array2b)->num_hort_blocks;
+    array->width = width;
+    array->height = height;
+    array->size = size;
+    array->block_width = block_width;
+    array->block_height = block_height;
+    array->num_vert_blocks = (height + block_height - 1) / block_height;
+    array->num_hort_blocks = (width + block_width - 1) / block_width;
+    array->storage = storage;
+    array->release = release;
+    array->release_cl = cl;
 
-    for (int i = 0; i < num_vert_blocks; i++) {
-        for (int j = 0; j < num_hort_blocks; j++) {
-            UArray_T *target_uarray = (UArray_T *)UArray2_at(block_array, j, i);
-            UArray_free(target_uarray);
-        }
+    return array;
+}
+
+extern void UArray2b_free (T *array2b)
+{
+    assert(array2b != NULL && *array2b != NULL);
+
+    T array = *array2b;
+    if (array->release != NULL) {
+        array->release(array->storage, array->release_cl);
+    } else {
+        free(array->storage);
     }
 
-    UArray2_free(&block_array);
-    free(*array2b);
+    free(array);
+    *array2b = NULL;
 }
 
 extern int UArray2b_width (T array2b)
@@ -121,10 +153,45 @@ extern int UArray2b_size (T array2b)
     return array2b->size;
 }
 
+/* the block width only; an array of rectangular blocks has
+ * UArray2b_block_height rows per block
+ */
 extern int UArray2b_blocksize(T array2b)
 {
     assert(array2b);
-    return array2b->blocksize;
+    return array2b->block_width;
+}
+
+extern int UArray2b_block_width(T array2b)
+{
+    assert(array2b);
+    return array2b->block_width;
+}
+
+extern int UArray2b_block_height(T array2b)
+{
+    assert(array2b);
+    return array2b->block_height;
+}
+
+extern void *UArray2b_storage(T array2b)
+{
+    assert(array2b);
+    return array2b->storage;
+}
+
+/* the bytes needed to hold every block of an array with these dimensions */
+extern size_t UArray2b_storage_size(int width, int height, int size,
+                                    int block_width, int block_height)
+{
+    assert(block_width >= 1 && block_height >= 1);
+    assert(width >= 1 && height >= 1 && size > 0);
+
+    size_t num_vert_blocks = (height + block_height - 1) / block_height;
+    size_t num_hort_blocks = (width + block_width - 1) / block_width;
+
+    return num_vert_blocks * num_hort_blocks
+           * block_width * block_height * size;
 }
 
 /* return a pointer to the cell in the given column and row.
@@ -136,20 +203,21 @@ extern void *UArray2b_at(T array2b, int column, int row)
     assert (column < array2b->width && column >= 0);
     assert (row < array2b->height && row >= 0);
 
-    UArray2_T block_array = array2b->block_array;
-    int blocksize = array2b->blocksize;
-    
-    int block_col = column / blocksize;
-    int block_row = row / blocksize;
+    int block_width = array2b->block_width;
+    int block_height = array2b->block_height;
+
+    int block_col = column / block_width;
+    int block_row = row / block_height;
 
     /* Convert global column and row coords to coords within block */
-    column %= blocksize;
-    row %= blocksize;
+    column %= block_width;
+    row %= block_height;
 
-    UArray_T target_uarray = *(UArray_T *)UArray2_at(block_array, block_col,
-                                                                 block_row);
-    
-    return UArray_at(target_uarray, blocksize * row + column);
+    char *block = array2b->storage
+        + ((size_t)block_row * array2b->num_hort_blocks + block_col)
+          * block_bytes(array2b);
+
+    return block + (size_t)(block_width * row + column) * array2b->size;
 }
 
 /* visits every cell in one block before moving to another block */
@@ -163,25 +231,25 @@ extern void UArray2b_map(T array2b,
     int num_hort_blocks = array2b->num_hort_blocks;
     int width = array2b->width;
     int height = array2b->height;
-    int blocksize = array2b->blocksize;
-    UArray2_T block_array = array2b->block_array;
+    int block_width = array2b->block_width;
+    int block_height = array2b->block_height;
+    int size = array2b->size;
+    int length = block_width * block_height;
+    char *block = array2b->storage;
     
     for (int b_row = 0; b_row < num_vert_blocks; b_row++) {
         for (int b_col = 0; b_col < num_hort_blocks; b_col++) {
-            
-            UArray_T *target_uarray = (UArray_T *)UArray2_at(block_array,
-                                                           b_col, b_row);
-            int length = UArray_length(*target_uarray);
 
             for (int i = 0; i < length; i++) {
-                int col = i % blocksize + b_col * blocksize;
-                int row = i / blocksize + b_row * blocksize;
+                int col = i % block_width + b_col * block_width;
+                int row = i / block_width + b_row * block_height;
 
                 if (col < width && row < height) {
-                    void *curr_elem_p = UArray_at(*target_uarray, i);
+                    void *curr_elem_p = block + (size_t)i * size;
                     apply(col, row, array2b, curr_elem_p, cl);
                 }
             }
+            block += block_bytes(array2b);
         }
     }
 }
@@ -0,0 +1,88 @@
+/**************************************************************
+ *
+ *                     uarray2b.h
+ *
+ *     Assignment: locality
+ *     Authors:  Eli Intriligator (eintri01), Katie Yang (zyang11)
+ *     Date:     Oct 14, 2021
+ *
+ *     Summary
+ *     The blocked array interface. This is the course interface
+ *     extended so a blocked array can live in storage it does not
+ *     own, such as a memory-mapped file.
+ *
+ *     Storage layout
+ *     All blocks live in one contiguous region, in row-major order
+ *     of blocks. Each block holds block_width * block_height cells
+ *     (blocksize * blocksize for square blocks) in row-major order,
+ *     including the unused cells of the blocks on the right and
+ *     bottom edges.
+ *
+ **************************************************************/
+
+#ifndef UARRAY2B_INCLUDED
+#define UARRAY2B_INCLUDED
+
+#include <stddef.h>
+
+#define T UArray2b_T
+typedef struct T *T;
+
+/*
+ * new blocked 2d array
+ * blocksize = square root of # of cells in block.
+ * blocksize < 1 is a checked runtime error
+ */
+extern T UArray2b_new(int width, int height, int size, int blocksize);
+
+/* new blocked 2d array of rectangular blocks, block_width cells wide and
+ * block_height cells high. Either below 1 is a checked runtime error
+ */
+extern T UArray2b_new_shape(int width, int height, int size,
+                            int block_width, int block_height);
+
+/* new blocked 2d array: blocksize as large as possible provided
+ * block occupies at most 64KB (if possible)
+ */
+extern T UArray2b_new_64K_block(int width, int height, int size);
+
+/* new blocked 2d array over 'storage', which must hold
+ * UArray2b_storage_size(width, height, size, block_width, block_height)
+ * bytes laid out as described above. The array does not own the storage:
+ * freeing the array calls 'release' (if not NULL) with the storage and 'cl'
+ */
+extern T UArray2b_wrap(int width, int height, int size, int block_width,
+                       int block_height, void *storage,
+                       void release(void *storage, void *cl), void *cl);
+
+extern void UArray2b_free(T *array2b);
+
+extern int UArray2b_width    (T array2b);
+extern int UArray2b_height   (T array2b);
+extern int UArray2b_size     (T array2b);
+extern int UArray2b_blocksize(T array2b);    /* the block width */
+extern int UArray2b_block_width (T array2b);
+extern int UArray2b_block_height(T array2b);
+
+/* the contiguous storage of all blocks and its length in bytes */
+extern void  *UArray2b_storage(T array2b);
+extern size_t UArray2b_storage_size(int width, int height, int size,
+                                    int block_width, int block_height);
+
+/* return a pointer to the cell in the given column and row.
+ * index out of range is a checked run-time error
+ */
+extern void *UArray2b_at(T array2b, int column, int row);
+
+/* visits every cell in one block before moving to another block */
+extern void UArray2b_map(T array2b,
+                void apply(int col, int row, T array2b, void *elem, void *cl),
+                         void *cl);
+
+/*
+ * it is a checked run-time error to pass a NULL T
+ * to any function in this interface
+ */
+
+#undef T
+#endif
@@ -7,7 +7,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
-#include <uarray2b.h>
+#include "uarray2b.h"
 
 typedef long number;
 